@@ -1,5 +1,8 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <vector>
+#include <immintrin.h>
 #include "Math.h"
 
 namespace dae
@@ -109,5 +112,355 @@ namespace dae
 			return  GeometryFunction_SchlickGGX(n, v, roughness) * GeometryFunction_SchlickGGX(n, l, roughness);
 		}
 
+		/**
+		 * \brief Cook-Torrance specular lobe with a Lambert diffuse lobe, evaluated term by term with the functions above
+		 * Reference for the precomputed evaluation of Material_CookTorrence, see BenchmarkBRDFs in main.cpp
+		 * \param n Normal of the surface
+		 * \param l Normalized light direction
+		 * \param v Normalized view direction
+		 * \param albedo Diffuse color of dielectrics, base reflectivity of metals
+		 * \param metalness 0 for dielectrics, anything else for metals
+		 * \param roughness Roughness of the material
+		 * \return Cook-Torrance Color
+		 */
+		static ColorRGB CookTorrance(const Vector3& n, const Vector3& l, const Vector3& v, const ColorRGB& albedo, float metalness, float roughness)
+		{
+			const ColorRGB f0 = metalness == 0.f ? ColorRGB(0.04f, 0.04f, 0.04f) : albedo;
+			const Vector3 h = (v + l).Normalized();
+
+			//const, the non-const ColorRGB operators write into their left operand
+			const ColorRGB F = FresnelFunction_Schlick(h, v, f0);
+			const float NdotV = Vector3::Dot(v, n);
+			const float NdotL = Vector3::Dot(l, n);
+			const float D = NormalDistribution_GGX(n, h, roughness);
+			const float G = GeometryFunction_Smith(n, v, l, roughness);
+
+			const ColorRGB specular = F * (G * D / (4.0f * NdotV * NdotL));
+			const ColorRGB kd = metalness == 0.f ? (ColorRGB(1.f, 1.f, 1.f) - F) : ColorRGB(0, 0, 0);
+
+			return Lambert(kd, albedo) + specular;
+		}
+
+		/**
+		 * \brief x to the fifth power with three multiplications instead of powf
+		 */
+		static float Pow5(float x)
+		{
+			const float xSqr = x * x;
+			return xSqr * xSqr * x;
+		}
+
+		/**
+		 * \brief BRDF Fresnel Function >> Schlick, for a cosine that is already known
+		 * \param HdotV Cosine between the half vector and the view direction
+		 * \param f0 Base reflectivity of the surface
+		 */
+		static ColorRGB FresnelFunction_Schlick(float HdotV, const ColorRGB& f0)
+		{
+			return f0 + (ColorRGB(1.f, 1.f, 1.f) - f0) * Pow5(1.f - HdotV);
+		}
+
+		/**
+		 * \brief BRDF NormalDistribution >> Trowbridge-Reitz GGX, with the roughness terms precomputed
+		 * \param NdotH Cosine between the normal and the half vector
+		 * \param alphaSqr Square of the GGX alpha, roughness^4
+		 */
+		static float NormalDistribution_GGX(float NdotH, float alphaSqr)
+		{
+			return alphaSqr / (PI * Square(Square(NdotH) * (alphaSqr - 1.f) + 1.f));
+		}
+
+		/**
+		 * \brief BRDF NormalDistribution >> Trowbridge-Reitz GGX read from a table over NdotH and roughness, bilinearly interpolated
+		 * The NdotH axis is spaced by sqrt(1 - NdotH), which gives the peak of smooth materials more entries. Below a roughness of
+		 * about 0.2 the peak is still narrower than a few entries and the error grows quickly, see BenchmarkBRDFs in main.cpp
+		 * \param NdotH Cosine between the normal and the half vector
+		 * \param roughness Roughness of the material
+		 */
+		inline float NormalDistribution_GGXTable(float NdotH, float roughness)
+		{
+			constexpr uint32_t cosineCount{ 256 };
+			constexpr uint32_t roughnessCount{ 64 };
+
+			//Built once at first use, every material shares it
+			static const std::vector<float> table = []
+				{
+					std::vector<float> values(cosineCount * roughnessCount);
+					for (uint32_t j{ 0 }; j < roughnessCount; ++j)
+					{
+						const float alphaSqr = Square(Square(float(j) / float(roughnessCount - 1)));
+						for (uint32_t i{ 0 }; i < cosineCount; ++i)
+							values[i + j * cosineCount] = NormalDistribution_GGX(1.f - Square(float(i) / float(cosineCount - 1)), alphaSqr);
+					}
+					return values;
+				}();
+
+			const float x = std::min(sqrtf(std::max(1.f - NdotH, 0.f)), 1.f) * float(cosineCount - 1);
+			const float y = std::clamp(roughness, 0.f, 1.f) * float(roughnessCount - 1);
+			const uint32_t i = std::min(static_cast<uint32_t>(x), cosineCount - 2);
+			const uint32_t j = std::min(static_cast<uint32_t>(y), roughnessCount - 2);
+			const float fx = x - float(i), fy = y - float(j);
+
+			const float* pRow = table.data() + j * cosineCount + i;
+			const float bottom = pRow[0] + (pRow[1] - pRow[0]) * fx;
+			const float top = pRow[cosineCount] + (pRow[cosineCount + 1] - pRow[cosineCount]) * fx;
+			return bottom + (top - bottom) * fy;
+		}
+
+		/**
+		 * \brief Orthonormal tangent frame around a normal, without branches or normalization (Duff et al. 2017)
+		 * \param n Normalized normal
+		 * \param t Tangent
+		 * \param b Bitangent
+		 */
+		static void GetTangentFrame(const Vector3& n, Vector3& t, Vector3& b)
+		{
+			const float sign = copysignf(1.f, n.z);
+			const float a = -1.f / (sign + n.z);
+			const float c = n.x * n.y * a;
+			t = Vector3{ 1.f + sign * n.x * n.x * a, sign * c, -sign * n.x };
+			b = Vector3{ c, sign + n.y * n.y * a, -n.y };
+		}
+
+		/**
+		 * \brief Cosine weighted direction on the hemisphere around n (Malley's method), follows the Lambert BRDF * cos exactly
+		 * \param n Normal of the surface
+		 * \param u1 Uniform random number in [0, 1)
+		 * \param u2 Uniform random number in [0, 1)
+		 * \return Normalized direction
+		 */
+		static Vector3 SampleCosineHemisphere(const Vector3& n, float u1, float u2)
+		{
+			const float r = sqrtf(u1);
+			const float phi = PI_2 * u2;
+
+			Vector3 t, b;
+			GetTangentFrame(n, t, b);
+			return t * (r * cosf(phi)) + b * (r * sinf(phi)) + n * sqrtf(std::max(1.f - u1, 0.f));
+		}
+
+		/**
+		 * \param n Normal of the surface
+		 * \param l Normalized sampled direction
+		 * \return Probability density (per solid angle) of SampleCosineHemisphere picking l
+		 */
+		static float PdfCosineHemisphere(const Vector3& n, const Vector3& l)
+		{
+			return std::max(Vector3::Dot(n, l), 0.f) / PI;
+		}
+
+		/**
+		 * \brief Smith masking of one direction for GGX, the exact form the visible normal distribution is normalized with
+		 * \param NdotV Cosine between the normal and the direction
+		 * \param roughness Roughness of the material (squared like NormalDistribution_GGX)
+		 */
+		static float GeometryFunction_SmithG1GGX(float NdotV, float roughness)
+		{
+			const float aSqrSqr = Square(Square(roughness));
+			return 2.f * NdotV / (NdotV + sqrtf(aSqrSqr + (1.f - aSqrSqr) * Square(NdotV)));
+		}
+
+		/**
+		 * \brief Picks a microfacet normal from the GGX normals visible from v (Heitz 2018), reflecting v on it follows D * G1 closely
+		 * \param n Normal of the surface
+		 * \param v Normalized view direction, above the surface
+		 * \param roughness Roughness of the material (squared like NormalDistribution_GGX)
+		 * \param u1 Uniform random number in [0, 1)
+		 * \param u2 Uniform random number in [0, 1)
+		 * \return Normalized half vector
+		 */
+		static Vector3 SampleGGXVNDF(const Vector3& n, const Vector3& v, float roughness, float u1, float u2)
+		{
+			const float a = Square(roughness);
+
+			Vector3 t, b;
+			GetTangentFrame(n, t, b);
+
+			//View direction in the tangent frame, stretched to the hemisphere configuration
+			const Vector3 vh = Vector3{ a * Vector3::Dot(v, t), a * Vector3::Dot(v, b), Vector3::Dot(v, n) }.Normalized();
+
+			const float lengthSqr = vh.x * vh.x + vh.y * vh.y;
+			const Vector3 t1 = lengthSqr > 0.f ? Vector3{ -vh.y, vh.x, 0.f } * (1.f / sqrtf(lengthSqr)) : Vector3{ 1.f, 0.f, 0.f };
+			const Vector3 t2 = Vector3::Cross(vh, t1);
+
+			//Uniform point on the projected half disk
+			const float r = sqrtf(u1);
+			const float phi = PI_2 * u2;
+			const float p1 = r * cosf(phi);
+			const float s = 0.5f * (1.f + vh.z);
+			const float p2 = (1.f - s) * sqrtf(std::max(1.f - p1 * p1, 0.f)) + s * r * sinf(phi);
+
+			//Back onto the hemisphere and unstretched
+			const Vector3 nh = t1 * p1 + t2 * p2 + vh * sqrtf(std::max(1.f - p1 * p1 - p2 * p2, 0.f));
+			const Vector3 h = Vector3{ a * nh.x, a * nh.y, std::max(nh.z, 0.f) }.Normalized();
+
+			return (t * h.x + b * h.y + n * h.z).Normalized();
+		}
+
+		/**
+		 * \param n Normal of the surface
+		 * \param v Normalized view direction
+		 * \param l Normalized direction, the reflection of v on the sampled half vector
+		 * \param roughness Roughness of the material
+		 * \return Probability density (per solid angle) of SampleGGXVNDF followed by the reflection picking l
+		 */
+		static float PdfGGXVNDF(const Vector3& n, const Vector3& v, const Vector3& l, float roughness)
+		{
+			const float NdotV = Vector3::Dot(n, v);
+			if (NdotV <= 0.f || Vector3::Dot(n, l) <= 0.f)
+				return 0.f;
+
+			const Vector3 h = (v + l).Normalized();
+			return GeometryFunction_SmithG1GGX(NdotV, roughness) * NormalDistribution_GGX(Vector3::Dot(n, h), Square(Square(roughness))) / (4.f * NdotV);
+		}
+
+#if defined(__AVX2__)
+#pragma region AVX2
+		//The functions below evaluate 8 light directions at once, one per lane, for Material::ShadeBatch
+		//They do the operations of the scalar functions in the same order, so only Pow differs from its scalar version
+
+		inline __m256 Dot(__m256 x1, __m256 y1, __m256 z1, __m256 x2, __m256 y2, __m256 z2)
+		{
+			return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x1, x2), _mm256_mul_ps(y1, y2)), _mm256_mul_ps(z1, z2));
+		}
+
+		inline __m256 Pow5(__m256 x)
+		{
+			const __m256 xSqr = _mm256_mul_ps(x, x);
+			return _mm256_mul_ps(_mm256_mul_ps(xSqr, xSqr), x);
+		}
+
+		//Natural logarithm of positive values, Cephes logf polynomial over the mantissa
+		inline __m256 Log(__m256 x)
+		{
+			const __m256 one = _mm256_set1_ps(1.f);
+			const __m256i bits = _mm256_castps_si256(x);
+			__m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+			__m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_castps_si256(one)));
+
+			//Mantissa in [sqrt(0.5), sqrt(2)) where the polynomial is accurate
+			const __m256 isLarge = _mm256_cmp_ps(mantissa, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+			mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(.5f)), isLarge);
+			exponent = _mm256_add_ps(exponent, _mm256_and_ps(isLarge, one));
+
+			const __m256 f = _mm256_sub_ps(mantissa, one);
+			const __m256 fSqr = _mm256_mul_ps(f, f);
+			__m256 y = _mm256_set1_ps(7.0376836292e-2f);
+			for (const float coefficient : { -1.1514610310e-1f, 1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f,
+				-1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f })
+				y = _mm256_add_ps(_mm256_mul_ps(y, f), _mm256_set1_ps(coefficient));
+			y = _mm256_mul_ps(_mm256_mul_ps(y, f), fSqr);
+
+			//ln(2) split in two so exponent * ln(2) stays exact
+			y = _mm256_add_ps(y, _mm256_mul_ps(exponent, _mm256_set1_ps(-2.12194440e-4f)));
+			y = _mm256_sub_ps(y, _mm256_mul_ps(fSqr, _mm256_set1_ps(.5f)));
+			return _mm256_add_ps(_mm256_add_ps(f, y), _mm256_mul_ps(exponent, _mm256_set1_ps(.693359375f)));
+		}
+
+		//e^x, Cephes expf polynomial, flushes to zero below e^-87
+		inline __m256 Exp(__m256 x)
+		{
+			x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-88.3762626647949f)), _mm256_set1_ps(88.3762626647949f));
+
+			//x = n * ln(2) + r with |r| <= ln(2) / 2
+			const __m256 n = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _mm256_set1_ps(.5f)));
+			x = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(.693359375f)));
+			x = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(-2.12194440e-4f)));
+
+			__m256 y = _mm256_set1_ps(1.9875691500e-4f);
+			for (const float coefficient : { 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f })
+				y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(coefficient));
+			y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, _mm256_mul_ps(x, x)), x), _mm256_set1_ps(1.f));
+
+			//2^n built in the exponent bits
+			const __m256i powerOfTwo = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+			return _mm256_mul_ps(y, _mm256_castsi256_ps(powerOfTwo));
+		}
+
+		/**
+		 * \brief powf of 8 bases to the same exponent, through Exp(exponent * Log(x)), within about 1e-6 relative error for the
+		 * exponents of Phong highlights
+		 * \param x Bases, negative ones are handled like powf: the sign for odd integer exponents, NaN for fractional ones
+		 * \param exponent Exponent
+		 */
+		inline __m256 Pow(__m256 x, float exponent)
+		{
+			const __m256 signBit = _mm256_set1_ps(-0.f);
+			const __m256 magnitude = Exp(_mm256_mul_ps(_mm256_set1_ps(exponent), Log(_mm256_andnot_ps(signBit, x))));
+
+			if (exponent != floorf(exponent))
+				return _mm256_blendv_ps(magnitude, _mm256_set1_ps(NAN), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+			if (fmodf(exponent, 2.f) != 0.f)
+				return _mm256_or_ps(magnitude, _mm256_and_ps(x, signBit));
+			return magnitude;
+		}
+
+		/**
+		 * \brief Phong for 8 light directions
+		 * \param lightX, lightY, lightZ Incoming (incident) Light Directions
+		 * \return Phong Specular Value of every light (the same for every channel)
+		 */
+		inline __m256 Phong(float ks, float exp, __m256 lightX, __m256 lightY, __m256 lightZ, const Vector3& v, const Vector3& n)
+		{
+			const __m256 normalX = _mm256_set1_ps(n.x), normalY = _mm256_set1_ps(n.y), normalZ = _mm256_set1_ps(n.z);
+			const __m256 twoNdotL = _mm256_mul_ps(_mm256_set1_ps(2.f), Dot(normalX, normalY, normalZ, lightX, lightY, lightZ));
+
+			const __m256 rX = _mm256_sub_ps(lightX, _mm256_mul_ps(twoNdotL, normalX));
+			const __m256 rY = _mm256_sub_ps(lightY, _mm256_mul_ps(twoNdotL, normalY));
+			const __m256 rZ = _mm256_sub_ps(lightZ, _mm256_mul_ps(twoNdotL, normalZ));
+			const __m256 cosAlpha = Dot(rX, rY, rZ, _mm256_set1_ps(v.x), _mm256_set1_ps(v.y), _mm256_set1_ps(v.z));
+
+			return _mm256_mul_ps(_mm256_set1_ps(ks), Pow(cosAlpha, exp));
+		}
+
+		/**
+		 * \brief Cook-Torrance with the precomputed terms of Material_CookTorrence for 8 light directions
+		 * \param lightX, lightY, lightZ Normalized light directions
+		 * \param v Normalized view direction
+		 * \param n Normal of the surface
+		 * \param f0 Base reflectivity
+		 * \param diffuse Lambert term of the albedo, black for metals
+		 * \param alphaSqr Square of the GGX alpha, roughness^4
+		 * \param kDirect Schlick-GGX k for direct lighting
+		 * \param red, green, blue Cook-Torrance Color of every light
+		 */
+		inline void CookTorrance(__m256 lightX, __m256 lightY, __m256 lightZ, const Vector3& v, const Vector3& n, const ColorRGB& f0, const ColorRGB& diffuse,
+			float alphaSqr, float kDirect, __m256& red, __m256& green, __m256& blue)
+		{
+			const __m256 one = _mm256_set1_ps(1.f);
+			const __m256 viewX = _mm256_set1_ps(v.x), viewY = _mm256_set1_ps(v.y), viewZ = _mm256_set1_ps(v.z);
+			const __m256 normalX = _mm256_set1_ps(n.x), normalY = _mm256_set1_ps(n.y), normalZ = _mm256_set1_ps(n.z);
+
+			__m256 hX = _mm256_add_ps(viewX, lightX), hY = _mm256_add_ps(viewY, lightY), hZ = _mm256_add_ps(viewZ, lightZ);
+			const __m256 hLength = _mm256_sqrt_ps(Dot(hX, hY, hZ, hX, hY, hZ));
+			hX = _mm256_div_ps(hX, hLength);
+			hY = _mm256_div_ps(hY, hLength);
+			hZ = _mm256_div_ps(hZ, hLength);
+
+			const __m256 NdotV = _mm256_set1_ps(Vector3::Dot(v, n));
+			const __m256 NdotL = Dot(lightX, lightY, lightZ, normalX, normalY, normalZ);
+			const __m256 NdotH = Dot(hX, hY, hZ, normalX, normalY, normalZ);
+			const __m256 fresnel = Pow5(_mm256_sub_ps(one, Dot(hX, hY, hZ, viewX, viewY, viewZ)));
+
+			const __m256 cosineSqr = _mm256_mul_ps(NdotH, NdotH);
+			const __m256 denominatorD = _mm256_add_ps(_mm256_mul_ps(cosineSqr, _mm256_set1_ps(alphaSqr - 1.f)), one);
+			const __m256 D = _mm256_div_ps(_mm256_set1_ps(alphaSqr), _mm256_mul_ps(_mm256_set1_ps(PI), _mm256_mul_ps(denominatorD, denominatorD)));
+
+			const __m256 k = _mm256_set1_ps(kDirect), oneMinusK = _mm256_set1_ps(1.f - kDirect);
+			const __m256 geometryV = _mm256_add_ps(_mm256_mul_ps(NdotV, oneMinusK), k);
+			const __m256 geometryL = _mm256_add_ps(_mm256_mul_ps(NdotL, oneMinusK), k);
+			const __m256 visibility = _mm256_div_ps(D, _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(4.f), geometryV), geometryL));
+
+			const auto channel = [&](float channelF0, float channelDiffuse)
+				{
+					const __m256 F = _mm256_add_ps(_mm256_set1_ps(channelF0), _mm256_mul_ps(_mm256_set1_ps(1.f - channelF0), fresnel));
+					return _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(one, F), _mm256_set1_ps(channelDiffuse)), _mm256_mul_ps(F, visibility));
+				};
+			red = channel(f0.r, diffuse.r);
+			green = channel(f0.g, diffuse.g);
+			blue = channel(f0.b, diffuse.b);
+		}
+#pragma endregion
+#endif
 	}
 }
\ No newline at end of file
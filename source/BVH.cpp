@@ -0,0 +1,1277 @@
+#include "DataTypes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <execution>
+#include <numeric>
+
+namespace dae
+{
+#pragma region BVH Build
+	namespace
+	{
+		constexpr uint32_t amountOfObjectBins{ 16 };
+		constexpr uint32_t amountOfSpatialBins{ 32 };
+
+		//Keeps the traversal stack bounded, deeper nodes become leaves
+		constexpr uint32_t maxDepth{ 60 };
+
+		//Cost of visiting a node, BVHBuildSettings::intersectionCost is the cost of testing a primitive relative to it
+		constexpr float traversalCost{ 1.f };
+
+		//Spatial splits are only tried when the children of the best object split overlap more than this part of the root
+		constexpr float minOverlapRatio{ 1e-5f };
+
+		inline AABB EmptyBounds()
+		{
+			return { Vector3{ FLT_MAX, FLT_MAX, FLT_MAX }, Vector3{ -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+		}
+
+		inline void Grow(AABB& bounds, const Vector3& point)
+		{
+			bounds.min = Vector3::Min(bounds.min, point);
+			bounds.max = Vector3::Max(bounds.max, point);
+		}
+
+		inline void Grow(AABB& bounds, const AABB& other)
+		{
+			bounds.min = Vector3::Min(bounds.min, other.min);
+			bounds.max = Vector3::Max(bounds.max, other.max);
+		}
+
+		inline AABB Intersect(const AABB& a, const AABB& b)
+		{
+			return { Vector3::Max(a.min, b.min), Vector3::Min(a.max, b.max) };
+		}
+
+		inline bool IsValid(const AABB& bounds)
+		{
+			return bounds.min.x <= bounds.max.x && bounds.min.y <= bounds.max.y && bounds.min.z <= bounds.max.z;
+		}
+
+		//Half the surface area, the SAH only compares ratios
+		inline float HalfArea(const AABB& bounds)
+		{
+			if (!IsValid(bounds))
+				return 0.f;
+
+			const Vector3 extent = bounds.max - bounds.min;
+			return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+		}
+
+		//Rays are tested in object space against bounds built from the object space positions, while the triangles
+		//are tested in world space. A small margin keeps both sides agreeing at triangle edges
+		void PadBounds(BVH& bvh, const AABB& rootBounds)
+		{
+			const Vector3 maxAbs = Vector3::Max(Vector3::Max(rootBounds.min, -rootBounds.min), Vector3::Max(rootBounds.max, -rootBounds.max));
+			const float padding = std::max(std::max(maxAbs.x, maxAbs.y), std::max(maxAbs.z, 1.f)) * 1e-5f;
+			const Vector3 margin{ padding, padding, padding };
+
+			for (BVHNode& node : bvh.nodes)
+			{
+				node.min -= margin;
+				node.max += margin;
+			}
+		}
+
+		struct Reference
+		{
+			AABB bounds{};
+			uint32_t triangleIndex{};
+		};
+
+		struct Split
+		{
+			float cost{ FLT_MAX };
+			int axis{ -1 };
+
+			//Bin left of the split plane, spatial splits also store the plane itself
+			uint32_t bin{};
+			float position{};
+			AABB leftBounds{};
+			AABB rightBounds{};
+			uint32_t leftCount{};
+			uint32_t rightCount{};
+			bool isSpatial{ false };
+		};
+
+		//References per parallel work item when binning or partitioning, smaller nodes are handled by a single worker
+		constexpr size_t referenceChunkSize{ 4096 };
+
+		//Runs function(first, last) over chunks of count elements, in parallel when there is more than one chunk
+		template<typename Function>
+		void ForEachChunk(size_t count, const Function& function)
+		{
+			const size_t amountOfChunks = (count + referenceChunkSize - 1) / referenceChunkSize;
+			if (amountOfChunks <= 1)
+			{
+				function(size_t{ 0 }, count, size_t{ 0 });
+				return;
+			}
+
+			std::vector<size_t> chunks(amountOfChunks);
+			std::iota(chunks.begin(), chunks.end(), 0);
+			std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+				function(chunk * referenceChunkSize, std::min((chunk + 1) * referenceChunkSize, count), chunk);
+				});
+		}
+
+		struct ObjectBins
+		{
+			AABB bounds[3][amountOfObjectBins];
+			uint32_t counts[3][amountOfObjectBins]{};
+
+			ObjectBins()
+			{
+				for (auto& axisBounds : bounds)
+					std::fill(std::begin(axisBounds), std::end(axisBounds), EmptyBounds());
+			}
+
+			void Merge(const ObjectBins& other)
+			{
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					for (uint32_t bin{ 0 }; bin < amountOfObjectBins; ++bin)
+					{
+						Grow(bounds[axis][bin], other.bounds[axis][bin]);
+						counts[axis][bin] += other.counts[axis][bin];
+					}
+				}
+			}
+		};
+
+		struct SpatialBins
+		{
+			AABB bounds[3][amountOfSpatialBins];
+			uint32_t entries[3][amountOfSpatialBins]{};
+			uint32_t exits[3][amountOfSpatialBins]{};
+
+			SpatialBins()
+			{
+				for (auto& axisBounds : bounds)
+					std::fill(std::begin(axisBounds), std::end(axisBounds), EmptyBounds());
+			}
+
+			void Merge(const SpatialBins& other)
+			{
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					for (uint32_t bin{ 0 }; bin < amountOfSpatialBins; ++bin)
+					{
+						Grow(bounds[axis][bin], other.bounds[axis][bin]);
+						entries[axis][bin] += other.entries[axis][bin];
+						exits[axis][bin] += other.exits[axis][bin];
+					}
+				}
+			}
+		};
+
+		//Top down binned SAH build, optionally with spatial splits (SBVH). Large nodes bin and partition their references
+		//in parallel chunks and both children of a large node are built as separate tasks
+		class SAHBuilder final
+		{
+		public:
+			//Spatial splits clip triangles, without positions and indices only object splits are used
+			SAHBuilder(const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>* pPositions, const std::vector<int>* pIndices, const BVHBuildSettings& settings, BVH& bvh) :
+				m_PrimitiveBounds{ primitiveBounds },
+				m_pPositions{ pPositions },
+				m_pIndices{ pIndices },
+				m_Settings{ settings },
+				m_Bvh{ bvh }
+			{
+			}
+
+			void Build()
+			{
+				const uint32_t amountOfTriangles = static_cast<uint32_t>(m_PrimitiveBounds.size());
+
+				std::vector<Reference> references(amountOfTriangles);
+				ForEachChunk(amountOfTriangles, [&](size_t first, size_t last, size_t) {
+					for (size_t i{ first }; i < last; ++i)
+						references[i] = { m_PrimitiveBounds[i], static_cast<uint32_t>(i) };
+					});
+
+				m_ReferenceCount = amountOfTriangles;
+				m_UseSpatialSplits = m_Settings.mode == BVHBuildMode::SpatialSplits && m_pPositions && m_pIndices;
+				m_MaxReferenceCount = m_UseSpatialSplits ?
+					static_cast<size_t>(amountOfTriangles * (1.f + std::max(m_Settings.splitBudget, 0.f))) : amountOfTriangles;
+
+				//Workers allocate nodes and leaf ranges from the worst case sizes, trimmed afterwards
+				m_Bvh.nodes.resize(m_MaxReferenceCount * 2);
+				m_Bvh.triangleIndices.resize(m_MaxReferenceCount);
+				m_NodeCount = 1;
+				m_TriangleIndexCount = 0;
+
+				Subdivide(0, references, 0);
+
+				m_Bvh.nodes.resize(m_NodeCount);
+				m_Bvh.triangleIndices.resize(m_TriangleIndexCount);
+				PadBounds(m_Bvh, { m_Bvh.nodes[0].min, m_Bvh.nodes[0].max });
+			}
+
+		private:
+			const std::vector<AABB>& m_PrimitiveBounds;
+			const std::vector<Vector3>* m_pPositions;
+			const std::vector<int>* m_pIndices;
+			const BVHBuildSettings& m_Settings;
+			BVH& m_Bvh;
+
+			bool m_UseSpatialSplits{};
+			std::atomic<size_t> m_ReferenceCount{};
+			size_t m_MaxReferenceCount{};
+			std::atomic<uint32_t> m_NodeCount{};
+			std::atomic<uint32_t> m_TriangleIndexCount{};
+			float m_MinOverlapArea{};
+
+			void Subdivide(uint32_t nodeIndex, std::vector<Reference>& references, uint32_t depth)
+			{
+				const uint32_t count = static_cast<uint32_t>(references.size());
+
+				AABB nodeBounds{ EmptyBounds() };
+				AABB centroidBounds{ EmptyBounds() };
+				std::vector<AABB> chunkBounds((count + referenceChunkSize - 1) / referenceChunkSize * 2);
+				ForEachChunk(count, [&](size_t first, size_t last, size_t chunk) {
+					AABB bounds{ EmptyBounds() };
+					AABB centroids{ EmptyBounds() };
+					for (size_t i{ first }; i < last; ++i)
+					{
+						Grow(bounds, references[i].bounds);
+						Grow(centroids, (references[i].bounds.min + references[i].bounds.max) * 0.5f);
+					}
+					chunkBounds[chunk * 2] = bounds;
+					chunkBounds[chunk * 2 + 1] = centroids;
+					});
+				for (size_t i{ 0 }; i < chunkBounds.size(); i += 2)
+				{
+					Grow(nodeBounds, chunkBounds[i]);
+					Grow(centroidBounds, chunkBounds[i + 1]);
+				}
+
+				m_Bvh.nodes[nodeIndex].min = nodeBounds.min;
+				m_Bvh.nodes[nodeIndex].max = nodeBounds.max;
+
+				if (depth == 0)
+					m_MinOverlapArea = HalfArea(nodeBounds) * minOverlapRatio;
+
+				if (count <= 1 || depth >= maxDepth)
+				{
+					MakeLeaf(nodeIndex, references);
+					return;
+				}
+
+				Split split = FindObjectSplit(references, centroidBounds);
+
+				//Overlapping children are what spatial splits remove, only worth trying while there is budget left
+				if (m_UseSpatialSplits && m_ReferenceCount < m_MaxReferenceCount &&
+					split.axis >= 0 && HalfArea(Intersect(split.leftBounds, split.rightBounds)) > m_MinOverlapArea)
+				{
+					const Split spatialSplit = FindSpatialSplit(references, nodeBounds);
+					if (spatialSplit.cost < split.cost)
+						split = spatialSplit;
+				}
+
+				const float nodeArea = HalfArea(nodeBounds);
+				const float leafCost = m_Settings.intersectionCost * count;
+				const float splitCost = nodeArea > 0.f ? traversalCost + m_Settings.intersectionCost * split.cost / nodeArea : FLT_MAX;
+				if (splitCost >= leafCost && count <= m_Settings.maxLeafSize)
+				{
+					MakeLeaf(nodeIndex, references);
+					return;
+				}
+
+				std::vector<Reference> children[2]{};
+				if (split.axis >= 0)
+				{
+					if (split.isSpatial)
+						PartitionSpatial(references, split, children[0], children[1]);
+					else
+						PartitionObject(references, split, centroidBounds, children[0], children[1]);
+				}
+
+				//No usable split (e.g. all centroids in one spot), halve the references instead
+				if (children[0].empty() || children[1].empty())
+				{
+					children[0].assign(references.begin(), references.begin() + count / 2);
+					children[1].assign(references.begin() + count / 2, references.end());
+				}
+
+				references.clear();
+				references.shrink_to_fit();
+
+				const uint32_t leftIndex = m_NodeCount.fetch_add(2);
+				m_Bvh.nodes[nodeIndex].leftFirst = leftIndex;
+				m_Bvh.nodes[nodeIndex].count = 0;
+
+				//Large subtrees are built as separate tasks
+				if (count >= referenceChunkSize)
+				{
+					std::for_each(std::execution::par, std::begin(children), std::end(children), [&](std::vector<Reference>& childReferences) {
+						const uint32_t child = &childReferences == &children[0] ? 0 : 1;
+						Subdivide(leftIndex + child, childReferences, depth + 1);
+						});
+				}
+				else
+				{
+					Subdivide(leftIndex, children[0], depth + 1);
+					Subdivide(leftIndex + 1, children[1], depth + 1);
+				}
+			}
+
+			void MakeLeaf(uint32_t nodeIndex, const std::vector<Reference>& references)
+			{
+				const uint32_t first = m_TriangleIndexCount.fetch_add(static_cast<uint32_t>(references.size()));
+				m_Bvh.nodes[nodeIndex].leftFirst = first;
+				m_Bvh.nodes[nodeIndex].count = static_cast<uint32_t>(references.size());
+
+				for (size_t i{ 0 }; i < references.size(); ++i)
+					m_Bvh.triangleIndices[first + i] = references[i].triangleIndex;
+			}
+
+			//Binned SAH over the reference centroids, the cost is left unnormalized (area * count)
+			Split FindObjectSplit(const std::vector<Reference>& references, const AABB& centroidBounds) const
+			{
+				const Vector3 extent = centroidBounds.max - centroidBounds.min;
+				const Vector3 scale{
+					extent.x > 0.f ? amountOfObjectBins / extent.x : 0.f,
+					extent.y > 0.f ? amountOfObjectBins / extent.y : 0.f,
+					extent.z > 0.f ? amountOfObjectBins / extent.z : 0.f };
+
+				std::vector<ObjectBins> chunkBins((references.size() + referenceChunkSize - 1) / referenceChunkSize);
+				ForEachChunk(references.size(), [&](size_t first, size_t last, size_t chunk) {
+					ObjectBins& bins = chunkBins[chunk];
+					for (size_t i{ first }; i < last; ++i)
+					{
+						for (int axis{ 0 }; axis < 3; ++axis)
+						{
+							const uint32_t bin = ObjectBin(references[i], axis, centroidBounds.min[axis], scale[axis]);
+							Grow(bins.bounds[axis][bin], references[i].bounds);
+							++bins.counts[axis][bin];
+						}
+					}
+					});
+				for (size_t chunk{ 1 }; chunk < chunkBins.size(); ++chunk)
+					chunkBins[0].Merge(chunkBins[chunk]);
+
+				Split best{};
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					if (extent[axis] > 0.f)
+						SweepBins(chunkBins[0].bounds[axis], chunkBins[0].counts[axis], chunkBins[0].counts[axis], amountOfObjectBins, axis, false, best);
+				}
+
+				return best;
+			}
+
+			//Spatial SAH: every reference is clipped into the bins it spans, entries and exits give the counts per side
+			Split FindSpatialSplit(const std::vector<Reference>& references, const AABB& nodeBounds) const
+			{
+				const Vector3 binWidth = (nodeBounds.max - nodeBounds.min) / static_cast<float>(amountOfSpatialBins);
+
+				std::vector<SpatialBins> chunkBins((references.size() + referenceChunkSize - 1) / referenceChunkSize);
+				ForEachChunk(references.size(), [&](size_t first, size_t last, size_t chunk) {
+					SpatialBins& bins = chunkBins[chunk];
+					for (size_t i{ first }; i < last; ++i)
+					{
+						for (int axis{ 0 }; axis < 3; ++axis)
+						{
+							if (binWidth[axis] <= 0.f)
+								continue;
+
+							const float origin = nodeBounds.min[axis];
+							const uint32_t firstBin = SpatialBin(references[i].bounds.min[axis], origin, binWidth[axis]);
+							const uint32_t lastBin = SpatialBin(references[i].bounds.max[axis], origin, binWidth[axis]);
+
+							Reference remainder{ references[i] };
+							for (uint32_t bin{ firstBin }; bin < lastBin; ++bin)
+							{
+								Reference left{}, right{};
+								SplitReference(remainder, axis, origin + binWidth[axis] * (bin + 1), left, right);
+								Grow(bins.bounds[axis][bin], left.bounds);
+								remainder = right;
+							}
+							Grow(bins.bounds[axis][lastBin], remainder.bounds);
+
+							++bins.entries[axis][firstBin];
+							++bins.exits[axis][lastBin];
+						}
+					}
+					});
+				for (size_t chunk{ 1 }; chunk < chunkBins.size(); ++chunk)
+					chunkBins[0].Merge(chunkBins[chunk]);
+
+				Split best{};
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					if (binWidth[axis] <= 0.f)
+						continue;
+
+					SweepBins(chunkBins[0].bounds[axis], chunkBins[0].entries[axis], chunkBins[0].exits[axis], amountOfSpatialBins, axis, true, best);
+					if (best.axis == axis)
+						best.position = nodeBounds.min[axis] + binWidth[axis] * (best.bin + 1);
+				}
+
+				return best;
+			}
+
+			//Evaluates every plane between bins, keeps the cheapest in best
+			static void SweepBins(const AABB* pBinBounds, const uint32_t* pLeftCounts, const uint32_t* pRightCounts, uint32_t amountOfBins,
+				int axis, bool isSpatial, Split& best)
+			{
+				std::vector<AABB> rightBounds(amountOfBins);
+				std::vector<uint32_t> rightCounts(amountOfBins);
+
+				AABB bounds{ EmptyBounds() };
+				uint32_t count{};
+				for (uint32_t bin{ amountOfBins - 1 }; bin > 0; --bin)
+				{
+					Grow(bounds, pBinBounds[bin]);
+					count += pRightCounts[bin];
+					rightBounds[bin] = bounds;
+					rightCounts[bin] = count;
+				}
+
+				bounds = EmptyBounds();
+				count = 0;
+				for (uint32_t bin{ 0 }; bin + 1 < amountOfBins; ++bin)
+				{
+					Grow(bounds, pBinBounds[bin]);
+					count += pLeftCounts[bin];
+
+					if (count == 0 || rightCounts[bin + 1] == 0)
+						continue;
+
+					const float cost = HalfArea(bounds) * count + HalfArea(rightBounds[bin + 1]) * rightCounts[bin + 1];
+					if (cost < best.cost)
+					{
+						best.cost = cost;
+						best.axis = axis;
+						best.bin = bin;
+						best.leftBounds = bounds;
+						best.rightBounds = rightBounds[bin + 1];
+						best.leftCount = count;
+						best.rightCount = rightCounts[bin + 1];
+						best.isSpatial = isSpatial;
+					}
+				}
+			}
+
+			static uint32_t ObjectBin(const Reference& reference, int axis, float origin, float scale)
+			{
+				const float centroid = (reference.bounds.min[axis] + reference.bounds.max[axis]) * 0.5f;
+				return std::min(static_cast<uint32_t>(std::max((centroid - origin) * scale, 0.f)), amountOfObjectBins - 1);
+			}
+
+			static uint32_t SpatialBin(float position, float origin, float binWidth)
+			{
+				return std::min(static_cast<uint32_t>(std::max((position - origin) / binWidth, 0.f)), amountOfSpatialBins - 1);
+			}
+
+			//Clips the triangle at the plane, both halves stay within the bounds of the original reference
+			void SplitReference(const Reference& reference, int axis, float position, Reference& left, Reference& right) const
+			{
+				left = { EmptyBounds(), reference.triangleIndex };
+				right = { EmptyBounds(), reference.triangleIndex };
+
+				const uint32_t triangle = reference.triangleIndex;
+				for (int i{ 0 }; i < 3; ++i)
+				{
+					const Vector3& v0 = (*m_pPositions)[(*m_pIndices)[triangle * 3 + i]];
+					const Vector3& v1 = (*m_pPositions)[(*m_pIndices)[triangle * 3 + (i + 1) % 3]];
+					const float p0 = v0[axis];
+					const float p1 = v1[axis];
+
+					if (p0 <= position)
+						Grow(left.bounds, v0);
+					if (p0 >= position)
+						Grow(right.bounds, v0);
+
+					//Edge crosses the plane
+					if ((p0 < position && p1 > position) || (p0 > position && p1 < position))
+					{
+						Vector3 intersection = v0 + (v1 - v0) * ((position - p0) / (p1 - p0));
+						intersection[axis] = position;
+						Grow(left.bounds, intersection);
+						Grow(right.bounds, intersection);
+					}
+				}
+
+				left.bounds.max[axis] = position;
+				right.bounds.min[axis] = position;
+				left.bounds = Intersect(left.bounds, reference.bounds);
+				right.bounds = Intersect(right.bounds, reference.bounds);
+			}
+
+			//Classifies the references in parallel chunks, concatenated in chunk order so the result does not depend on the workers
+			template<typename Classify>
+			static void Partition(const std::vector<Reference>& references, std::vector<Reference>& left, std::vector<Reference>& right, const Classify& classify)
+			{
+				const size_t amountOfChunks = (references.size() + referenceChunkSize - 1) / referenceChunkSize;
+				if (amountOfChunks <= 1)
+				{
+					for (const Reference& reference : references)
+						classify(reference, left, right);
+					return;
+				}
+
+				std::vector<std::vector<Reference>> chunkLeft(amountOfChunks);
+				std::vector<std::vector<Reference>> chunkRight(amountOfChunks);
+				ForEachChunk(references.size(), [&](size_t first, size_t last, size_t chunk) {
+					for (size_t i{ first }; i < last; ++i)
+						classify(references[i], chunkLeft[chunk], chunkRight[chunk]);
+					});
+
+				for (size_t chunk{ 0 }; chunk < amountOfChunks; ++chunk)
+				{
+					left.insert(left.end(), chunkLeft[chunk].begin(), chunkLeft[chunk].end());
+					right.insert(right.end(), chunkRight[chunk].begin(), chunkRight[chunk].end());
+				}
+			}
+
+			static void PartitionObject(const std::vector<Reference>& references, const Split& split, const AABB& centroidBounds,
+				std::vector<Reference>& left, std::vector<Reference>& right)
+			{
+				const float origin = centroidBounds.min[split.axis];
+				const float scale = amountOfObjectBins / (centroidBounds.max[split.axis] - origin);
+
+				Partition(references, left, right, [&](const Reference& reference, std::vector<Reference>& leftOut, std::vector<Reference>& rightOut) {
+					if (ObjectBin(reference, split.axis, origin, scale) <= split.bin)
+						leftOut.push_back(reference);
+					else
+						rightOut.push_back(reference);
+					});
+			}
+
+			//References straddling the plane are split, unless moving them whole to one side is cheaper (reference unsplitting)
+			void PartitionSpatial(const std::vector<Reference>& references, const Split& split, std::vector<Reference>& left, std::vector<Reference>& right)
+			{
+				const int axis = split.axis;
+				const float leftArea = HalfArea(split.leftBounds);
+				const float rightArea = HalfArea(split.rightBounds);
+				const float splitCost = leftArea * split.leftCount + rightArea * split.rightCount;
+
+				Partition(references, left, right, [&](const Reference& reference, std::vector<Reference>& leftOut, std::vector<Reference>& rightOut) {
+					if (reference.bounds.max[axis] <= split.position)
+					{
+						leftOut.push_back(reference);
+						return;
+					}
+					if (reference.bounds.min[axis] >= split.position)
+					{
+						rightOut.push_back(reference);
+						return;
+					}
+
+					AABB leftUnion{ split.leftBounds };
+					AABB rightUnion{ split.rightBounds };
+					Grow(leftUnion, reference.bounds);
+					Grow(rightUnion, reference.bounds);
+
+					const float leftOnlyCost = HalfArea(leftUnion) * split.leftCount + rightArea * (split.rightCount - 1);
+					const float rightOnlyCost = leftArea * (split.leftCount - 1) + HalfArea(rightUnion) * split.rightCount;
+
+					Reference leftPart{}, rightPart{};
+					bool isSplit = leftOnlyCost >= splitCost && rightOnlyCost >= splitCost;
+					if (isSplit)
+					{
+						SplitReference(reference, axis, split.position, leftPart, rightPart);
+						isSplit = IsValid(leftPart.bounds) && IsValid(rightPart.bounds) && ReserveReference();
+					}
+
+					if (isSplit)
+					{
+						leftOut.push_back(leftPart);
+						rightOut.push_back(rightPart);
+					}
+					else if (leftOnlyCost <= rightOnlyCost)
+						leftOut.push_back(reference);
+					else
+						rightOut.push_back(reference);
+					});
+			}
+
+			//Claims one extra reference from the split budget, shared by all workers
+			bool ReserveReference()
+			{
+				if (m_ReferenceCount.fetch_add(1) < m_MaxReferenceCount)
+					return true;
+
+				m_ReferenceCount.fetch_sub(1);
+				return false;
+			}
+		};
+
+		//Karras style LBVH: Morton sorted centroids, every inner node found independently, then refit bottom up.
+		//Inner node i splits the sorted range between split and split + 1, its children go in slots 1 + 2 * split and
+		//2 + 2 * split, so the hierarchy comes out with the sibling layout the traversal expects
+		class LinearBuilder final
+		{
+		public:
+			LinearBuilder(const std::vector<AABB>& primitiveBounds, const BVHBuildSettings& settings, BVH& bvh) :
+				m_PrimitiveBounds{ primitiveBounds },
+				m_Settings{ settings },
+				m_Bvh{ bvh },
+				m_AmountOfTriangles{ static_cast<uint32_t>(primitiveBounds.size()) }
+			{
+			}
+
+			void Build()
+			{
+				const uint32_t amountOfTriangles = m_AmountOfTriangles;
+
+				std::vector<uint32_t> triangles(amountOfTriangles);
+				std::iota(triangles.begin(), triangles.end(), 0);
+
+				//Bounds of all centroids
+				AABB centroidBounds{ EmptyBounds() };
+				for (const AABB& bounds : m_PrimitiveBounds)
+					Grow(centroidBounds, (bounds.min + bounds.max) * 0.5f);
+
+				//Morton codes of the centroids, quantized inside the centroid bounds
+				const bool isWide = m_Settings.use63BitMortonCodes;
+				const float gridSize = isWide ? 2097151.f : 1023.f;
+				const Vector3 extent = centroidBounds.max - centroidBounds.min;
+				const Vector3 scale{
+					extent.x > 0.f ? gridSize / extent.x : 0.f,
+					extent.y > 0.f ? gridSize / extent.y : 0.f,
+					extent.z > 0.f ? gridSize / extent.z : 0.f };
+
+				m_Codes.resize(amountOfTriangles);
+				std::for_each(std::execution::par, triangles.begin(), triangles.end(), [&](uint32_t i) {
+					const Vector3 cell = Vector3{
+						((m_PrimitiveBounds[i].min.x + m_PrimitiveBounds[i].max.x) * 0.5f - centroidBounds.min.x) * scale.x,
+						((m_PrimitiveBounds[i].min.y + m_PrimitiveBounds[i].max.y) * 0.5f - centroidBounds.min.y) * scale.y,
+						((m_PrimitiveBounds[i].min.z + m_PrimitiveBounds[i].max.z) * 0.5f - centroidBounds.min.z) * scale.z };
+
+					m_Codes[i] = isWide ?
+						MortonEncode3D(static_cast<uint64_t>(cell.x), static_cast<uint64_t>(cell.y), static_cast<uint64_t>(cell.z)) :
+						MortonEncode3D(static_cast<uint32_t>(cell.x), static_cast<uint32_t>(cell.y), static_cast<uint32_t>(cell.z));
+					});
+
+				m_CodeBits = isWide ? 63 : 30;
+				RadixSort(m_Codes, triangles);
+				m_SortedTriangles = std::move(triangles);
+
+				//Hierarchy, one slot per node
+				const uint32_t amountOfNodes = amountOfTriangles * 2 - 1;
+				m_Bvh.nodes.resize(amountOfNodes);
+				m_Parents.resize(amountOfNodes);
+				m_LeafSlots.resize(amountOfTriangles);
+				m_Costs.resize(amountOfNodes);
+				m_Counts.resize(amountOfNodes);
+
+				if (amountOfTriangles == 1)
+				{
+					SetLeaf(0, 0);
+				}
+				else
+				{
+					std::vector<uint32_t> innerNodes(amountOfTriangles - 1);
+					std::iota(innerNodes.begin(), innerNodes.end(), 0);
+					std::for_each(std::execution::par, innerNodes.begin(), innerNodes.end(), [&](uint32_t i) { EmitInnerNode(i); });
+
+					Refit();
+				}
+
+				Collapse();
+				PadBounds(m_Bvh, { m_Bvh.nodes[0].min, m_Bvh.nodes[0].max });
+			}
+
+		private:
+			//Subtrees per treelet, Karras and Aila found 7 a good balance between build time and quality
+			static constexpr uint32_t treeletSize{ 7 };
+
+			//Elements per parallel work item of the radix sort
+			static constexpr size_t sortChunkSize{ 1 << 16 };
+
+			const std::vector<AABB>& m_PrimitiveBounds;
+			const BVHBuildSettings& m_Settings;
+			BVH& m_Bvh;
+			const uint32_t m_AmountOfTriangles;
+
+			std::vector<uint64_t> m_Codes{};
+			std::vector<uint32_t> m_SortedTriangles{};
+			int m_CodeBits{};
+
+			//Per slot: parent slot, SAH cost of the subtree (unnormalized) and triangles in the subtree
+			std::vector<uint32_t> m_Parents{};
+			std::vector<float> m_Costs{};
+			std::vector<uint32_t> m_Counts{};
+			std::vector<uint32_t> m_LeafSlots{};
+
+			//Parallel LSD radix sort of the codes, 8 bits per pass, only as many passes as the codes have bits
+			void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values) const
+			{
+				const size_t amountOfKeys = keys.size();
+				const size_t amountOfChunks = (amountOfKeys + sortChunkSize - 1) / sortChunkSize;
+
+				std::vector<uint64_t> tempKeys(amountOfKeys);
+				std::vector<uint32_t> tempValues(amountOfKeys);
+				std::vector<size_t> offsets(amountOfChunks * 256);
+				std::vector<size_t> chunks(amountOfChunks);
+				std::iota(chunks.begin(), chunks.end(), 0);
+
+				for (int shift{ 0 }; shift < m_CodeBits; shift += 8)
+				{
+					//Digit histogram per chunk
+					std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+						size_t* pCounts = &offsets[chunk * 256];
+						std::fill(pCounts, pCounts + 256, 0);
+
+						const size_t last = std::min((chunk + 1) * sortChunkSize, amountOfKeys);
+						for (size_t i{ chunk * sortChunkSize }; i < last; ++i)
+							++pCounts[(keys[i] >> shift) & 0xff];
+						});
+
+					//Exclusive prefix sum, digit major so every chunk scatters after the lower chunks of the same digit
+					size_t sum{};
+					for (size_t digit{ 0 }; digit < 256; ++digit)
+					{
+						for (size_t chunk{ 0 }; chunk < amountOfChunks; ++chunk)
+						{
+							const size_t count = offsets[chunk * 256 + digit];
+							offsets[chunk * 256 + digit] = sum;
+							sum += count;
+						}
+					}
+
+					std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+						size_t* pOffsets = &offsets[chunk * 256];
+
+						const size_t last = std::min((chunk + 1) * sortChunkSize, amountOfKeys);
+						for (size_t i{ chunk * sortChunkSize }; i < last; ++i)
+						{
+							const size_t destination = pOffsets[(keys[i] >> shift) & 0xff]++;
+							tempKeys[destination] = keys[i];
+							tempValues[destination] = values[i];
+						}
+						});
+
+					keys.swap(tempKeys);
+					values.swap(tempValues);
+				}
+			}
+
+			//Length of the common prefix of two sorted keys, equal codes fall back on their position
+			int CommonPrefix(int64_t i, int64_t j) const
+			{
+				if (j < 0 || j >= static_cast<int64_t>(m_AmountOfTriangles))
+					return -1;
+
+				const uint64_t difference = m_Codes[i] ^ m_Codes[j];
+				if (difference == 0)
+					return 64 + std::countl_zero(static_cast<uint64_t>(i ^ j));
+
+				return std::countl_zero(difference);
+			}
+
+			void EmitInnerNode(uint32_t index)
+			{
+				const int64_t i = index;
+
+				//Direction of the range, towards the neighbour sharing the longest prefix
+				const int64_t direction = CommonPrefix(i, i + 1) > CommonPrefix(i, i - 1) ? 1 : -1;
+				const int minPrefix = CommonPrefix(i, i - direction);
+
+				//Other end of the range, exponential then binary search
+				int64_t maxLength{ 2 };
+				while (CommonPrefix(i, i + maxLength * direction) > minPrefix)
+					maxLength *= 2;
+
+				int64_t length{ 0 };
+				for (int64_t step{ maxLength / 2 }; step >= 1; step /= 2)
+				{
+					if (CommonPrefix(i, i + (length + step) * direction) > minPrefix)
+						length += step;
+				}
+				const int64_t j = i + length * direction;
+
+				//Split position, the last key sharing more than the node prefix with i
+				const int nodePrefix = CommonPrefix(i, j);
+				int64_t split{ 0 };
+				for (int64_t divisor{ 2 }; ; divisor *= 2)
+				{
+					const int64_t step = (length + divisor - 1) / divisor;
+					if (CommonPrefix(i, i + (split + step) * direction) > nodePrefix)
+						split += step;
+					if (step <= 1)
+						break;
+				}
+				const int64_t gamma = i + split * direction + std::min<int64_t>(direction, 0);
+
+				//Inner nodes other than the root sit at the end of their range that touches the parent split
+				const uint32_t slot = index == 0 ? 0 : (direction < 0 ? 1 + 2 * index : 2 * index);
+				const uint32_t leftSlot = static_cast<uint32_t>(1 + 2 * gamma);
+
+				m_Bvh.nodes[slot].leftFirst = leftSlot;
+				m_Bvh.nodes[slot].count = 0;
+				m_Parents[leftSlot] = slot;
+				m_Parents[leftSlot + 1] = slot;
+
+				if (std::min(i, j) == gamma)
+					SetLeaf(leftSlot, static_cast<uint32_t>(gamma));
+				if (std::max(i, j) == gamma + 1)
+					SetLeaf(leftSlot + 1, static_cast<uint32_t>(gamma + 1));
+			}
+
+			void SetLeaf(uint32_t slot, uint32_t sortedIndex)
+			{
+				const AABB& bounds = m_PrimitiveBounds[m_SortedTriangles[sortedIndex]];
+
+				m_Bvh.nodes[slot] = { bounds.min, sortedIndex, bounds.max, 1 };
+				m_Costs[slot] = m_Settings.intersectionCost * HalfArea(bounds);
+				m_Counts[slot] = 1;
+				m_LeafSlots[sortedIndex] = slot;
+			}
+
+			//Every leaf walks up, the second child to arrive at a node finishes it
+			void Refit()
+			{
+				std::vector<std::atomic<uint32_t>> arrivals(m_Bvh.nodes.size());
+
+				std::for_each(std::execution::par, m_LeafSlots.begin(), m_LeafSlots.end(), [&](uint32_t leafSlot) {
+					uint32_t slot = leafSlot;
+					while (slot != 0)
+					{
+						slot = m_Parents[slot];
+						if (arrivals[slot].fetch_add(1, std::memory_order_acq_rel) == 0)
+							return;
+
+						FinishInnerNode(slot);
+						if (m_Settings.optimizeTreelets)
+							OptimizeTreelet(slot);
+					}
+					});
+			}
+
+			void FinishInnerNode(uint32_t slot)
+			{
+				BVHNode& node = m_Bvh.nodes[slot];
+				const BVHNode& left = m_Bvh.nodes[node.leftFirst];
+				const BVHNode& right = m_Bvh.nodes[node.leftFirst + 1];
+
+				const AABB bounds{ Vector3::Min(left.min, right.min), Vector3::Max(left.max, right.max) };
+				node.min = bounds.min;
+				node.max = bounds.max;
+				m_Costs[slot] = traversalCost * HalfArea(bounds) + m_Costs[node.leftFirst] + m_Costs[node.leftFirst + 1];
+				m_Counts[slot] = m_Counts[node.leftFirst] + m_Counts[node.leftFirst + 1];
+			}
+
+			//Finds the cheapest binary tree over the subtrees of the treelet rooted at slot (dynamic programming over all
+			//subsets) and rebuilds the treelet with it, reusing the sibling slots of its inner nodes
+			void OptimizeTreelet(uint32_t rootSlot)
+			{
+				//Grow the treelet by opening the subtree with the largest surface area
+				uint32_t subtrees[treeletSize]{ m_Bvh.nodes[rootSlot].leftFirst, m_Bvh.nodes[rootSlot].leftFirst + 1 };
+				uint32_t pairs[treeletSize - 1]{ m_Bvh.nodes[rootSlot].leftFirst };
+				uint32_t amountOfSubtrees{ 2 };
+
+				while (amountOfSubtrees < treeletSize)
+				{
+					int largest{ -1 };
+					float largestArea{ -1.f };
+					for (uint32_t i{ 0 }; i < amountOfSubtrees; ++i)
+					{
+						const BVHNode& node = m_Bvh.nodes[subtrees[i]];
+						const float area = HalfArea({ node.min, node.max });
+						if (node.count == 0 && area > largestArea)
+						{
+							largest = static_cast<int>(i);
+							largestArea = area;
+						}
+					}
+					if (largest < 0)
+						break;
+
+					const uint32_t pair = m_Bvh.nodes[subtrees[largest]].leftFirst;
+					pairs[amountOfSubtrees - 1] = pair;
+					subtrees[largest] = pair;
+					subtrees[amountOfSubtrees++] = pair + 1;
+				}
+
+				if (amountOfSubtrees < 3)
+					return;
+
+				//Cheapest cost and partition of every subset of subtrees
+				const uint32_t amountOfSubsets = 1u << amountOfSubtrees;
+				AABB subsetBounds[1u << treeletSize];
+				float subsetCosts[1u << treeletSize];
+				uint32_t subsetPartitions[1u << treeletSize]{};
+
+				for (uint32_t subset{ 1 }; subset < amountOfSubsets; ++subset)
+				{
+					const uint32_t lowest = std::countr_zero(subset);
+					const BVHNode& node = m_Bvh.nodes[subtrees[lowest]];
+					const uint32_t rest = subset & (subset - 1);
+
+					if (rest == 0)
+					{
+						subsetBounds[subset] = { node.min, node.max };
+						subsetCosts[subset] = m_Costs[subtrees[lowest]];
+						continue;
+					}
+
+					subsetBounds[subset] = { Vector3::Min(subsetBounds[rest].min, node.min), Vector3::Max(subsetBounds[rest].max, node.max) };
+				}
+
+				for (uint32_t size{ 2 }; size <= amountOfSubtrees; ++size)
+				{
+					for (uint32_t subset{ 1 }; subset < amountOfSubsets; ++subset)
+					{
+						if (static_cast<uint32_t>(std::popcount(subset)) != size)
+							continue;
+
+						float bestCost{ FLT_MAX };
+						uint32_t bestPartition{};
+						for (uint32_t part = (subset - 1) & subset; part != 0; part = (part - 1) & subset)
+						{
+							const float cost = subsetCosts[part] + subsetCosts[subset ^ part];
+							if (cost < bestCost)
+							{
+								bestCost = cost;
+								bestPartition = part;
+							}
+						}
+
+						subsetCosts[subset] = traversalCost * HalfArea(subsetBounds[subset]) + bestCost;
+						subsetPartitions[subset] = bestPartition;
+					}
+				}
+
+				const uint32_t fullSet = amountOfSubsets - 1;
+				if (subsetCosts[fullSet] >= m_Costs[rootSlot] * 0.999f)
+					return;
+
+				//Subtree roots move to new slots, copy them out first
+				BVHNode subtreeNodes[treeletSize];
+				float subtreeCosts[treeletSize];
+				uint32_t subtreeCounts[treeletSize];
+				for (uint32_t i{ 0 }; i < amountOfSubtrees; ++i)
+				{
+					subtreeNodes[i] = m_Bvh.nodes[subtrees[i]];
+					subtreeCosts[i] = m_Costs[subtrees[i]];
+					subtreeCounts[i] = m_Counts[subtrees[i]];
+				}
+
+				uint32_t amountOfUsedPairs{ 0 };
+				const auto emit = [&](const auto& self, uint32_t slot, uint32_t subset) -> void
+					{
+						if ((subset & (subset - 1)) == 0)
+						{
+							const uint32_t subtree = std::countr_zero(subset);
+							m_Bvh.nodes[slot] = subtreeNodes[subtree];
+							m_Costs[slot] = subtreeCosts[subtree];
+							m_Counts[slot] = subtreeCounts[subtree];
+							return;
+						}
+
+						const uint32_t pair = pairs[amountOfUsedPairs++];
+						BVHNode& node = m_Bvh.nodes[slot];
+						node.min = subsetBounds[subset].min;
+						node.max = subsetBounds[subset].max;
+						node.leftFirst = pair;
+						node.count = 0;
+
+						self(self, pair, subsetPartitions[subset]);
+						self(self, pair + 1, subset ^ subsetPartitions[subset]);
+						m_Costs[slot] = subsetCosts[subset];
+						m_Counts[slot] = m_Counts[pair] + m_Counts[pair + 1];
+					};
+				emit(emit, rootSlot, fullSet);
+			}
+
+			//Turns small subtrees into leaves where the SAH prefers it and writes the final depth first layout. Equal Morton codes
+			//are split by their index, so a cluster of coincident centroids can nest deeper than maxDepth and becomes a leaf there
+			void Collapse()
+			{
+				std::vector<BVHNode> nodes{};
+				nodes.reserve(m_Bvh.nodes.size());
+				m_Bvh.triangleIndices.reserve(m_AmountOfTriangles);
+
+				nodes.emplace_back();
+				CollapseNode(nodes, 0, 0, 0);
+				m_Bvh.nodes.swap(nodes);
+			}
+
+			void CollapseNode(std::vector<BVHNode>& nodes, uint32_t sourceSlot, uint32_t destinationSlot, uint32_t depth)
+			{
+				const BVHNode& source = m_Bvh.nodes[sourceSlot];
+				const uint32_t count = m_Counts[sourceSlot];
+				const float leafCost = m_Settings.intersectionCost * HalfArea({ source.min, source.max }) * count;
+
+				nodes[destinationSlot].min = source.min;
+				nodes[destinationSlot].max = source.max;
+
+				if (source.count > 0 || depth >= maxDepth || (count <= m_Settings.maxLeafSize && leafCost <= m_Costs[sourceSlot]))
+				{
+					nodes[destinationSlot].leftFirst = static_cast<uint32_t>(m_Bvh.triangleIndices.size());
+					nodes[destinationSlot].count = count;
+					GatherTriangles(sourceSlot);
+					return;
+				}
+
+				const uint32_t pair = static_cast<uint32_t>(nodes.size());
+				nodes.emplace_back();
+				nodes.emplace_back();
+				nodes[destinationSlot].leftFirst = pair;
+				nodes[destinationSlot].count = 0;
+
+				CollapseNode(nodes, source.leftFirst, pair, depth + 1);
+				CollapseNode(nodes, source.leftFirst + 1, pair + 1, depth + 1);
+			}
+
+			//Left to right, without recursion since the subtree below a depth limited leaf can be arbitrarily deep
+			void GatherTriangles(uint32_t slot)
+			{
+				std::vector<uint32_t> stack{ slot };
+				while (!stack.empty())
+				{
+					const BVHNode& node = m_Bvh.nodes[stack.back()];
+					stack.pop_back();
+
+					if (node.count > 0)
+					{
+						m_Bvh.triangleIndices.push_back(m_SortedTriangles[node.leftFirst]);
+						continue;
+					}
+
+					stack.push_back(node.leftFirst + 1);
+					stack.push_back(node.leftFirst);
+				}
+			}
+		};
+	}
+
+	void BVH::Build(const std::vector<Vector3>& positions, const std::vector<int>& indices, const BVHBuildSettings& settings)
+	{
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		std::vector<AABB> triangleBounds(indices.size() / 3);
+		ForEachChunk(triangleBounds.size(), [&](size_t first, size_t last, size_t) {
+			for (size_t i{ first }; i < last; ++i)
+			{
+				triangleBounds[i] = EmptyBounds();
+				for (int v{ 0 }; v < 3; ++v)
+					Grow(triangleBounds[i], positions[indices[i * 3 + v]]);
+			}
+			});
+
+		Build(triangleBounds, &positions, &indices, settings);
+
+		buildTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	}
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds, const BVHBuildSettings& settings)
+	{
+		const auto startTime = std::chrono::high_resolution_clock::now();
+
+		Build(primitiveBounds, nullptr, nullptr, settings);
+
+		buildTimeMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	}
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>* pPositions, const std::vector<int>* pIndices, const BVHBuildSettings& settings)
+	{
+		nodes.clear();
+		quantizedNodes.clear();
+		triangleIndices.clear();
+
+		if (!primitiveBounds.empty())
+		{
+			if (settings.mode == BVHBuildMode::Linear)
+			{
+				LinearBuilder builder{ primitiveBounds, settings, *this };
+				builder.Build();
+			}
+			else
+			{
+				SAHBuilder builder{ primitiveBounds, pPositions, pIndices, settings, *this };
+				builder.Build();
+			}
+		}
+
+		if (settings.quantizeNodes && !nodes.empty())
+			Quantize();
+	}
+#pragma endregion
+#pragma region BVH Quantization
+	namespace
+	{
+		//A child of a quantized node: an inner node of the source BVH, or a range of its triangle references
+		struct QuantizationChild
+		{
+			AABB bounds{};
+			bool isLeaf{};
+			uint32_t node{};
+			uint32_t first{};
+			uint32_t count{};
+		};
+
+		//Power of two scale, so decoding q * scale is exact
+		inline float ExponentToScale(int exponent)
+		{
+			return std::bit_cast<float>(static_cast<uint32_t>(exponent + 127) << 23);
+		}
+
+		class Quantizer final
+		{
+		public:
+			Quantizer(const std::vector<BVHNode>& nodes, const std::vector<uint32_t>& triangleIndices,
+				std::vector<QuantizedBVHNode>& quantizedNodes, std::vector<uint32_t>& quantizedTriangleIndices) :
+				m_Nodes{ nodes },
+				m_TriangleIndices{ triangleIndices },
+				m_QuantizedNodes{ quantizedNodes },
+				m_QuantizedTriangleIndices{ quantizedTriangleIndices }
+			{
+			}
+
+			void Quantize()
+			{
+				m_QuantizedNodes.reserve(m_Nodes.size() / 2 + 1);
+				m_QuantizedTriangleIndices.reserve(m_TriangleIndices.size());
+				m_QuantizedNodes.emplace_back();
+
+				const BVHNode& root = m_Nodes[0];
+				const QuantizationChild rootChild{ { root.min, root.max }, root.count > 0, 0, root.leftFirst, root.count };
+
+				//A root leaf still needs a node, with an empty leaf next to it
+				QuantizationChild children[2]{};
+				if (rootChild.isLeaf && rootChild.count <= QuantizedBVHNode::maxLeafCount)
+				{
+					children[0] = rootChild;
+					children[1] = { EmptyBounds(), true, 0, 0, 0 };
+				}
+				else
+				{
+					GetChildren(rootChild, children);
+				}
+
+				EmitNode(0, rootChild.bounds, children);
+			}
+
+		private:
+			const std::vector<BVHNode>& m_Nodes;
+			const std::vector<uint32_t>& m_TriangleIndices;
+			std::vector<QuantizedBVHNode>& m_QuantizedNodes;
+			std::vector<uint32_t>& m_QuantizedTriangleIndices;
+
+			//Leaves larger than a quantized node can count are split in halves sharing the leaf bounds
+			void GetChildren(const QuantizationChild& parent, QuantizationChild(&children)[2]) const
+			{
+				if (parent.isLeaf)
+				{
+					const uint32_t leftCount = parent.count / 2;
+					children[0] = { parent.bounds, true, 0, parent.first, leftCount };
+					children[1] = { parent.bounds, true, 0, parent.first + leftCount, parent.count - leftCount };
+					return;
+				}
+
+				for (uint32_t i{ 0 }; i < 2; ++i)
+				{
+					const uint32_t index = m_Nodes[parent.node].leftFirst + i;
+					const BVHNode& node = m_Nodes[index];
+					children[i] = { { node.min, node.max }, node.count > 0, index, node.leftFirst, node.count };
+				}
+			}
+
+			void EmitNode(uint32_t slot, const AABB& bounds, const QuantizationChild(&children)[2])
+			{
+				QuantizedBVHNode node{};
+				node.origin = bounds.min;
+
+				float scales[3]{};
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					int exponent{};
+					std::frexp((bounds.max[axis] - bounds.min[axis]) / 255.f, &exponent);
+					exponent = std::clamp(exponent, -126, 127);
+
+					node.exponents[axis] = static_cast<int8_t>(exponent);
+					scales[axis] = ExponentToScale(exponent);
+				}
+
+				for (int child{ 0 }; child < 2; ++child)
+					QuantizeBounds(node, child, children[child].bounds, scales);
+
+				//Leaf children small enough to store directly, their references are copied next to each other
+				bool isInner[2]{};
+				node.childTriangles = static_cast<uint32_t>(m_QuantizedTriangleIndices.size());
+				for (int child{ 0 }; child < 2; ++child)
+				{
+					const QuantizationChild& c = children[child];
+					isInner[child] = !c.isLeaf || c.count > QuantizedBVHNode::maxLeafCount;
+					if (isInner[child])
+						continue;
+
+					node.meta |= static_cast<uint8_t>((1 << child) | (c.count << (2 + child * 3)));
+					m_QuantizedTriangleIndices.insert(m_QuantizedTriangleIndices.end(),
+						m_TriangleIndices.begin() + c.first, m_TriangleIndices.begin() + c.first + c.count);
+				}
+
+				//Inner children get adjacent slots before either subtree is written
+				node.childNodes = static_cast<uint32_t>(m_QuantizedNodes.size());
+				const uint32_t amountOfInnerChildren = isInner[0] + isInner[1];
+				m_QuantizedNodes.resize(m_QuantizedNodes.size() + amountOfInnerChildren);
+				m_QuantizedNodes[slot] = node;
+
+				uint32_t childSlot = node.childNodes;
+				for (int child{ 0 }; child < 2; ++child)
+				{
+					if (!isInner[child])
+						continue;
+
+					QuantizationChild grandChildren[2]{};
+					GetChildren(children[child], grandChildren);
+					EmitNode(childSlot++, children[child].bounds, grandChildren);
+				}
+			}
+
+			//Rounds outwards, and checks the float decode so the quantized bounds always contain the real ones
+			static void QuantizeBounds(QuantizedBVHNode& node, int child, const AABB& bounds, const float(&scales)[3])
+			{
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					if (bounds.min[axis] > bounds.max[axis])
+					{
+						node.childMin[child][axis] = 255;
+						node.childMax[child][axis] = 0;
+						continue;
+					}
+
+					const float origin = node.origin[axis];
+					const float scale = scales[axis];
+
+					int minimum = std::clamp(static_cast<int>(std::floor((bounds.min[axis] - origin) / scale)), 0, 255);
+					while (minimum > 0 && origin + minimum * scale > bounds.min[axis])
+						--minimum;
+
+					int maximum = std::clamp(static_cast<int>(std::ceil((bounds.max[axis] - origin) / scale)), 0, 255);
+					while (maximum < 255 && origin + maximum * scale < bounds.max[axis])
+						++maximum;
+
+					node.childMin[child][axis] = static_cast<uint8_t>(minimum);
+					node.childMax[child][axis] = static_cast<uint8_t>(maximum);
+				}
+			}
+		};
+	}
+
+	void BVH::Quantize()
+	{
+		std::vector<uint32_t> quantizedTriangleIndices{};
+		quantizedNodes.clear();
+
+		Quantizer quantizer{ nodes, triangleIndices, quantizedNodes, quantizedTriangleIndices };
+		quantizer.Quantize();
+
+		quantizedRootBounds = { nodes[0].min, nodes[0].max };
+		triangleIndices.swap(quantizedTriangleIndices);
+
+		//The float nodes are what the quantized layout saves memory on
+		nodes.clear();
+		nodes.shrink_to_fit();
+	}
+#pragma endregion
+}
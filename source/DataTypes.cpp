@@ -0,0 +1,305 @@
+#include "DataTypes.h"
+
+#include <algorithm>
+#include <execution>
+#include <immintrin.h>
+
+namespace dae
+{
+#pragma region TriangleMesh Transforms
+	namespace
+	{
+		//Vertices per parallel work item, a multiple of the 8 wide kernel
+		constexpr size_t transformChunkSize{ 4096 };
+
+#if defined(__AVX2__)
+		//Writes 8 SoA vectors as 8 consecutive Vector3's
+		inline void StoreInterleaved(float* pDestination, __m256 x, __m256 y, __m256 z)
+		{
+			const auto storeHalf = [](float* pOut, __m128 x, __m128 y, __m128 z)
+				{
+					const __m128 xyLow = _mm_unpacklo_ps(x, y);
+					const __m128 xyHigh = _mm_unpackhi_ps(x, y);
+
+					//x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+					_mm_storeu_ps(pOut, _mm_shuffle_ps(xyLow, _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0)));
+					_mm_storeu_ps(pOut + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), xyHigh, _MM_SHUFFLE(1, 0, 2, 0)));
+					_mm_storeu_ps(pOut + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+				};
+
+			storeHalf(pDestination, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z));
+			storeHalf(pDestination + 12, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+		}
+
+		inline float ReduceMin(__m256 v)
+		{
+			float values[8];
+			_mm256_storeu_ps(values, v);
+			return *std::min_element(values, values + 8);
+		}
+
+		inline float ReduceMax(__m256 v)
+		{
+			float values[8];
+			_mm256_storeu_ps(values, v);
+			return *std::max_element(values, values + 8);
+		}
+#endif
+
+		//Transforms positions [first, last) as points and returns their bounds
+		AABB TransformPositions(const Vector3SoA& in, Vector3* pOut, size_t first, size_t last, const Matrix& transform)
+		{
+			const Vector3 axisX = transform.GetAxisX();
+			const Vector3 axisY = transform.GetAxisY();
+			const Vector3 axisZ = transform.GetAxisZ();
+			const Vector3 translation = transform.GetTranslation();
+
+			AABB bounds{ { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+			size_t i{ first };
+
+#if defined(__AVX2__)
+			const __m256 m00 = _mm256_set1_ps(axisX.x), m01 = _mm256_set1_ps(axisX.y), m02 = _mm256_set1_ps(axisX.z);
+			const __m256 m10 = _mm256_set1_ps(axisY.x), m11 = _mm256_set1_ps(axisY.y), m12 = _mm256_set1_ps(axisY.z);
+			const __m256 m20 = _mm256_set1_ps(axisZ.x), m21 = _mm256_set1_ps(axisZ.y), m22 = _mm256_set1_ps(axisZ.z);
+			const __m256 tx = _mm256_set1_ps(translation.x), ty = _mm256_set1_ps(translation.y), tz = _mm256_set1_ps(translation.z);
+
+			__m256 minX = _mm256_set1_ps(FLT_MAX), minY = minX, minZ = minX;
+			__m256 maxX = _mm256_set1_ps(-FLT_MAX), maxY = maxX, maxZ = maxX;
+
+			for (; i + 8 <= last; i += 8)
+			{
+				const __m256 x = _mm256_loadu_ps(in.x.data() + i);
+				const __m256 y = _mm256_loadu_ps(in.y.data() + i);
+				const __m256 z = _mm256_loadu_ps(in.z.data() + i);
+
+				const __m256 rx = _mm256_fmadd_ps(x, m00, _mm256_fmadd_ps(y, m10, _mm256_fmadd_ps(z, m20, tx)));
+				const __m256 ry = _mm256_fmadd_ps(x, m01, _mm256_fmadd_ps(y, m11, _mm256_fmadd_ps(z, m21, ty)));
+				const __m256 rz = _mm256_fmadd_ps(x, m02, _mm256_fmadd_ps(y, m12, _mm256_fmadd_ps(z, m22, tz)));
+
+				minX = _mm256_min_ps(minX, rx); maxX = _mm256_max_ps(maxX, rx);
+				minY = _mm256_min_ps(minY, ry); maxY = _mm256_max_ps(maxY, ry);
+				minZ = _mm256_min_ps(minZ, rz); maxZ = _mm256_max_ps(maxZ, rz);
+
+				StoreInterleaved(&pOut[i].x, rx, ry, rz);
+			}
+
+			bounds.min = { ReduceMin(minX), ReduceMin(minY), ReduceMin(minZ) };
+			bounds.max = { ReduceMax(maxX), ReduceMax(maxY), ReduceMax(maxZ) };
+#endif
+
+			for (; i < last; ++i)
+			{
+				pOut[i] = transform.TransformPoint(in.x[i], in.y[i], in.z[i]);
+				bounds.min = Vector3::Min(bounds.min, pOut[i]);
+				bounds.max = Vector3::Max(bounds.max, pOut[i]);
+			}
+
+			return bounds;
+		}
+
+		//Transforms normals [first, last) by the 3x3 part of transform and renormalizes them
+		void TransformNormals(const Vector3SoA& in, Vector3* pOut, size_t first, size_t last, const Matrix& transform)
+		{
+			const Vector3 axisX = transform.GetAxisX();
+			const Vector3 axisY = transform.GetAxisY();
+			const Vector3 axisZ = transform.GetAxisZ();
+
+			size_t i{ first };
+
+#if defined(__AVX2__)
+			const __m256 m00 = _mm256_set1_ps(axisX.x), m01 = _mm256_set1_ps(axisX.y), m02 = _mm256_set1_ps(axisX.z);
+			const __m256 m10 = _mm256_set1_ps(axisY.x), m11 = _mm256_set1_ps(axisY.y), m12 = _mm256_set1_ps(axisY.z);
+			const __m256 m20 = _mm256_set1_ps(axisZ.x), m21 = _mm256_set1_ps(axisZ.y), m22 = _mm256_set1_ps(axisZ.z);
+
+			for (; i + 8 <= last; i += 8)
+			{
+				const __m256 x = _mm256_loadu_ps(in.x.data() + i);
+				const __m256 y = _mm256_loadu_ps(in.y.data() + i);
+				const __m256 z = _mm256_loadu_ps(in.z.data() + i);
+
+				const __m256 rx = _mm256_fmadd_ps(x, m00, _mm256_fmadd_ps(y, m10, _mm256_mul_ps(z, m20)));
+				const __m256 ry = _mm256_fmadd_ps(x, m01, _mm256_fmadd_ps(y, m11, _mm256_mul_ps(z, m21)));
+				const __m256 rz = _mm256_fmadd_ps(x, m02, _mm256_fmadd_ps(y, m12, _mm256_mul_ps(z, m22)));
+
+				const __m256 length = _mm256_sqrt_ps(_mm256_fmadd_ps(rx, rx, _mm256_fmadd_ps(ry, ry, _mm256_mul_ps(rz, rz))));
+
+				StoreInterleaved(&pOut[i].x, _mm256_div_ps(rx, length), _mm256_div_ps(ry, length), _mm256_div_ps(rz, length));
+			}
+#endif
+
+			for (; i < last; ++i)
+			{
+				pOut[i] = transform.TransformVector(in.x[i], in.y[i], in.z[i]).Normalized();
+			}
+		}
+	}
+
+	void TriangleMesh::UpdateTransforms()
+	{
+		// The levels of detail are placed wherever the mesh is
+		for (TriangleMesh& lod : lods)
+		{
+			lod.scaleTransform = scaleTransform;
+			lod.rotationTransform = rotationTransform;
+			lod.translationTransform = translationTransform;
+			lod.UpdateTransforms();
+		}
+
+		// Calculate the final transformation matrix
+		const Matrix finalTransform = scaleTransform * rotationTransform * translationTransform;
+
+		// Keep the SoA copies in sync with the vertices
+		const bool verticesChanged = hasDirtyVertices || objectPositions.Size() != positions.size() || objectNormals.Size() != normals.size() ||
+			objectVertexNormals.Size() != vertexNormals.size();
+		if (verticesChanged)
+		{
+			objectPositions.Assign(positions);
+			objectNormals.Assign(normals);
+			objectVertexNormals.Assign(vertexNormals);
+			// The object space bounds only change with the vertices, the transformed ones come out of the transform pass
+			UpdateAABB();
+
+			needsBvhBuild = true;
+			hasDirtyVertices = false;
+		}
+
+		if (hasTransforms && !verticesChanged && finalTransform == lastTransform)
+			return;
+
+		nextWorldToObject = finalTransform.InverseAffine();
+		// Normals follow the transpose of the inverse, so they stay perpendicular to a non uniformly scaled surface
+		const Matrix normalTransform = Matrix::Transpose(nextWorldToObject);
+
+		nextTransformedPositions.resize(positions.size());
+		nextTransformedNormals.resize(normals.size());
+		nextTransformedVertexNormals.resize(vertexNormals.size());
+
+		// Positions and normals are split in the same chunks, each chunk also bounds its own positions
+		const size_t amountOfChunks = (std::max(positions.size(), normals.size()) + transformChunkSize - 1) / transformChunkSize;
+		assert(vertexNormals.size() <= positions.size());
+		std::vector<size_t> chunkIndices(amountOfChunks);
+		std::vector<AABB> chunkBounds(amountOfChunks);
+		for (size_t i{ 0 }; i < amountOfChunks; ++i) chunkIndices[i] = i;
+
+		std::for_each(std::execution::par, chunkIndices.begin(), chunkIndices.end(), [&](size_t chunk) {
+			const size_t first = chunk * transformChunkSize;
+
+			chunkBounds[chunk] = TransformPositions(objectPositions, nextTransformedPositions.data(),
+				std::min(first, positions.size()), std::min(first + transformChunkSize, positions.size()), finalTransform);
+
+			TransformNormals(objectNormals, nextTransformedNormals.data(),
+				std::min(first, normals.size()), std::min(first + transformChunkSize, normals.size()), normalTransform);
+			TransformNormals(objectVertexNormals, nextTransformedVertexNormals.data(),
+				std::min(first, vertexNormals.size()), std::min(first + transformChunkSize, vertexNormals.size()), normalTransform);
+			});
+
+		nextTransformedMinAABB = positions.empty() ? Vector3{} : chunkBounds[0].min;
+		nextTransformedMaxAABB = positions.empty() ? Vector3{} : chunkBounds[0].max;
+		for (const AABB& bounds : chunkBounds)
+		{
+			nextTransformedMinAABB = Vector3::Min(nextTransformedMinAABB, bounds.min);
+			nextTransformedMaxAABB = Vector3::Max(nextTransformedMaxAABB, bounds.max);
+		}
+
+		lastTransform = finalTransform;
+		hasTransforms = true;
+		hasNextTransforms = true;
+	}
+
+	uint32_t TriangleMesh::GetFootprintLevel(const Ray& ray, uint32_t level) const
+	{
+		// Distance at which the ray enters the bounds, the levels lie inside them so a ray that misses them misses every level
+		const Vector3 invDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+		const Vector3 t1{ (transformedMinAABB.x - ray.origin.x) * invDirection.x, (transformedMinAABB.y - ray.origin.y) * invDirection.y,
+			(transformedMinAABB.z - ray.origin.z) * invDirection.z };
+		const Vector3 t2{ (transformedMaxAABB.x - ray.origin.x) * invDirection.x, (transformedMaxAABB.y - ray.origin.y) * invDirection.y,
+			(transformedMaxAABB.z - ray.origin.z) * invDirection.z };
+		const Vector3 tNear = Vector3::Min(t1, t2);
+		const Vector3 tFar = Vector3::Max(t1, t2);
+		const float tEntry = std::max({ tNear.x, tNear.y, tNear.z, 0.f });
+		if (tEntry > std::min({ tFar.x, tFar.y, tFar.z }) || tEntry > ray.max)
+			return missedLevel;
+
+		const float maxError = ray.GetFootprint(tEntry) * lodFootprintScale;
+		while (level < lods.size() && lodErrors[level] <= maxError)
+			++level;
+		return level;
+	}
+#pragma endregion
+#pragma region SphereSet
+	void SphereSet::BuildBVH()
+	{
+		const size_t amountOfSpheres = Size();
+
+		std::vector<AABB> bounds(amountOfSpheres);
+		for (size_t i{ 0 }; i < amountOfSpheres; ++i)
+		{
+			const Vector3 center{ centers.x[i], centers.y[i], centers.z[i] };
+			const Vector3 extent{ radii[i], radii[i], radii[i] };
+			bounds[i] = { center - extent, center + extent };
+		}
+
+		//The kernel reads the float nodes
+		BVHBuildSettings settings = bvhSettings;
+		settings.quantizeNodes = false;
+		bvh.Build(bounds, settings);
+
+		//Object splits reference every sphere once, in leaf order
+		Vector3SoA sortedCenters{};
+		sortedCenters.x.resize(amountOfSpheres);
+		sortedCenters.y.resize(amountOfSpheres);
+		sortedCenters.z.resize(amountOfSpheres);
+		std::vector<float> sortedRadii(amountOfSpheres);
+		std::vector<unsigned char> sortedMaterialIndices(amountOfSpheres);
+
+		for (size_t i{ 0 }; i < bvh.triangleIndices.size(); ++i)
+		{
+			const uint32_t sphere = bvh.triangleIndices[i];
+			sortedCenters.x[i] = centers.x[sphere];
+			sortedCenters.y[i] = centers.y[sphere];
+			sortedCenters.z[i] = centers.z[sphere];
+			sortedRadii[i] = radii[sphere];
+			sortedMaterialIndices[i] = materialIndices[sphere];
+		}
+
+		centers = std::move(sortedCenters);
+		radii.swap(sortedRadii);
+		materialIndices.swap(sortedMaterialIndices);
+
+		bvh.triangleIndices.clear();
+		bvh.triangleIndices.shrink_to_fit();
+		needsBvhBuild = false;
+	}
+#pragma endregion
+#pragma region QuadSet
+	void QuadSet::BuildBVH()
+	{
+		std::vector<AABB> bounds(quads.size());
+		for (size_t i{ 0 }; i < quads.size(); ++i)
+		{
+			const Quad& q = quads[i];
+			const Vector3 corners[]{ q.origin + q.edge1, q.origin + q.edge2, q.origin + q.edge1 + q.edge2 };
+
+			bounds[i] = { q.origin, q.origin };
+			for (const Vector3& corner : corners)
+			{
+				bounds[i].min = Vector3::Min(bounds[i].min, corner);
+				bounds[i].max = Vector3::Max(bounds[i].max, corner);
+			}
+		}
+
+		BVHBuildSettings settings = bvhSettings;
+		settings.quantizeNodes = false;
+		bvh.Build(bounds, settings);
+
+		std::vector<Quad> sortedQuads(quads.size());
+		for (size_t i{ 0 }; i < bvh.triangleIndices.size(); ++i)
+			sortedQuads[i] = quads[bvh.triangleIndices[i]];
+		quads.swap(sortedQuads);
+
+		bvh.triangleIndices.clear();
+		bvh.triangleIndices.shrink_to_fit();
+		needsBvhBuild = false;
+	}
+#pragma endregion
+}
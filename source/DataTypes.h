@@ -1,12 +1,22 @@
 #pragma once
 #include <cassert>
+#include <cstdint>
+#include <utility>
 
 #include "Math.h"
 #include "vector"
 
 namespace dae
 {
+	struct Ray;
+
 #pragma region GEOMETRY
+	struct AABB
+	{
+		Vector3 min{};
+		Vector3 max{};
+	};
+
 	struct Sphere
 	{
 		Vector3 origin{};
@@ -23,6 +33,26 @@ namespace dae
 		unsigned char materialIndex{ 0 };
 	};
 
+	//Parallelogram spanned by two edges from a corner (a rectangle when they are perpendicular), facing
+	//Cross(edge1, edge2). w projects a point in the plane onto the edges
+	struct Quad
+	{
+		Vector3 origin{};
+		Vector3 edge1{};
+		Vector3 edge2{};
+		Vector3 normal{};
+		Vector3 w{};
+
+		unsigned char materialIndex{ 0 };
+	};
+
+	//Texture coordinates of a vertex, v runs down the image
+	struct TexCoord
+	{
+		float u{};
+		float v{};
+	};
+
 	enum class TriangleCullMode
 	{
 		FrontFaceCulling,
@@ -54,6 +84,169 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	//Structure of arrays copy of a Vector3 array, the layout the batched transform kernel reads
+	struct Vector3SoA
+	{
+		std::vector<float> x{};
+		std::vector<float> y{};
+		std::vector<float> z{};
+
+		void Assign(const std::vector<Vector3>& vectors)
+		{
+			x.resize(vectors.size());
+			y.resize(vectors.size());
+			z.resize(vectors.size());
+
+			for (size_t i{ 0 }; i < vectors.size(); ++i)
+			{
+				x[i] = vectors[i].x;
+				y[i] = vectors[i].y;
+				z[i] = vectors[i].z;
+			}
+		}
+
+		size_t Size() const { return x.size(); }
+	};
+
+	//SoA copy of the scene planes the 8 wide kernel reads, packed between frames. Dot(origin - rayOrigin, normal) only
+	//depends on the ray origin, rays from precomputedOrigin (the frame camera) reuse precomputedNumerators
+	struct PlaneSet
+	{
+		Vector3SoA origins{};
+		Vector3SoA normals{};
+		std::vector<unsigned char> materialIndices{};
+
+		Vector3 precomputedOrigin{};
+		std::vector<float> precomputedNumerators{};
+
+		void Assign(const std::vector<Plane>& planes)
+		{
+			origins.x.resize(planes.size());
+			origins.y.resize(planes.size());
+			origins.z.resize(planes.size());
+			normals.x.resize(planes.size());
+			normals.y.resize(planes.size());
+			normals.z.resize(planes.size());
+			materialIndices.resize(planes.size());
+
+			for (size_t i{ 0 }; i < planes.size(); ++i)
+			{
+				origins.x[i] = planes[i].origin.x;
+				origins.y[i] = planes[i].origin.y;
+				origins.z[i] = planes[i].origin.z;
+				normals.x[i] = planes[i].normal.x;
+				normals.y[i] = planes[i].normal.y;
+				normals.z[i] = planes[i].normal.z;
+				materialIndices[i] = planes[i].materialIndex;
+			}
+		}
+
+		void Precompute(const Vector3& rayOrigin)
+		{
+			precomputedOrigin = rayOrigin;
+			precomputedNumerators.resize(Size());
+
+			for (size_t i{ 0 }; i < Size(); ++i)
+			{
+				const Vector3 origin{ origins.x[i], origins.y[i], origins.z[i] };
+				const Vector3 normal{ normals.x[i], normals.y[i], normals.z[i] };
+				precomputedNumerators[i] = Vector3::Dot(origin - rayOrigin, normal);
+			}
+		}
+
+		size_t Size() const { return materialIndices.size(); }
+	};
+
+	enum class BVHBuildMode
+	{
+		BinnedSAH,
+		SpatialSplits,
+		Linear
+	};
+
+	struct BVHBuildSettings
+	{
+		BVHBuildMode mode{ BVHBuildMode::BinnedSAH };
+
+		//Spatial splits only: extra triangle references allowed, as a fraction of the triangle count
+		float splitBudget{ 0.3f };
+		uint32_t maxLeafSize{ 4 };
+
+		//Linear only: 63 bit Morton codes instead of 30 bit ones, for meshes with small details in large bounds
+		bool use63BitMortonCodes{ false };
+
+		//Linear only: reorganizes treelets of up to 7 subtrees by SAH, slower to build but faster to trace
+		bool optimizeTreelets{ false };
+
+		//Converts the finished BVH to QuantizedBVHNodes, a bit over half the memory for a slightly slower traversal
+		bool quantizeNodes{ false };
+
+		//Cost of testing one primitive relative to visiting a node, lower for primitives tested several at a time
+		float intersectionCost{ 1.f };
+	};
+
+	//Inner nodes (count 0) store their left child in leftFirst, the right child directly follows it
+	//Leaves store count triangle references starting at leftFirst
+	struct BVHNode
+	{
+		Vector3 min{};
+		uint32_t leftFirst{};
+		Vector3 max{};
+		uint32_t count{};
+	};
+
+	//Inner node storing the bounds of both children in 8 bits per side, relative to the bounds of the node itself
+	//(origin + q * 2^exponent, rounded outwards). Inner children are stored next to each other from childNodes, the
+	//triangle references of leaf children from childTriangles, the right leaf's after the left leaf's
+	struct QuantizedBVHNode
+	{
+		Vector3 origin{};
+		int8_t exponents[3]{};
+
+		//Bit 0/1: left/right child is a leaf, bits 2-4/5-7: triangle count of the left/right leaf
+		uint8_t meta{};
+
+		uint8_t childMin[2][3]{};
+		uint8_t childMax[2][3]{};
+		uint32_t childNodes{};
+		uint32_t childTriangles{};
+
+		static constexpr uint32_t maxLeafCount{ 7 };
+
+		bool IsLeaf(int child) const { return (meta >> child) & 1; }
+		uint32_t GetLeafCount(int child) const { return (meta >> (2 + child * 3)) & 7; }
+	};
+
+	struct BVH
+	{
+		//Either nodes or quantizedNodes is filled, depending on BVHBuildSettings::quantizeNodes
+		std::vector<BVHNode> nodes{};
+		std::vector<QuantizedBVHNode> quantizedNodes{};
+		AABB quantizedRootBounds{};
+
+		//Triangle per reference, with spatial splits a triangle can be referenced by several leaves
+		std::vector<uint32_t> triangleIndices{};
+
+		float buildTimeMs{};
+
+		void Build(const std::vector<Vector3>& positions, const std::vector<int>& indices, const BVHBuildSettings& settings);
+
+		//Builds over any kind of primitive from its bounds, references then index those primitives. Spatial splits
+		//need triangles to clip, without them SpatialSplits builds a binned SAH BVH
+		void Build(const std::vector<AABB>& primitiveBounds, const BVHBuildSettings& settings);
+
+		bool IsEmpty() const { return nodes.empty() && quantizedNodes.empty(); }
+
+		size_t GetMemorySize() const
+		{
+			return nodes.size() * sizeof(BVHNode) + quantizedNodes.size() * sizeof(QuantizedBVHNode) + triangleIndices.size() * sizeof(uint32_t);
+		}
+
+	private:
+		void Build(const std::vector<AABB>& primitiveBounds, const std::vector<Vector3>* pPositions, const std::vector<int>* pIndices, const BVHBuildSettings& settings);
+		void Quantize();
+	};
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -76,6 +269,11 @@ namespace dae
 		std::vector<Vector3> positions{};
 		std::vector<Vector3> normals{};
 		std::vector<int> indices{};
+
+		//Per vertex normals for smooth shading, left empty for flat shaded meshes
+		std::vector<Vector3> vertexNormals{};
+		//Per vertex texture coordinates, left empty for meshes without textures
+		std::vector<TexCoord> texCoords{};
 		unsigned char materialIndex{};
 
 		TriangleCullMode cullMode{TriangleCullMode::BackFaceCulling};
@@ -92,6 +290,44 @@ namespace dae
 
 		std::vector<Vector3> transformedPositions{};
 		std::vector<Vector3> transformedNormals{};
+		std::vector<Vector3> transformedVertexNormals{};
+
+		//Double buffered: UpdateTransforms writes these while the current transforms are being traced
+		std::vector<Vector3> nextTransformedPositions{};
+		std::vector<Vector3> nextTransformedNormals{};
+		std::vector<Vector3> nextTransformedVertexNormals{};
+		Vector3 nextTransformedMinAABB;
+		Vector3 nextTransformedMaxAABB;
+		bool hasNextTransforms{ false };
+
+		//Object space vertices in SoA form and the transform they were last transformed with
+		Vector3SoA objectPositions{};
+		Vector3SoA objectNormals{};
+		Vector3SoA objectVertexNormals{};
+		Matrix lastTransform{};
+		bool hasTransforms{ false };
+
+		//Set by scenes that edit the vertices in place (deforming meshes), the next UpdateTransforms then rebuilds the BVH
+		bool hasDirtyVertices{ false };
+		bool needsBvhBuild{ false };
+
+		//Object space BVH, rebuilt when the vertices change. Rays are moved into object space to traverse it
+		BVHBuildSettings bvhSettings{};
+		BVH bvh{};
+		BVH nextBvh{};
+		bool hasNextBvh{ false };
+		Matrix worldToObject{};
+		Matrix nextWorldToObject{};
+
+		//Levels of detail from GenerateLODs, each with about a quarter of the triangles of the level before. They follow the transforms
+		//of the mesh, lodErrors holds how far each one is estimated to be from the mesh, in object space
+		std::vector<TriangleMesh> lods{};
+		std::vector<float> lodErrors{};
+		//Level traced this frame, 0 is the mesh itself. Rays whose lodSelector is below lodBlend trace the next coarser level instead
+		uint32_t lodLevel{ 0 };
+		float lodBlend{ 0.f };
+		//Object space size of a world space footprint, zero while the levels of detail are off
+		float lodFootprintScale{ 0.f };
 
 		void Translate(const Vector3& translation)
 		{
@@ -137,38 +373,103 @@ namespace dae
 			}
 		}
 
-		void UpdateTransforms()
+		//Area weighted average of the normals of every triangle sharing the vertex
+		void CalculateVertexNormals()
 		{
-			// Calculate the final transformation matrix
-			Matrix finalTransform = scaleTransform * rotationTransform * translationTransform;
+			vertexNormals.assign(positions.size(), Vector3::Zero);
 
-			// Initialize transformedPositions and transformedNormals with the same size as positions and normals
-			transformedPositions.resize(positions.size());
-			transformedNormals.resize(normals.size());
+			for (size_t i{ 0 }; i + 2 < indices.size(); i += 3)
+			{
+				const Vector3 edgeV0V1 = positions[indices[i + 1]] - positions[indices[i]];
+				const Vector3 edgeV0V2 = positions[indices[i + 2]] - positions[indices[i]];
+
+				//Not normalized, its length is twice the area of the triangle
+				const Vector3 weightedNormal = Vector3::Cross(edgeV0V1, edgeV0V2);
+				vertexNormals[indices[i]] += weightedNormal;
+				vertexNormals[indices[i + 1]] += weightedNormal;
+				vertexNormals[indices[i + 2]] += weightedNormal;
+			}
 
-			// Apply the transformation to each position and normal
-			for (size_t i = 0; i < positions.size(); ++i)
+			for (Vector3& normal : vertexNormals)
 			{
-				Vector3 positionVector(positions[i].x, positions[i].y, positions[i].z);
-				
-				// Apply the transformation to the position
-				Vector3 transformedPositionVector = finalTransform.TransformVector(positionVector);
+				if (normal.SqrMagnitude() > 0.f)
+					normal.Normalize();
+			}
+		}
 
-				transformedPositionVector += translationTransform.GetTranslation();
+		bool HasVertexNormals() const { return !vertexNormals.empty() && vertexNormals.size() == positions.size(); }
+		bool HasTexCoords() const { return !texCoords.empty() && texCoords.size() == positions.size(); }
+
+		//Transforms all positions and normals into the next buffers, skipped when neither the transform nor the vertex count changed
+		void UpdateTransforms();
+
+		//Simplifies the mesh into up to maxLevelCount levels of detail with the quadric error metric (Garland and Heckbert 1997)
+		//Vertices are only merged into their neighbours, so the levels keep the texture coordinates of the mesh. Their vertex normals
+		//are recalculated, the ones of the mesh hold detail that the larger triangles can not show
+		//Borders only collapse along themselves and vertices shared by several texture or normal seams are kept
+		//Called once after loading, a mesh whose vertices are edited afterwards needs new levels
+		void GenerateLODs(uint32_t maxLevelCount = 6, uint32_t minTriangleCount = 64);
+
+		const TriangleMesh& GetLOD(uint32_t level) const { return level == 0 ? *this : lods[level - 1]; }
+		//Level of detail a ray traces, lodLevel (or the next one for its lodSelector) or coarser where the footprint of the ray
+		//where it enters the bounds is wide enough for the error of a coarser level (rays after a rough or curved bounce)
+		//The footprint test already finds rays that miss the bounds, missedLevel lets the caller skip the mesh
+		static constexpr uint32_t missedLevel{ UINT32_MAX };
+		uint32_t GetTracedLevel(const Ray& ray) const;
+		uint32_t GetFootprintLevel(const Ray& ray, uint32_t level) const;
+
+		//Rebuilds the traced BVH right away, only called while the mesh is not being traced
+		void BuildBVH()
+		{
+			bvh.Build(positions, indices, bvhSettings);
+			hasNextBvh = false;
+			needsBvhBuild = false;
 
-				transformedPositions[i] = transformedPositionVector;
+			for (TriangleMesh& lod : lods)
+			{
+				lod.bvhSettings = bvhSettings;
+				lod.BuildBVH();
 			}
+		}
+
+		//Builds the next BVH if UpdateTransforms saw the vertices change, the scene does this for all meshes at once
+		void UpdateBVH()
+		{
+			for (TriangleMesh& lod : lods)
+				lod.UpdateBVH();
+
+			if (!needsBvhBuild)
+				return;
+
+			nextBvh.Build(positions, indices, bvhSettings);
+			hasNextBvh = true;
+			needsBvhBuild = false;
+		}
+
+		//Makes the transforms written by UpdateTransforms the traced ones, only called between frames
+		bool SwapTransforms()
+		{
+			for (TriangleMesh& lod : lods)
+				lod.SwapTransforms();
 
-			for (int i{ 0 }; i < normals.size() ; ++i) {
-				Vector3 normalVector(normals[i].x, normals[i].y, normals[i].z);
+			if (!hasNextTransforms)
+				return false;
 
-				// Apply the rotation part of the transformation to the normal
-				Vector3 transformedNormalVector = rotationTransform.TransformVector(normalVector);
-				transformedNormals[i] = transformedNormalVector.Normalized();
+			if (hasNextBvh)
+			{
+				std::swap(bvh, nextBvh);
+				hasNextBvh = false;
 			}
+			worldToObject = nextWorldToObject;
 
-			UpdateTransformedAABB(finalTransform);
+			transformedPositions.swap(nextTransformedPositions);
+			transformedNormals.swap(nextTransformedNormals);
+			transformedVertexNormals.swap(nextTransformedVertexNormals);
+			transformedMinAABB = nextTransformedMinAABB;
+			transformedMaxAABB = nextTransformedMaxAABB;
 
+			hasNextTransforms = false;
+			return true;
 		}
 
 		void UpdateAABB() {
@@ -183,51 +484,78 @@ namespace dae
 				}
 			}
 		}
-		void UpdateTransformedAABB(const Matrix& finalTransform) 
-		{
-			Vector3 tMinAABB = finalTransform.TransformPoint(minAABB);
-			Vector3 tMaxAABB = tMinAABB;
 
-			Vector3 tAABB = finalTransform.TransformPoint(maxAABB.x, minAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+	};
 
-			tAABB = finalTransform.TransformPoint(maxAABB.x, minAABB.y, maxAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+	//Large amounts of spheres (particles, molecules) as a single primitive. The spheres are stored as SoA in the order
+	//of the BVH leaves, so every leaf is a run of spheres the 8 wide kernel tests at once
+	struct SphereSet
+	{
+		static constexpr uint32_t batchSize{ 8 };
 
-			tAABB = finalTransform.TransformPoint(minAABB.x, minAABB.y, maxAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		Vector3SoA centers{};
+		std::vector<float> radii{};
+		std::vector<unsigned char> materialIndices{};
 
-			 tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		//World space BVH, leaves index the spheres directly. A leaf of up to a batch costs about as much as a node
+		BVHBuildSettings bvhSettings{ BVHBuildMode::BinnedSAH, 0.f, batchSize, false, false, false, 1.f / batchSize };
+		BVH bvh{};
+		bool needsBvhBuild{ false };
 
-			 tAABB = finalTransform.TransformPoint(maxAABB.x, maxAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		void AddSphere(const Vector3& center, float radius, unsigned char materialIndex = 0)
+		{
+			centers.x.push_back(center.x);
+			centers.y.push_back(center.y);
+			centers.z.push_back(center.z);
+			radii.push_back(radius);
+			materialIndices.push_back(materialIndex);
+			needsBvhBuild = true;
+		}
 
-			 tAABB = finalTransform.TransformPoint(maxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		size_t Size() const { return radii.size(); }
 
-			 tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		//Builds the BVH and sorts the spheres into leaf order, only called while the set is not being traced
+		void BuildBVH();
+	};
 
-			transformedMinAABB = tMinAABB;
-			transformedMaxAABB = tMaxAABB;
-		}
+	//Bounded planes as a BVH primitive, the quads are sorted in the order of the BVH leaves like a SphereSet
+	struct QuadSet
+	{
+		std::vector<Quad> quads{};
+
+		//World space BVH, leaves index the quads directly
+		BVHBuildSettings bvhSettings{};
+		BVH bvh{};
+		bool needsBvhBuild{ false };
 
+		void AddQuad(const Vector3& origin, const Vector3& edge1, const Vector3& edge2, unsigned char materialIndex = 0)
+		{
+			const Vector3 n = Vector3::Cross(edge1, edge2);
+
+			Quad q{};
+			q.origin = origin;
+			q.edge1 = edge1;
+			q.edge2 = edge2;
+			q.normal = n.Normalized();
+			q.w = n / Vector3::Dot(n, n);
+			q.materialIndex = materialIndex;
+
+			quads.push_back(q);
+			needsBvhBuild = true;
+		}
 
+		//Builds the BVH and sorts the quads into leaf order, only called while the set is not being traced
+		void BuildBVH();
 	};
 #pragma endregion
 #pragma region LIGHT
 	enum class LightType
 	{
 		Point,
-		Directional
+		Directional,
+		//Area lights, shaded from points spread over their surface, which gives soft shadows
+		Rectangle,
+		Sphere
 	};
 
 	struct Light
@@ -237,8 +565,42 @@ namespace dae
 		ColorRGB color{};
 		float intensity{};
 
+		//A rectangle light is centered on origin, spans edge1 and edge2 and emits to the side of direction
+		Vector3 edge1{};
+		Vector3 edge2{};
+		float radius{};
+
 		LightType type{};
 	};
+
+	//Up to 8 lights seen from one hit in SoA layout, shaded together by Material::ShadeBatch
+	struct LightBatch
+	{
+		static constexpr uint32_t size{ 8 };
+
+		//Normalized directions from the hit towards the lights
+		alignas(32) float directionX[size]{};
+		alignas(32) float directionY[size]{};
+		alignas(32) float directionZ[size]{};
+		//Radiance arriving from every light, ShadeBatch replaces it by the radiance reflected towards the viewer
+		alignas(32) float red[size]{};
+		alignas(32) float green[size]{};
+		alignas(32) float blue[size]{};
+
+		uint32_t count{ 0 };
+
+		void Add(const Vector3& direction, const ColorRGB& radiance)
+		{
+			assert(count < size);
+			directionX[count] = direction.x;
+			directionY[count] = direction.y;
+			directionZ[count] = direction.z;
+			red[count] = radiance.r;
+			green[count] = radiance.g;
+			blue[count] = radiance.b;
+			++count;
+		}
+	};
 #pragma endregion
 #pragma region MISC
 	struct Ray
@@ -248,6 +610,90 @@ namespace dae
 
 		float min{ 0.0001f };
 		float max{ FLT_MAX };
+
+		//Cone around the ray that holds its pixel footprint, footprintWidth wide at the origin and footprintSpread wider per unit of
+		//distance. Only filled in for rays after a bounce in scenes with levels of detail, wide footprints trace coarser levels
+		float footprintWidth{};
+		float footprintSpread{};
+
+		float GetFootprint(float distance) const { return footprintWidth + footprintSpread * distance; }
+
+		//Uniform number in [0, 1) shared by every ray of a pixel sample, picks one of the two levels of detail of a mesh that is
+		//switching between them (TriangleMesh::lodBlend). The rays of a sample then all see the same geometry
+		float lodSelector{};
+		//Mesh and level of detail of the surface a shadow ray leaves, that mesh is tested at the same level so another one can not
+		//shadow the surface. UINT16_MAX for other rays, 16 bits each so the ray only grows by 4 bytes
+		uint16_t lodMeshIndex{ UINT16_MAX };
+		uint16_t lodMeshLevel{};
+	};
+
+	inline uint32_t TriangleMesh::GetTracedLevel(const Ray& ray) const
+	{
+		const uint32_t level = ray.lodSelector < lodBlend ? lodLevel + 1 : lodLevel;
+		if (lodFootprintScale <= 0.f || level >= lods.size() || (ray.footprintWidth <= 0.f && ray.footprintSpread <= 0.f))
+			return level;
+
+		return GetFootprintLevel(ray, level);
+	}
+
+	//Offsets of the origin and direction of a ray to the rays through the neighbouring pixel on the right (x) and below (y)
+	//Transferred to a hit they give the footprint of the pixel on the surface (Igehy 1999)
+	struct RayDifferential
+	{
+		Vector3 originX{};
+		Vector3 originY{};
+		Vector3 directionX{};
+		Vector3 directionY{};
+		bool isValid{ false };
+	};
+
+	//Up to 8 rays in SoA layout, traced together by the packet kernels in the space of the BVH they traverse
+	struct RayPacket
+	{
+		static constexpr uint32_t size{ 8 };
+
+		alignas(32) float originX[size]{};
+		alignas(32) float originY[size]{};
+		alignas(32) float originZ[size]{};
+		alignas(32) float directionX[size]{};
+		alignas(32) float directionY[size]{};
+		alignas(32) float directionZ[size]{};
+		alignas(32) float invDirectionX[size]{};
+		alignas(32) float invDirectionY[size]{};
+		alignas(32) float invDirectionZ[size]{};
+		alignas(32) float tMin[size]{};
+		alignas(32) float tMax[size]{};
+
+		//Bounds of every ray segment in the packet, nodes outside of them are skipped without testing the rays
+		//Rays towards the same point light share their end point, which keeps these bounds tight
+		AABB bounds{ { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+
+		void SetRay(uint32_t lane, const Vector3& origin, const Vector3& direction, float min, float max)
+		{
+			originX[lane] = origin.x;
+			originY[lane] = origin.y;
+			originZ[lane] = origin.z;
+			directionX[lane] = direction.x;
+			directionY[lane] = direction.y;
+			directionZ[lane] = direction.z;
+			invDirectionX[lane] = 1.f / direction.x;
+			invDirectionY[lane] = 1.f / direction.y;
+			invDirectionZ[lane] = 1.f / direction.z;
+			tMin[lane] = min;
+			tMax[lane] = max;
+
+			const Vector3 end = origin + direction * max;
+			bounds.min = Vector3::Min(bounds.min, Vector3::Min(origin, end));
+			bounds.max = Vector3::Max(bounds.max, Vector3::Max(origin, end));
+		}
+
+		//Grows the bounds a little so rounding never culls a node a ray still touches
+		void PadBounds()
+		{
+			const Vector3 padding = (bounds.max - bounds.min) * 1e-4f + Vector3{ 1e-4f, 1e-4f, 1e-4f };
+			bounds.min -= padding;
+			bounds.max += padding;
+		}
 	};
 
 	struct HitRecord
@@ -256,6 +702,24 @@ namespace dae
 		Vector3 normal{};
 		float t = FLT_MAX;
 
+		//Barycentric weights of v1 and v2 for triangle hits (v0 gets 1 - u - v)
+		float u{};
+		float v{};
+
+		//How fast the normal turns per unit moved along the surface (1 / radius for spheres), used to widen reflected ray differentials
+		float curvature{};
+
+		//Texture coordinates and their world space gradients in the plane of the hit, only set for meshes with texture coordinates
+		TexCoord texCoord{};
+		Vector3 dUdP{};
+		Vector3 dVdP{};
+		//Size of the pixel footprint in texture coordinates, picks the mip level of the textures. Zero samples the largest level
+		float texFootprint{};
+		//Ray::lodSelector of the ray that found the hit and the mesh and level of detail it hit (if any), handed on to its shadow rays
+		float lodSelector{};
+		uint16_t lodMeshIndex{ UINT16_MAX };
+		uint16_t lodMeshLevel{};
+
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
 	};
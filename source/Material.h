@@ -2,7 +2,13 @@
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
+#include "Texture.h"
 #include <iostream>
+#include <optional>
+
+//Reads the GGX normal distribution from a table instead of evaluating it, off because the analytic one is a single division
+//and measured faster than the lookup, see BenchmarkBRDFs in main.cpp for the time and the error of both
+//#define GGX_LOOKUP_TABLE
 
 namespace dae
 {
@@ -26,6 +32,80 @@ namespace dae
 		 * \return color
 		 */
 		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+
+		/**
+		 * \brief Shades every light of a batch, the radiance of each is multiplied by Shade and the cosine towards it
+		 * \param hitRecord current hitrecord
+		 * \param v view direction
+		 * \param batch lights above the surface, their radiance is replaced by the radiance they reflect towards v
+		 */
+		virtual void ShadeBatch(const HitRecord& hitRecord, const Vector3& v, LightBatch& batch)
+		{
+			for (uint32_t i{ 0 }; i < batch.count; ++i)
+			{
+				const Vector3 l{ batch.directionX[i], batch.directionY[i], batch.directionZ[i] };
+				const ColorRGB shading = Shade(hitRecord, l, v);
+				const float angleCos = Vector3::Dot(hitRecord.normal, l);
+
+				batch.red[i] = batch.red[i] * shading.r * angleCos;
+				batch.green[i] = batch.green[i] * shading.g * angleCos;
+				batch.blue[i] = batch.blue[i] * shading.b * angleCos;
+			}
+		}
+
+		/**
+		 * \brief Picks a light direction for the view direction, as close to in proportion to Shade * cos as the material can
+		 * \param hitRecord current hitrecord
+		 * \param v view direction
+		 * \param u1 uniform random number in [0, 1)
+		 * \param u2 uniform random number in [0, 1)
+		 * \param l picked light direction
+		 * \param pdf probability density (per solid angle) of picking l, zero when no direction was picked
+		 * \return color (Shade for l)
+		 */
+		virtual ColorRGB Sample(const HitRecord& hitRecord, const Vector3& v, float u1, float u2, Vector3& l, float& pdf)
+		{
+			l = BRDF::SampleCosineHemisphere(hitRecord.normal, u1, u2);
+			pdf = BRDF::PdfCosineHemisphere(hitRecord.normal, l);
+			return pdf > 0.f ? Shade(hitRecord, l, v) : ColorRGB{};
+		}
+
+		/**
+		 * \brief Weight of the mirror reflection traced from a hit, black for materials that do not reflect
+		 * \param hitRecord current hitrecord
+		 * \param v view direction
+		 * \return reflectance
+		 */
+		virtual ColorRGB GetReflectance(const HitRecord& hitRecord, const Vector3& v) const { return {}; }
+
+		/**
+		 * \brief Weight of the ray refracted through a hit, black for opaque materials
+		 * \param hitRecord current hitrecord
+		 * \param v view direction
+		 * \return transmittance
+		 */
+		virtual ColorRGB GetTransmittance(const HitRecord& hitRecord, const Vector3& v) const { return {}; }
+		virtual float GetIndexOfRefraction() const { return 1.f; }
+
+	protected:
+#if defined(__AVX2__)
+		//The AVX2 ShadeBatch of the materials only computes the BRDF of every lane, these load the directions and apply it
+		static void LoadDirections(const LightBatch& batch, const Vector3& n, __m256& x, __m256& y, __m256& z, __m256& angleCos)
+		{
+			x = _mm256_load_ps(batch.directionX);
+			y = _mm256_load_ps(batch.directionY);
+			z = _mm256_load_ps(batch.directionZ);
+			angleCos = BRDF::Dot(_mm256_set1_ps(n.x), _mm256_set1_ps(n.y), _mm256_set1_ps(n.z), x, y, z);
+		}
+
+		//radiance * BRDF * cos, in the order of the scalar ShadeBatch
+		static void StoreReflected(LightBatch& batch, __m256 angleCos, __m256 red, __m256 green, __m256 blue)
+		{
+			_mm256_store_ps(batch.red, _mm256_mul_ps(_mm256_mul_ps(_mm256_load_ps(batch.red), red), angleCos));
+			_mm256_store_ps(batch.green, _mm256_mul_ps(_mm256_mul_ps(_mm256_load_ps(batch.green), green), angleCos));
+			_mm256_store_ps(batch.blue, _mm256_mul_ps(_mm256_mul_ps(_mm256_load_ps(batch.blue), blue), angleCos));
+		}
+#endif
 	};
 #pragma endregion
 
@@ -63,6 +143,17 @@ namespace dae
 			return BRDF::Lambert(m_DiffuseReflectance,m_DiffuseColor);
 		}
 
+#if defined(__AVX2__)
+		void ShadeBatch(const HitRecord& hitRecord, const Vector3& v, LightBatch& batch) override
+		{
+			__m256 lightX, lightY, lightZ, angleCos;
+			LoadDirections(batch, hitRecord.normal, lightX, lightY, lightZ, angleCos);
+
+			const ColorRGB rho = BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			StoreReflected(batch, angleCos, _mm256_set1_ps(rho.r), _mm256_set1_ps(rho.g), _mm256_set1_ps(rho.b));
+		}
+#endif
+
 	private:
 		ColorRGB m_DiffuseColor{colors::White};
 		float m_DiffuseReflectance{1.f}; //kd
@@ -86,6 +177,19 @@ namespace dae
 			return BRDF::Lambert(m_DiffuseReflectance,m_DiffuseColor) + BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, -v, hitRecord.normal);
 		}
 
+#if defined(__AVX2__)
+		void ShadeBatch(const HitRecord& hitRecord, const Vector3& v, LightBatch& batch) override
+		{
+			__m256 lightX, lightY, lightZ, angleCos;
+			LoadDirections(batch, hitRecord.normal, lightX, lightY, lightZ, angleCos);
+
+			const ColorRGB rho = BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			const __m256 specular = BRDF::Phong(m_SpecularReflectance, m_PhongExponent, lightX, lightY, lightZ, -v, hitRecord.normal);
+			StoreReflected(batch, angleCos, _mm256_add_ps(_mm256_set1_ps(rho.r), specular), _mm256_add_ps(_mm256_set1_ps(rho.g), specular),
+				_mm256_add_ps(_mm256_set1_ps(rho.b), specular));
+		}
+#endif
+
 	private:
 		ColorRGB m_DiffuseColor{colors::White};
 		float m_DiffuseReflectance{0.5f}; //kd
@@ -102,44 +206,243 @@ namespace dae
 		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness):
 			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
 		{
+			//Everything that only depends on the material is computed once here instead of for every light of every hit
+			m_F0 = m_Metalness == 0.f ? ColorRGB(0.04f, 0.04f, 0.04f) : m_Albedo;
+			m_Diffuse = m_Metalness == 0.f ? BRDF::Lambert(ColorRGB(1.f, 1.f, 1.f), m_Albedo) : ColorRGB(0, 0, 0);
+			m_AlphaSqr = Square(Square(m_Roughness));
+			m_KDirect = Square(Square(m_Roughness) + 1.f) / 8.f;
 		}
 
+		//Same result as BRDF::CookTorrance, the NdotV and NdotL of the geometry term cancel against the Cook-Torrance denominator
 		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
 		{
-			// Constants
-			ColorRGB f0 = m_Metalness == 0.f ? ColorRGB(0.04f, 0.04f, 0.04f) : m_Albedo;
-
-			// Calculate half vector between view direction and light direction
-			Vector3 h = (v + l).Normalized();
+			const Vector3 h = (v + l).Normalized();
+			const float NdotV = Vector3::Dot(v, hitRecord.normal);
+			const float NdotL = Vector3::Dot(l, hitRecord.normal);
+			const float NdotH = Vector3::Dot(h, hitRecord.normal);
 
-			// Calculate specular component (Cook-Torrance)
-			ColorRGB F = BRDF::FresnelFunction_Schlick(h, v, f0);
-			float NdotV = Vector3::Dot(v, hitRecord.normal);
-			float NdotL = Vector3::Dot(l, hitRecord.normal);
-			float D = BRDF::NormalDistribution_GGX(hitRecord.normal, h, m_Roughness);
-			float G = BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, m_Roughness);
+			const ColorRGB F = BRDF::FresnelFunction_Schlick(Vector3::Dot(h, v), m_F0);
+#if defined(GGX_LOOKUP_TABLE)
+			const float D = BRDF::NormalDistribution_GGXTable(NdotH, m_Roughness);
+#else
+			const float D = BRDF::NormalDistribution_GGX(NdotH, m_AlphaSqr);
+#endif
+			const float oneMinusK = 1.f - m_KDirect;
+			const float visibility = D / (4.f * (NdotV * oneMinusK + m_KDirect) * (NdotL * oneMinusK + m_KDirect));
 
-			ColorRGB DFG = F * G * D;
+			const ColorRGB kd = ColorRGB(1.f, 1.f, 1.f) - F;
+			return kd * m_Diffuse + F * visibility;
+		}
 
-			float torranceVar = 4.0f * NdotV * NdotL;
+		//The table lookup has no AVX2 version, it keeps the scalar ShadeBatch
+#if defined(__AVX2__) && !defined(GGX_LOOKUP_TABLE)
+		void ShadeBatch(const HitRecord& hitRecord, const Vector3& v, LightBatch& batch) override
+		{
+			__m256 lightX, lightY, lightZ, angleCos;
+			LoadDirections(batch, hitRecord.normal, lightX, lightY, lightZ, angleCos);
 
-			ColorRGB specular = DFG / torranceVar;
+			__m256 red, green, blue;
+			BRDF::CookTorrance(lightX, lightY, lightZ, v, hitRecord.normal, m_F0, m_Diffuse, m_AlphaSqr, m_KDirect, red, green, blue);
+			StoreReflected(batch, angleCos, red, green, blue);
+		}
+#endif
 
-			ColorRGB kd = m_Metalness == 0.f ? (ColorRGB(1.f, 1.f, 1.f) - F) : ColorRGB(0, 0, 0);
+		ColorRGB Sample(const HitRecord& hitRecord, const Vector3& v, float u1, float u2, Vector3& l, float& pdf) override
+		{
+			const Vector3& n = hitRecord.normal;
+			pdf = 0.f;
+			if (Vector3::Dot(n, v) <= 0.f)
+				return {};
 
-			// Calculate diffuse component (Lambert)
-			ColorRGB diffuse = BRDF::Lambert(kd, m_Albedo);
+			//Either lobe can be picked, the density of both together weights the sample (one sample MIS, balance heuristic)
+			const float specularProbability = GetSpecularProbability(hitRecord, v);
+			if (u1 < specularProbability)
+			{
+				const Vector3 h = BRDF::SampleGGXVNDF(n, v, m_Roughness, u1 / specularProbability, u2);
+				l = Vector3::Reflect(-v, h);
+			}
+			else
+			{
+				l = BRDF::SampleCosineHemisphere(n, (u1 - specularProbability) / (1.f - specularProbability), u2);
+			}
 
-			ColorRGB finalColor = diffuse + specular;
+			if (Vector3::Dot(n, l) <= 0.f)
+				return {};
 
-			return finalColor;
+			pdf = specularProbability * BRDF::PdfGGXVNDF(n, v, l, m_Roughness) + (1.f - specularProbability) * BRDF::PdfCosineHemisphere(n, l);
+			return pdf > 0.f ? Shade(hitRecord, l, v) : ColorRGB{};
 		}
 
+		ColorRGB GetReflectance(const HitRecord& hitRecord, const Vector3& v) const override
+		{
+			const float NdotV = Vector3::Dot(v, hitRecord.normal);
+			if (NdotV <= 0.f)
+				return {};
+
+			//Only the mirror direction is traced, so the reflection fades out as the surface gets rougher
+			return BRDF::FresnelFunction_Schlick(NdotV, m_F0) * Square(1.f - m_Roughness);
+		}
 
 	private:
 		ColorRGB m_Albedo{0.955f, 0.637f, 0.538f}; //Copper
+
+		//Share of the samples given to the specular lobe, by the Fresnel weight of both lobes seen from v
+		float GetSpecularProbability(const HitRecord& hitRecord, const Vector3& v) const
+		{
+			if (m_Metalness != 0.f)
+				return 1.f;
+
+			const ColorRGB F = BRDF::FresnelFunction_Schlick(Vector3::Dot(hitRecord.normal, v), m_F0);
+			const float specular = (F.r + F.g + F.b) / 3.f;
+			const ColorRGB diffuse = (ColorRGB(1.f, 1.f, 1.f) - F) * m_Albedo;
+			const float probability = specular / (specular + (diffuse.r + diffuse.g + diffuse.b) / 3.f);
+
+			//Both lobes keep some samples, the density of a lobe that is never picked would be wrong where the other is small
+			return std::clamp(probability, 0.1f, 0.9f);
+		}
 		float m_Metalness{1.0f};
 		float m_Roughness{0.1f}; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
+
+		//Precomputed from the parameters above
+		ColorRGB m_F0{};
+		ColorRGB m_Diffuse{}; //albedo / PI, black for metals
+		float m_AlphaSqr{};
+		float m_KDirect{};
+	};
+#pragma endregion
+
+#pragma region Material TEXTURED COOK TORRENCE
+	//TEXTURED COOK TORRENCE
+	//======================
+	//Cook-Torrance with its parameters read from textures at the texture coordinates of the hit. The albedo map is multiplied by albedo
+	//and the green and blue channel of the roughness/metalness map by roughness and metalness (the glTF layout). Either map can be null
+	class Material_TexturedCookTorrence final : public Material
+	{
+	public:
+		Material_TexturedCookTorrence(const Texture* pAlbedoMap, const Texture* pRoughnessMetalnessMap, const ColorRGB& albedo = { 1.f, 1.f, 1.f },
+			float metalness = 1.f, float roughness = 1.f):
+			m_pAlbedoMap(pAlbedoMap), m_pRoughnessMetalnessMap(pRoughnessMetalnessMap), m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
+		{
+		}
+
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		{
+			return GetMaterial(hitRecord).Shade(hitRecord, l, v);
+		}
+
+		void ShadeBatch(const HitRecord& hitRecord, const Vector3& v, LightBatch& batch) override
+		{
+			GetMaterial(hitRecord).ShadeBatch(hitRecord, v, batch);
+		}
+
+		ColorRGB Sample(const HitRecord& hitRecord, const Vector3& v, float u1, float u2, Vector3& l, float& pdf) override
+		{
+			return GetMaterial(hitRecord).Sample(hitRecord, v, u1, u2, l, pdf);
+		}
+
+		ColorRGB GetReflectance(const HitRecord& hitRecord, const Vector3& v) const override
+		{
+			return GetMaterial(hitRecord).GetReflectance(hitRecord, v);
+		}
+
+	private:
+		const Texture* m_pAlbedoMap{};
+		const Texture* m_pRoughnessMetalnessMap{};
+		ColorRGB m_Albedo{};
+		float m_Metalness{};
+		float m_Roughness{};
+
+		//The Cook-Torrance material of a hit, every light of a hit and its bounce are shaded with the same parameters,
+		//so the textures are only sampled once per hit and the material of the last hit is kept per thread
+		Material_CookTorrence& GetMaterial(const HitRecord& hitRecord) const
+		{
+			struct LastHit
+			{
+				const Material_TexturedCookTorrence* pMaterial{};
+				TexCoord texCoord{};
+				float texFootprint{};
+				std::optional<Material_CookTorrence> material{};
+			};
+			thread_local LastHit lastHit{};
+
+			if (lastHit.pMaterial == this && lastHit.material && lastHit.texCoord.u == hitRecord.texCoord.u &&
+				lastHit.texCoord.v == hitRecord.texCoord.v && lastHit.texFootprint == hitRecord.texFootprint)
+				return *lastHit.material;
+
+			const TexCoord& uv = hitRecord.texCoord;
+			ColorRGB albedo = m_Albedo;
+			if (m_pAlbedoMap)
+				albedo *= m_pAlbedoMap->Sample(uv.u, uv.v, hitRecord.texFootprint);
+
+			ColorRGB roughnessMetalness{ 1.f, 1.f, 1.f };
+			if (m_pRoughnessMetalnessMap)
+				roughnessMetalness = m_pRoughnessMetalnessMap->Sample(uv.u, uv.v, hitRecord.texFootprint);
+
+			//Cook-Torrance only knows metals and dielectrics, a filtered texel is the one it is closest to
+			const float metalness = roughnessMetalness.b * m_Metalness >= 0.5f ? 1.f : 0.f;
+			//A roughness of zero is a perfect mirror whose highlight the lights can never hit
+			const float roughness = std::max(roughnessMetalness.g * m_Roughness, 0.02f);
+
+			lastHit.pMaterial = this;
+			lastHit.texCoord = uv;
+			lastHit.texFootprint = hitRecord.texFootprint;
+			lastHit.material.emplace(albedo, metalness, roughness);
+			return *lastHit.material;
+		}
+	};
+#pragma endregion
+
+#pragma region Material DIELECTRIC
+	//DIELECTRIC
+	//==========
+	//Glass, only a highlight is shaded for the lights, everything else is seen through the reflected and refracted rays
+	class Material_Dielectric final : public Material
+	{
+	public:
+		Material_Dielectric(const ColorRGB& tint, float indexOfRefraction, float ks = 1.f, float phongExponent = 60.f):
+			m_Tint(tint), m_IndexOfRefraction(indexOfRefraction), m_SpecularReflectance(ks), m_PhongExponent(phongExponent)
+		{
+		}
+
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		{
+			return BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, -v, hitRecord.normal);
+		}
+
+#if defined(__AVX2__)
+		void ShadeBatch(const HitRecord& hitRecord, const Vector3& v, LightBatch& batch) override
+		{
+			__m256 lightX, lightY, lightZ, angleCos;
+			LoadDirections(batch, hitRecord.normal, lightX, lightY, lightZ, angleCos);
+
+			const __m256 specular = BRDF::Phong(m_SpecularReflectance, m_PhongExponent, lightX, lightY, lightZ, -v, hitRecord.normal);
+			StoreReflected(batch, angleCos, specular, specular, specular);
+		}
+#endif
+
+		ColorRGB GetReflectance(const HitRecord& hitRecord, const Vector3& v) const override
+		{
+			//Rays leaving the glass see the normal from the inside
+			const Vector3 n = Vector3::Dot(v, hitRecord.normal) < 0.f ? -hitRecord.normal : hitRecord.normal;
+			const float f0 = Square((m_IndexOfRefraction - 1.f) / (m_IndexOfRefraction + 1.f));
+			return BRDF::FresnelFunction_Schlick(Vector3::Dot(n, v), ColorRGB(f0, f0, f0));
+		}
+
+		ColorRGB GetTransmittance(const HitRecord& hitRecord, const Vector3& v) const override
+		{
+			return (ColorRGB(1.f, 1.f, 1.f) - GetReflectance(hitRecord, v)) * m_Tint;
+		}
+
+		float GetIndexOfRefraction() const override
+		{
+			return m_IndexOfRefraction;
+		}
+
+	private:
+		ColorRGB m_Tint{colors::White};
+		float m_IndexOfRefraction{1.5f};
+		float m_SpecularReflectance{1.f}; //ks
+		float m_PhongExponent{60.f}; //Phong Exponent
 	};
 #pragma endregion
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
 #include <float.h>
 
 namespace dae
@@ -28,4 +29,70 @@ namespace dae
 	{
 		return abs(a - b) < epsilon;
 	}
+
+	//Spreads the lower 16 bits of a so there is a zero bit between each of them
+	inline uint32_t Part1By1(uint32_t a)
+	{
+		a &= 0x0000ffff;
+		a = (a | (a << 8)) & 0x00ff00ff;
+		a = (a | (a << 4)) & 0x0f0f0f0f;
+		a = (a | (a << 2)) & 0x33333333;
+		a = (a | (a << 1)) & 0x55555555;
+		return a;
+	}
+
+	//Z-order curve index of a 2D coordinate (x in the even bits, y in the odd bits)
+	inline uint32_t MortonEncode2D(uint32_t x, uint32_t y)
+	{
+		return Part1By1(x) | (Part1By1(y) << 1);
+	}
+
+	//Spreads the lower 10 bits of a so there are two zero bits between each of them
+	inline uint32_t Part1By2(uint32_t a)
+	{
+		a &= 0x000003ff;
+		a = (a | (a << 16)) & 0xff0000ff;
+		a = (a | (a << 8)) & 0x0300f00f;
+		a = (a | (a << 4)) & 0x030c30c3;
+		a = (a | (a << 2)) & 0x09249249;
+		return a;
+	}
+
+	//Spreads the lower 21 bits of a so there are two zero bits between each of them
+	inline uint64_t Part1By2(uint64_t a)
+	{
+		a &= 0x1fffff;
+		a = (a | (a << 32)) & 0x1f00000000ffff;
+		a = (a | (a << 16)) & 0x1f0000ff0000ff;
+		a = (a | (a << 8)) & 0x100f00f00f00f00f;
+		a = (a | (a << 4)) & 0x10c30c30c30c30c3;
+		a = (a | (a << 2)) & 0x1249249249249249;
+		return a;
+	}
+
+	//30 bit Z-order curve index of a 3D coordinate with 10 bits per axis
+	inline uint32_t MortonEncode3D(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return Part1By2(x) | (Part1By2(y) << 1) | (Part1By2(z) << 2);
+	}
+
+	//63 bit Z-order curve index of a 3D coordinate with 21 bits per axis
+	inline uint64_t MortonEncode3D(uint64_t x, uint64_t y, uint64_t z)
+	{
+		return Part1By2(x) | (Part1By2(y) << 1) | (Part1By2(z) << 2);
+	}
+
+	//PCG hash, a stateless random number per input (e.g. per pixel and sample) so no generator state has to be shared between threads
+	inline uint32_t PcgHash(uint32_t a)
+	{
+		const uint32_t state = a * 747796405u + 2891336453u;
+		const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	//Uniform float in [0, 1) from the upper 24 bits of a
+	inline float ToUnitFloat(uint32_t a)
+	{
+		return (a >> 8) * (1.f / 16777216.f);
+	}
 }
\ No newline at end of file
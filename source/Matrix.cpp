@@ -74,6 +74,33 @@ namespace dae {
 		return *this;
 	}
 
+	Matrix Matrix::InverseAffine() const
+	{
+		const Vector3 xAxis = GetAxisX();
+		const Vector3 yAxis = GetAxisY();
+		const Vector3 zAxis = GetAxisZ();
+
+		//Columns of the inverse 3x3 are the cross products of the rows
+		const Vector3 yCrossZ = Vector3::Cross(yAxis, zAxis);
+		const Vector3 zCrossX = Vector3::Cross(zAxis, xAxis);
+		const Vector3 xCrossY = Vector3::Cross(xAxis, yAxis);
+
+		const float determinant = Vector3::Dot(xAxis, yCrossZ);
+		assert(determinant != 0.f);
+		const float invDeterminant = 1.f / determinant;
+
+		Matrix result{
+			Vector3{ yCrossZ.x, zCrossX.x, xCrossY.x } * invDeterminant,
+			Vector3{ yCrossZ.y, zCrossX.y, xCrossY.y } * invDeterminant,
+			Vector3{ yCrossZ.z, zCrossX.z, xCrossY.z } * invDeterminant,
+			Vector3::Zero
+		};
+
+		const Vector3 translation = result.TransformVector(GetTranslation());
+		result[3] = Vector4{ -translation.x, -translation.y, -translation.z, 1.f };
+		return result;
+	}
+
 	Matrix Matrix::Transpose(const Matrix& m)
 	{
 		Matrix out{ m };
@@ -212,5 +239,19 @@ namespace dae {
 
 		return *this;
 	}
+
+	bool Matrix::operator==(const Matrix& m) const
+	{
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			for (int c{ 0 }; c < 4; ++c)
+			{
+				if (data[r][c] != m[r][c])
+					return false;
+			}
+		}
+
+		return true;
+	}
 #pragma endregion
 }
\ No newline at end of file
@@ -25,6 +25,8 @@ namespace dae {
 		Vector3 TransformPoint(const Vector3& p) const;
 		Vector3 TransformPoint(float x, float y, float z) const;
 		const Matrix& Transpose();
+		//Inverse of an affine transform (last column 0,0,0,1)
+		Matrix InverseAffine() const;
 
 		Vector3 GetAxisX() const;
 		Vector3 GetAxisY() const;
@@ -46,6 +48,7 @@ namespace dae {
 		Vector4 operator[](int index) const;
 		Matrix operator*(const Matrix& m) const;
 		const Matrix& operator*=(const Matrix& m);
+		bool operator==(const Matrix& m) const;
 
 	private:
 
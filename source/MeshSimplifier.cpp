@@ -0,0 +1,580 @@
+#include "DataTypes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <queue>
+#include <utility>
+
+namespace dae
+{
+#pragma region Mesh Simplification
+	namespace
+	{
+		//Boundary planes are weighted up so open borders keep their shape while the surface around them is simplified
+		constexpr double borderWeight{ 10.0 };
+
+		//A collapse is rejected when it turns a triangle further than this, as the cosine between its normals before and after
+		constexpr float minNormalCos{ .2f };
+
+		//Sum of the squared distances to a set of planes, weighted by their area: x^T A x for x = (p, 1)
+		//Doubles, the terms of planes far from the origin cancel each other out
+		struct Quadric
+		{
+			double a00{}, a01{}, a02{}, a03{};
+			double a11{}, a12{}, a13{};
+			double a22{}, a23{};
+			double a33{};
+			//Area of the triangles whose planes were added, the boundary planes are not counted
+			double area{};
+
+			static Quadric FromPlane(const Vector3& normal, float distance, double weight)
+			{
+				const double a{ normal.x }, b{ normal.y }, c{ normal.z }, d{ distance };
+
+				Quadric q{};
+				q.a00 = weight * a * a; q.a01 = weight * a * b; q.a02 = weight * a * c; q.a03 = weight * a * d;
+				q.a11 = weight * b * b; q.a12 = weight * b * c; q.a13 = weight * b * d;
+				q.a22 = weight * c * c; q.a23 = weight * c * d;
+				q.a33 = weight * d * d;
+				return q;
+			}
+
+			Quadric& operator+=(const Quadric& q)
+			{
+				a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+				a11 += q.a11; a12 += q.a12; a13 += q.a13;
+				a22 += q.a22; a23 += q.a23;
+				a33 += q.a33;
+				area += q.area;
+				return *this;
+			}
+
+			double Evaluate(const Vector3& p) const
+			{
+				const double x{ p.x }, y{ p.y }, z{ p.z };
+				const double error = a00 * x * x + a11 * y * y + a22 * z * z + a33
+					+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+
+				//Rounding can leave a tiny negative sum
+				return std::max(error, 0.0);
+			}
+		};
+
+		enum class VertexKind : uint8_t
+		{
+			Interior,
+			//On an open edge of the mesh, only collapses along that edge
+			Border,
+			//Shares its position with another vertex (a seam of the normals or texture coordinates) or sits on a non-manifold edge
+			Locked
+		};
+
+		//Half edge collapse that moves from onto to, the versions tell whether to changed since the collapse was queued
+		struct Collapse
+		{
+			float cost{};
+			uint32_t from{};
+			uint32_t to{};
+			uint32_t version{};
+
+			bool operator>(const Collapse& other) const { return cost > other.cost; }
+		};
+
+		class Simplifier final
+		{
+		public:
+			Simplifier(const std::vector<Vector3>& positions, const std::vector<int>& indices) :
+				m_Positions(positions),
+				m_Indices(indices),
+				m_Quadrics(positions.size()),
+				m_Kinds(positions.size(), VertexKind::Interior),
+				m_VertexTriangles(positions.size()),
+				m_Versions(positions.size(), 0),
+				m_IsRemoved(positions.size(), false),
+				m_CollapsedInto(positions.size()),
+				m_IsTriangleRemoved(indices.size() / 3, false),
+				m_TriangleCount(static_cast<uint32_t>(indices.size() / 3))
+			{
+				std::iota(m_CollapsedInto.begin(), m_CollapsedInto.end(), 0);
+				for (uint32_t triangle{ 0 }; triangle < m_TriangleCount; ++triangle)
+				{
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+						m_VertexTriangles[m_Indices[triangle * 3 + corner]].push_back(triangle);
+				}
+
+				ClassifyVertices();
+				AddQuadrics();
+
+				for (uint32_t triangle{ 0 }; triangle < m_TriangleCount; ++triangle)
+				{
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+					{
+						const uint32_t v0 = m_Indices[triangle * 3 + corner];
+						const uint32_t v1 = m_Indices[triangle * 3 + (corner + 1) % 3];
+						QueueCollapse(v0, v1);
+						QueueCollapse(v1, v0);
+					}
+				}
+			}
+
+			//Collapses the cheapest edges until at most targetCount triangles are left, false once nothing can be collapsed anymore
+			bool Simplify(uint32_t targetCount)
+			{
+				while (m_TriangleCount > targetCount)
+				{
+					if (m_Queue.empty())
+						return false;
+
+					const Collapse collapse = m_Queue.top();
+					m_Queue.pop();
+
+					if (m_IsRemoved[collapse.from] || m_IsRemoved[collapse.to] || collapse.version != m_Versions[collapse.from] + m_Versions[collapse.to])
+						continue;
+
+					if (!CanCollapse(collapse.from, collapse.to))
+						continue;
+
+					ApplyCollapse(collapse.from, collapse.to);
+				}
+
+				return true;
+			}
+
+			uint32_t GetTriangleCount() const { return m_TriangleCount; }
+
+			//Largest distance of a vertex of the mesh to the triangles around the vertex it was merged into. A one sided estimate of how
+			//far the simplified surface is from the mesh, cheap enough to measure for every level
+			float GetError()
+			{
+				float maxSqrDistance{ 0.f };
+				for (uint32_t vertex{ 0 }; vertex < m_Positions.size(); ++vertex)
+				{
+					const uint32_t target = FindTarget(vertex);
+					if (target == vertex)
+						continue;
+
+					float minSqrDistance{ FLT_MAX };
+					for (const uint32_t triangle : m_VertexTriangles[target])
+					{
+						if (UsesVertex(triangle, target))
+							minSqrDistance = std::min(minSqrDistance, GetSqrDistanceToTriangle(m_Positions[vertex], triangle));
+					}
+
+					if (minSqrDistance < FLT_MAX)
+						maxSqrDistance = std::max(maxSqrDistance, minSqrDistance);
+				}
+
+				return std::sqrt(maxSqrDistance);
+			}
+
+			//The triangles that are left, indexing into a compacted copy of the vertices that are still used
+			void GetMesh(const TriangleMesh& mesh, TriangleMesh& lod) const
+			{
+				std::vector<int> remap(m_Positions.size(), -1);
+
+				const bool hasTexCoords = mesh.HasTexCoords();
+
+				for (uint32_t triangle{ 0 }; triangle < m_IsTriangleRemoved.size(); ++triangle)
+				{
+					if (m_IsTriangleRemoved[triangle])
+						continue;
+
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+					{
+						const int vertex = m_Indices[triangle * 3 + corner];
+						if (remap[vertex] < 0)
+						{
+							remap[vertex] = static_cast<int>(lod.positions.size());
+							lod.positions.push_back(m_Positions[vertex]);
+
+							if (hasTexCoords)
+								lod.texCoords.push_back(mesh.texCoords[vertex]);
+						}
+
+						lod.indices.push_back(remap[vertex]);
+					}
+				}
+			}
+
+		private:
+			const std::vector<Vector3>& m_Positions;
+			std::vector<int> m_Indices;
+
+			std::vector<Quadric> m_Quadrics;
+			std::vector<VertexKind> m_Kinds;
+			//Triangles around every vertex, can still hold triangles that were removed or no longer use the vertex
+			std::vector<std::vector<uint32_t>> m_VertexTriangles;
+			std::vector<uint32_t> m_Versions;
+			std::vector<bool> m_IsRemoved;
+			//The vertex every removed vertex was moved onto, the vertices that are left point to themselves
+			std::vector<uint32_t> m_CollapsedInto;
+			std::vector<bool> m_IsTriangleRemoved;
+			uint32_t m_TriangleCount;
+
+			std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_Queue{};
+
+			bool UsesVertex(uint32_t triangle, uint32_t vertex) const
+			{
+				return !m_IsTriangleRemoved[triangle] && (m_Indices[triangle * 3] == static_cast<int>(vertex) ||
+					m_Indices[triangle * 3 + 1] == static_cast<int>(vertex) || m_Indices[triangle * 3 + 2] == static_cast<int>(vertex));
+			}
+
+			Vector3 GetTriangleNormal(uint32_t triangle, uint32_t from, const Vector3& position) const
+			{
+				Vector3 p[3];
+				for (uint32_t corner{ 0 }; corner < 3; ++corner)
+				{
+					const uint32_t vertex = m_Indices[triangle * 3 + corner];
+					p[corner] = vertex == from ? position : m_Positions[vertex];
+				}
+
+				return Vector3::Cross(p[1] - p[0], p[2] - p[0]);
+			}
+
+			//The vertex that is left of the vertices vertex was merged into, the chains are shortened on the way
+			uint32_t FindTarget(uint32_t vertex)
+			{
+				uint32_t target{ vertex };
+				while (m_CollapsedInto[target] != target)
+					target = m_CollapsedInto[target];
+
+				while (m_CollapsedInto[vertex] != target)
+					vertex = std::exchange(m_CollapsedInto[vertex], target);
+
+				return target;
+			}
+
+			//Closest point on a triangle (Ericson, Real-Time Collision Detection 5.1.5)
+			float GetSqrDistanceToTriangle(const Vector3& point, uint32_t triangle) const
+			{
+				const Vector3& a = m_Positions[m_Indices[triangle * 3]];
+				const Vector3& b = m_Positions[m_Indices[triangle * 3 + 1]];
+				const Vector3& c = m_Positions[m_Indices[triangle * 3 + 2]];
+
+				const Vector3 ab = b - a, ac = c - a, ap = point - a;
+				const float d1 = Vector3::Dot(ab, ap), d2 = Vector3::Dot(ac, ap);
+				if (d1 <= 0.f && d2 <= 0.f)
+					return ap.SqrMagnitude();
+
+				const Vector3 bp = point - b;
+				const float d3 = Vector3::Dot(ab, bp), d4 = Vector3::Dot(ac, bp);
+				if (d3 >= 0.f && d4 <= d3)
+					return bp.SqrMagnitude();
+
+				const float vc = d1 * d4 - d3 * d2;
+				if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+					return (ap - ab * (d1 / (d1 - d3))).SqrMagnitude();
+
+				const Vector3 cp = point - c;
+				const float d5 = Vector3::Dot(ab, cp), d6 = Vector3::Dot(ac, cp);
+				if (d6 >= 0.f && d5 <= d6)
+					return cp.SqrMagnitude();
+
+				const float vb = d5 * d2 - d1 * d6;
+				if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+					return (ap - ac * (d2 / (d2 - d6))).SqrMagnitude();
+
+				const float va = d3 * d6 - d5 * d4;
+				if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f)
+					return (bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))).SqrMagnitude();
+
+				const float denominator = 1.f / (va + vb + vc);
+				return (ap - ab * (vb * denominator) - ac * (vc * denominator)).SqrMagnitude();
+			}
+
+			void ClassifyVertices()
+			{
+				//Vertices at the same position are found by sorting them
+				std::vector<uint32_t> order(m_Positions.size());
+				std::iota(order.begin(), order.end(), 0);
+				const auto less = [this](uint32_t a, uint32_t b)
+					{
+						const Vector3& pa = m_Positions[a];
+						const Vector3& pb = m_Positions[b];
+						return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+					};
+				std::sort(order.begin(), order.end(), less);
+
+				for (size_t i{ 1 }; i < order.size(); ++i)
+				{
+					if (!less(order[i - 1], order[i]))
+					{
+						m_Kinds[order[i - 1]] = VertexKind::Locked;
+						m_Kinds[order[i]] = VertexKind::Locked;
+					}
+				}
+
+				//Edges used by one triangle are open borders, edges used by more than two are not manifold
+				ForEachEdge([this](uint32_t v0, uint32_t v1, uint32_t useCount, uint32_t)
+					{
+						if (useCount == 2)
+							return;
+
+						for (const uint32_t vertex : { v0, v1 })
+						{
+							if (useCount > 2)
+								m_Kinds[vertex] = VertexKind::Locked;
+							else if (m_Kinds[vertex] == VertexKind::Interior)
+								m_Kinds[vertex] = VertexKind::Border;
+						}
+					});
+			}
+
+			//Calls edgeFunction(v0, v1, useCount, triangle) once for every undirected edge, with one of the triangles using it
+			template<typename EdgeFunction>
+			void ForEachEdge(const EdgeFunction& edgeFunction) const
+			{
+				struct Edge
+				{
+					uint32_t v0;
+					uint32_t v1;
+					uint32_t triangle;
+				};
+
+				std::vector<Edge> edges{};
+				edges.reserve(m_Indices.size());
+				for (uint32_t triangle{ 0 }; triangle < m_TriangleCount; ++triangle)
+				{
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+					{
+						const uint32_t v0 = m_Indices[triangle * 3 + corner];
+						const uint32_t v1 = m_Indices[triangle * 3 + (corner + 1) % 3];
+						edges.push_back({ std::min(v0, v1), std::max(v0, v1), triangle });
+					}
+				}
+
+				std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) { return a.v0 != b.v0 ? a.v0 < b.v0 : a.v1 < b.v1; });
+
+				for (size_t first{ 0 }; first < edges.size();)
+				{
+					size_t last{ first + 1 };
+					while (last < edges.size() && edges[last].v0 == edges[first].v0 && edges[last].v1 == edges[first].v1)
+						++last;
+
+					edgeFunction(edges[first].v0, edges[first].v1, static_cast<uint32_t>(last - first), edges[first].triangle);
+					first = last;
+				}
+			}
+
+			void AddQuadrics()
+			{
+				for (uint32_t triangle{ 0 }; triangle < m_TriangleCount; ++triangle)
+				{
+					const Vector3 normal = GetTriangleNormal(triangle, UINT32_MAX, {});
+					const float doubleArea = normal.Magnitude();
+					if (doubleArea <= 0.f)
+						continue;
+
+					const Vector3 unitNormal = normal / doubleArea;
+					Quadric q = Quadric::FromPlane(unitNormal, -Vector3::Dot(unitNormal, m_Positions[m_Indices[triangle * 3]]), .5 * doubleArea);
+					q.area = .5 * doubleArea;
+
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+						m_Quadrics[m_Indices[triangle * 3 + corner]] += q;
+				}
+
+				//A plane through every open edge, perpendicular to its triangle, holds the border in place
+				ForEachEdge([this](uint32_t v0, uint32_t v1, uint32_t useCount, uint32_t triangle)
+					{
+						if (useCount != 1)
+							return;
+
+						const Vector3 edge = m_Positions[v1] - m_Positions[v0];
+						const Vector3 borderNormal = Vector3::Cross(edge, GetTriangleNormal(triangle, UINT32_MAX, {}));
+						if (borderNormal.SqrMagnitude() <= 0.f)
+							return;
+
+						const Vector3 unitNormal = borderNormal.Normalized();
+						const Quadric q = Quadric::FromPlane(unitNormal, -Vector3::Dot(unitNormal, m_Positions[v0]), borderWeight * edge.SqrMagnitude());
+						m_Quadrics[v0] += q;
+						m_Quadrics[v1] += q;
+					});
+			}
+
+			void QueueCollapse(uint32_t from, uint32_t to)
+			{
+				if (m_Kinds[from] == VertexKind::Locked)
+					return;
+
+				Quadric q = m_Quadrics[from];
+				q += m_Quadrics[to];
+
+				const float error = static_cast<float>(std::sqrt(q.Evaluate(m_Positions[to]) / std::max(q.area, 1e-20)));
+				m_Queue.push({ error, from, to, m_Versions[from] + m_Versions[to] });
+			}
+
+			bool CanCollapse(uint32_t from, uint32_t to) const
+			{
+				//The edge still exists, and the vertices it connects to both ends are exactly those of the triangles on it (the link
+				//condition), otherwise the collapse would fold the surface onto itself
+				thread_local std::vector<uint32_t> fromNeighbours{};
+				thread_local std::vector<uint32_t> toNeighbours{};
+				fromNeighbours.clear();
+				toNeighbours.clear();
+
+				uint32_t sharedCount{ 0 };
+				for (const uint32_t triangle : m_VertexTriangles[from])
+				{
+					if (!UsesVertex(triangle, from))
+						continue;
+
+					sharedCount += UsesVertex(triangle, to);
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+						fromNeighbours.push_back(m_Indices[triangle * 3 + corner]);
+				}
+				if (sharedCount == 0)
+					return false;
+
+				//A border vertex may only slide along its border
+				if (m_Kinds[from] == VertexKind::Border && sharedCount != 1)
+					return false;
+
+				for (const uint32_t triangle : m_VertexTriangles[to])
+				{
+					if (!UsesVertex(triangle, to))
+						continue;
+
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+						toNeighbours.push_back(m_Indices[triangle * 3 + corner]);
+				}
+
+				for (auto* pNeighbours : { &fromNeighbours, &toNeighbours })
+				{
+					std::sort(pNeighbours->begin(), pNeighbours->end());
+					pNeighbours->erase(std::unique(pNeighbours->begin(), pNeighbours->end()), pNeighbours->end());
+				}
+
+				uint32_t commonCount{ 0 };
+				for (size_t i{ 0 }, j{ 0 }; i < fromNeighbours.size() && j < toNeighbours.size();)
+				{
+					if (fromNeighbours[i] < toNeighbours[j])
+						++i;
+					else if (toNeighbours[j] < fromNeighbours[i])
+						++j;
+					else
+					{
+						commonCount += fromNeighbours[i] != from && fromNeighbours[i] != to;
+						++i;
+						++j;
+					}
+				}
+				if (commonCount != sharedCount)
+					return false;
+
+				//None of the triangles that stay may flip or turn too far
+				for (const uint32_t triangle : m_VertexTriangles[from])
+				{
+					if (!UsesVertex(triangle, from) || UsesVertex(triangle, to))
+						continue;
+
+					const Vector3 before = GetTriangleNormal(triangle, UINT32_MAX, {});
+					const Vector3 after = GetTriangleNormal(triangle, from, m_Positions[to]);
+					const float lengths = before.Magnitude() * after.Magnitude();
+					if (lengths <= 0.f || Vector3::Dot(before, after) < minNormalCos * lengths)
+						return false;
+				}
+
+				return true;
+			}
+
+			void ApplyCollapse(uint32_t from, uint32_t to)
+			{
+				for (const uint32_t triangle : m_VertexTriangles[from])
+				{
+					if (!UsesVertex(triangle, from))
+						continue;
+
+					if (UsesVertex(triangle, to))
+					{
+						m_IsTriangleRemoved[triangle] = true;
+						--m_TriangleCount;
+						continue;
+					}
+
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+					{
+						if (m_Indices[triangle * 3 + corner] == static_cast<int>(from))
+							m_Indices[triangle * 3 + corner] = static_cast<int>(to);
+					}
+					m_VertexTriangles[to].push_back(triangle);
+				}
+
+				m_IsRemoved[from] = true;
+				m_CollapsedInto[from] = to;
+				m_VertexTriangles[from].clear();
+				m_Quadrics[to] += m_Quadrics[from];
+				++m_Versions[to];
+
+				//Only the live triangles of to are kept, then every edge of to is queued again with its new quadric
+				std::vector<uint32_t>& triangles = m_VertexTriangles[to];
+				triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [&](uint32_t triangle) { return !UsesVertex(triangle, to); }), triangles.end());
+				std::sort(triangles.begin(), triangles.end());
+				triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+				thread_local std::vector<uint32_t> neighbours{};
+				neighbours.clear();
+				for (const uint32_t triangle : triangles)
+				{
+					for (uint32_t corner{ 0 }; corner < 3; ++corner)
+					{
+						if (m_Indices[triangle * 3 + corner] != static_cast<int>(to))
+							neighbours.push_back(m_Indices[triangle * 3 + corner]);
+					}
+				}
+				std::sort(neighbours.begin(), neighbours.end());
+				neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+				for (const uint32_t neighbour : neighbours)
+				{
+					QueueCollapse(neighbour, to);
+					QueueCollapse(to, neighbour);
+				}
+			}
+		};
+	}
+
+	void TriangleMesh::GenerateLODs(uint32_t maxLevelCount, uint32_t minTriangleCount)
+	{
+		lods.clear();
+		lodErrors.clear();
+		lodLevel = 0;
+		lodBlend = 0.f;
+
+		//One simplification of the whole mesh, every level is a snapshot of it, so the errors of the levels only grow
+		Simplifier simplifier{ positions, indices };
+
+		uint32_t previousCount = static_cast<uint32_t>(indices.size() / 3);
+		while (lods.size() < maxLevelCount)
+		{
+			const uint32_t targetCount = previousCount / 4;
+			if (targetCount < minTriangleCount)
+				break;
+
+			const bool reachedTarget = simplifier.Simplify(targetCount);
+
+			//Stuck on locked vertices, a level that is hardly smaller is not worth tracing
+			if (!reachedTarget && simplifier.GetTriangleCount() * 4 > previousCount * 3)
+				break;
+
+			TriangleMesh lod{};
+			simplifier.GetMesh(*this, lod);
+			lod.CalculateNormals();
+			if (HasVertexNormals())
+				lod.CalculateVertexNormals();
+			lod.UpdateAABB();
+			lod.cullMode = cullMode;
+			lod.materialIndex = materialIndex;
+			lod.bvhSettings = bvhSettings;
+
+			lods.push_back(std::move(lod));
+			lodErrors.push_back(simplifier.GetError());
+
+			previousCount = simplifier.GetTriangleCount();
+			if (!reachedTarget)
+				break;
+		}
+	}
+#pragma endregion
+}
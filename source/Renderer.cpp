@@ -8,10 +8,14 @@
 #include "Matrix.h"
 #include "Material.h"
 #include "Scene.h"
+#include "Sampler.h"
 #include "Utils.h"
 #include <algorithm>
 
+#include <chrono>
 #include <execution>
+#include <numeric>
+#include <immintrin.h>
 
 #define PARALLEL_EXECUTION
 using namespace dae;
@@ -23,166 +27,1258 @@ Renderer::Renderer(SDL_Window* pWindow) :
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	m_pColorBuffer = std::make_unique<float[]>(3 * m_Width * m_Height);
+	m_pAccumulationBuffer = std::make_unique<float[]>(3 * m_Width * m_Height);
+
+	//The pack pass writes whole 32 bit pixels in the surface's own channel layout
+	assert(m_pBuffer->format->BytesPerPixel == 4 && m_pBuffer->pitch == m_Width * 4);
+
+	InitializeTiles();
+}
+
+Renderer::~Renderer()
+{
+	WaitForScreenshot();
+}
+
+//Distance of the image plane used when generating camera rays (and when projecting back onto the screen)
+constexpr float imagePlaneDistance{ 0.7f };
+
+//Random numbers of a sample, every depth of a path uses its own dimensions for the light samples, the area light samples,
+//the roulette of its rays and the ray budget
+constexpr uint32_t dimensionsPerDepth{ 16 };
+constexpr uint32_t areaLightDimension{ dimensionsPerDepth - 7 };
+constexpr uint32_t bounceDimension{ dimensionsPerDepth - 5 };
+constexpr uint32_t budgetDimension{ dimensionsPerDepth - 3 };
+constexpr uint32_t reflectionDimension{ dimensionsPerDepth - 2 };
+constexpr uint32_t refractionDimension{ dimensionsPerDepth - 1 };
+
+inline float GetRandom(uint32_t pixelIndex, uint32_t width, uint32_t sampleIndex, uint32_t dimension)
+{
+	return Sampler::Get1D(pixelIndex % width, pixelIndex / width, sampleIndex, dimension);
+}
+
+#pragma region Ray Differentials
+//Ray differentials (Igehy 1999): the offsets of a ray to the rays through the neighbouring pixels, followed through every
+//mirror reflection and refraction of its path
+
+//Moves the differentials of a ray along it to the plane of its hit, the offsets of the hit towards the neighbouring pixels
+inline bool TransferDifferential(const Vector3& direction, const RayDifferential& differential, const HitRecord& hit, Vector3& hitOffsetX, Vector3& hitOffsetY)
+{
+	if (!differential.isValid)
+		return false;
+
+	const float cosHit = Vector3::Dot(direction, hit.normal);
+	if (cosHit == 0.f)
+		return false;
+
+	const Vector3 offsetX = differential.originX + differential.directionX * hit.t;
+	const Vector3 offsetY = differential.originY + differential.directionY * hit.t;
+	hitOffsetX = offsetX - direction * (Vector3::Dot(offsetX, hit.normal) / cosHit);
+	hitOffsetY = offsetY - direction * (Vector3::Dot(offsetY, hit.normal) / cosHit);
+	return true;
+}
+
+//Size of the pixel footprint of a ray at its hit in texture coordinates, the larger of the texture coordinate offsets towards the
+//neighbouring pixels
+inline float GetTexFootprint(const Ray& ray, const RayDifferential& differential, const HitRecord& hit)
+{
+	Vector3 hitOffsetX{}, hitOffsetY{};
+	if (!TransferDifferential(ray.direction, differential, hit, hitOffsetX, hitOffsetY))
+		return 0.f;
+
+	const float footprintX = Square(Vector3::Dot(hit.dUdP, hitOffsetX)) + Square(Vector3::Dot(hit.dVdP, hitOffsetX));
+	const float footprintY = Square(Vector3::Dot(hit.dUdP, hitOffsetY)) + Square(Vector3::Dot(hit.dVdP, hitOffsetY));
+	return sqrtf(std::max(footprintX, footprintY));
+}
+
+//Differential of the ray reflected about normal at the hit of a ray with direction. normal faces the side the ray arrives from,
+//it is either the normal of the hit or the normal of a microfacet. The normal turns by the curvature of the surface times the offset
+inline RayDifferential ReflectDifferential(const Vector3& direction, const RayDifferential& differential, const HitRecord& hit, const Vector3& normal)
+{
+	RayDifferential reflected{};
+	if (!TransferDifferential(direction, differential, hit, reflected.originX, reflected.originY))
+		return {};
+
+	const float curvature = Vector3::Dot(normal, hit.normal) < 0.f ? -hit.curvature : hit.curvature;
+	const float cosIncident = -Vector3::Dot(direction, normal);
+	const auto reflect = [&](const Vector3& directionOffset, const Vector3& hitOffset)
+		{
+			const Vector3 normalOffset = hitOffset * curvature;
+			const float cosOffset = -(Vector3::Dot(directionOffset, normal) + Vector3::Dot(direction, normalOffset));
+			return directionOffset + (normal * cosOffset + normalOffset * cosIncident) * 2.f;
+		};
+
+	reflected.directionX = reflect(differential.directionX, reflected.originX);
+	reflected.directionY = reflect(differential.directionY, reflected.originY);
+	reflected.isValid = true;
+	return reflected;
+}
+
+//Differential of the ray refracted through normal with the ratio of indices of refraction eta, like ReflectDifferential
+inline RayDifferential RefractDifferential(const Vector3& direction, const RayDifferential& differential, const HitRecord& hit, const Vector3& normal, float eta)
+{
+	RayDifferential refracted{};
+	if (!TransferDifferential(direction, differential, hit, refracted.originX, refracted.originY))
+		return {};
+
+	const float curvature = Vector3::Dot(normal, hit.normal) < 0.f ? -hit.curvature : hit.curvature;
+	const float cosIncident = -Vector3::Dot(direction, normal);
+	const float cosTransmitted = sqrtf(std::max(1.f - Square(eta) * (1.f - Square(cosIncident)), 0.f));
+	if (cosTransmitted <= 0.f)
+		return {};
+
+	//The refracted direction is direction * eta + normal * (eta * cosIncident - cosTransmitted)
+	const auto refract = [&](const Vector3& directionOffset, const Vector3& hitOffset)
+		{
+			const Vector3 normalOffset = hitOffset * curvature;
+			const float cosOffset = -(Vector3::Dot(directionOffset, normal) + Vector3::Dot(direction, normalOffset));
+			const float cosTransmittedOffset = Square(eta) * cosIncident * cosOffset / cosTransmitted;
+			return directionOffset * eta + normal * (eta * cosOffset - cosTransmittedOffset) + normalOffset * (eta * cosIncident - cosTransmitted);
+		};
+
+	refracted.directionX = refract(differential.directionX, refracted.originX);
+	refracted.directionY = refract(differential.directionY, refracted.originY);
+	refracted.isValid = true;
+	return refracted;
+}
+#pragma endregion
+
+inline void GetRandom2D(uint32_t pixelIndex, uint32_t width, uint32_t sampleIndex, uint32_t dimension, float& u1, float& u2)
+{
+	Sampler::Get2D(pixelIndex % width, pixelIndex / width, sampleIndex, dimension, u1, u2);
 }
 
-void Renderer::Render(Scene* pScene) const
+//Dithers the meshes that are between two levels of detail, the R2 sequence over the pixels (Roberts 2018) moved on by the golden
+//ratio every sample. Much cheaper than a dimension of the sampler and as even, every ray of a sample gets the same value
+inline float GetLODSelector(uint32_t pixelIndex, uint32_t width, uint32_t sampleIndex)
 {
-	Camera& camera = pScene->GetCamera();
+	const float value = (pixelIndex % width) * .7548777f + (pixelIndex / width) * .5698403f + sampleIndex * .618034f;
+	return value - floorf(value);
+}
+
+void Renderer::Render(Scene* pScene)
+{
+	Camera& camera = pScene->GetFrameCamera();
 	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
 	const float aspect = static_cast<float>(m_Width) / static_cast<float>(m_Height);
 	const float fovAngle = TO_RADIANS * camera.fovAngle;
 	const float fov = tanf(fovAngle / 2);
 
-#if defined(PARALLEL_EXECUTION)
-	uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
-	std::vector<uint32_t> pixelIndices{};
+	const auto& lights = pScene->GetLights();
+	m_HasAreaLights = std::any_of(lights.begin(), lights.end(), [](const Light& l) { return LightUtils::IsAreaLight(l); });
 
-	pixelIndices.reserve(amountOfPixels);
+	MarkDirtyTiles(pScene, cameraToWorld, fov, aspect);
 
-	for (uint32_t index{}; index < amountOfPixels; ++index) pixelIndices.emplace_back(index);
+	m_SampleCount = 0;
+	m_BusyNanoseconds = 0;
+	const auto startTime = std::chrono::steady_clock::now();
 
-	std::for_each(std::execution::par, pixelIndices.begin(), pixelIndices.end(), [&](int i) {
-			RenderPixel(pScene, i, fov, aspect, cameraToWorld, camera.origin);
+	//The secondary rays of a frame are shared evenly by the traced tiles, a partial redraw can afford deeper paths
+	m_TileRayBudget = static_cast<uint32_t>(m_SecondaryRaysPerPixel * m_Width * m_Height / std::max(m_DirtyTileIndices.size(), size_t(1)));
+
+#if defined(PARALLEL_EXECUTION)
+	std::for_each(std::execution::par, m_DirtyTileIndices.begin(), m_DirtyTileIndices.end(), [&](uint32_t i) {
+			RenderTile(pScene, i, fov, aspect, cameraToWorld, camera.origin);
 			});
 	
 #else
-	for (uint32_t i{}; i < m_Width * m_Height; ++i) {
-		RenderPixel(pScene, i, fov, aspect, cameraToWorld, camera.origin);
+	for (uint32_t i : m_DirtyTileIndices) {
+		RenderTile(pScene, i, fov, aspect, cameraToWorld, camera.origin);
 	}
 
 #endif
 
+	m_FrameStats.sampleCount = m_SampleCount;
+	m_FrameStats.traceSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+	m_FrameStats.busySeconds = m_BusyNanoseconds * 1e-9f;
+
+	//The surface can only be overwritten once the previous frame has been shown and its screenshot has been saved
+	m_IsPresentPending.wait(true);
+	WaitForScreenshot();
+	PackColorBuffer();
+}
+
+std::future<void> Renderer::RenderAsync(Scene* pScene)
+{
+	m_IsPresentPending = true;
+	return std::async(std::launch::async, [this, pScene]() { Render(pScene); });
+}
+
+void Renderer::Present()
+{
+	//SDL only allows the window surface to be updated from the main thread, the pack pass already ran in Render
 	SDL_UpdateWindowSurface(m_pWindow);
+
+	//Saving overlaps with tracing the next frame, the job is started before that frame can wait for it
+	if (m_ScreenshotRequested)
+	{
+		m_ScreenshotRequested = false;
+		m_ScreenshotJob = std::async(std::launch::async, [this]() {
+			if (!SaveBufferToImage())
+				std::cout << "Screenshot saved!" << std::endl;
+			else
+				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
+			});
+	}
+
+	m_IsPresentPending = false;
+	m_IsPresentPending.notify_all();
 }
 
-void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRation, const  Matrix cameraToWorld, const Vector3 cameraOrigin) const
+void Renderer::WaitForScreenshot()
 {
-	auto materials{ pScene->GetMaterials() };
-	auto& lights = pScene->GetLights();
+	if (m_ScreenshotJob.valid())
+		m_ScreenshotJob.wait();
+}
+
+void Renderer::PackColorBuffer() const
+{
+	const uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
+
+#if defined(PARALLEL_EXECUTION)
+	//The pass is bound by memory bandwidth, so it is split in blocks of rows to use every core's share of it
+	const uint32_t pixelsPerBlock{ m_TileSize * m_Width };
+	std::vector<uint32_t> blockStarts{};
+	for (uint32_t start{}; start < amountOfPixels; start += pixelsPerBlock) blockStarts.push_back(start);
 
+	std::for_each(std::execution::par, blockStarts.begin(), blockStarts.end(), [&](uint32_t start) {
+			PackColorRange(start, std::min(start + pixelsPerBlock, amountOfPixels));
+			});
+#else
+	PackColorRange(0, amountOfPixels);
+#endif
+}
+
+void Renderer::PackColorRange(uint32_t first, uint32_t last) const
+{
+	const uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
+	const float* pRed = m_pColorBuffer.get();
+	const float* pGreen = pRed + amountOfPixels;
+	const float* pBlue = pGreen + amountOfPixels;
+
+	const SDL_PixelFormat* pFormat = m_pBuffer->format;
+
+	//Same result as MaxToOne, clamping and SDL_MapRGB per pixel
+	const auto packScalar = [&](uint32_t i)
+		{
+			ColorRGB color{ pRed[i], pGreen[i], pBlue[i] };
+			color.MaxToOne();
+
+			color.r = std::clamp(color.r, 0.f, 1.f);
+			color.g = std::clamp(color.g, 0.f, 1.f);
+			color.b = std::clamp(color.b, 0.f, 1.f);
+
+			if (m_GammaCorrectionEnabled)
+			{
+				//sRGB curve approximation by Ian Taylor, only needs square roots
+				const auto toSRGB = [](float c)
+					{
+						const float s1 = sqrtf(c), s2 = sqrtf(s1), s3 = sqrtf(s2);
+						return std::min(0.585122381f * s1 + 0.783140355f * s2 - 0.368262736f * s3, 1.f);
+					};
+				color = { toSRGB(color.r), toSRGB(color.g), toSRGB(color.b) };
+			}
+
+			m_pBufferPixels[i] = (static_cast<uint32_t>(color.r * 255) << pFormat->Rshift) |
+				(static_cast<uint32_t>(color.g * 255) << pFormat->Gshift) |
+				(static_cast<uint32_t>(color.b * 255) << pFormat->Bshift) |
+				pFormat->Amask;
+		};
+
+	uint32_t i{ first };
+
+#if defined(__AVX2__)
+	//Scalar until the destination is aligned for streaming stores
+	while (i < last && reinterpret_cast<uintptr_t>(m_pBufferPixels + i) % 32 != 0)
+		packScalar(i++);
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 scale = _mm256_set1_ps(255.f);
+	const __m128i shiftR = _mm_cvtsi32_si128(pFormat->Rshift);
+	const __m128i shiftG = _mm_cvtsi32_si128(pFormat->Gshift);
+	const __m128i shiftB = _mm_cvtsi32_si128(pFormat->Bshift);
+	const __m256i alpha = _mm256_set1_epi32(static_cast<int>(pFormat->Amask));
+
+	const __m256 c1 = _mm256_set1_ps(0.585122381f);
+	const __m256 c2 = _mm256_set1_ps(0.783140355f);
+	const __m256 c3 = _mm256_set1_ps(-0.368262736f);
+	const auto toSRGB = [&](__m256 c)
+		{
+			const __m256 s1 = _mm256_sqrt_ps(c);
+			const __m256 s2 = _mm256_sqrt_ps(s1);
+			const __m256 s3 = _mm256_sqrt_ps(s2);
+			return _mm256_min_ps(_mm256_fmadd_ps(c3, s3, _mm256_fmadd_ps(c2, s2, _mm256_mul_ps(c1, s1))), one);
+		};
+
+	for (; i + 8 <= last; i += 8)
+	{
+		__m256 r = _mm256_loadu_ps(pRed + i);
+		__m256 g = _mm256_loadu_ps(pGreen + i);
+		__m256 b = _mm256_loadu_ps(pBlue + i);
+
+		//Tone map: scale the color down by its largest channel when that one is above one
+		const __m256 maxValue = _mm256_max_ps(r, _mm256_max_ps(g, b));
+		const __m256 divisor = _mm256_blendv_ps(one, maxValue, _mm256_cmp_ps(maxValue, one, _CMP_GT_OQ));
+		r = _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(r, divisor), zero), one);
+		g = _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(g, divisor), zero), one);
+		b = _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(b, divisor), zero), one);
+
+		if (m_GammaCorrectionEnabled)
+		{
+			r = toSRGB(r);
+			g = toSRGB(g);
+			b = toSRGB(b);
+		}
+
+		const __m256i packed = _mm256_or_si256(
+			_mm256_or_si256(_mm256_sll_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(r, scale)), shiftR),
+				_mm256_sll_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(g, scale)), shiftG)),
+			_mm256_or_si256(_mm256_sll_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(b, scale)), shiftB), alpha));
+
+		//The surface is only read back by SDL, keep it out of the caches
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(m_pBufferPixels + i), packed);
+	}
+
+	_mm_sfence();
+#endif
+
+	for (; i < last; ++i)
+		packScalar(i);
+}
+
+bool Renderer::FollowsRayDifferentials(const Scene* pScene) const
+{
+	return pScene->UsesRayFootprints() || (pScene->UsesLODFootprints() && (m_MaxDepth > 0 || IsPathTracing()));
+}
+
+void Renderer::RenderTile(Scene* pScene, uint32_t tileIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	Tile& tile = m_Tiles[tileIndex];
+	tile.hasHit = false;
+
+	//The camera rays of the whole tile are traced together, followed by the secondary rays and shadow rays they need
+	thread_local std::vector<PixelState> pixels{};
+	thread_local PathQueue rays{};
+	pixels.clear();
+	rays.Resize(0);
+
+	for (uint32_t localIndex : m_TilePixelOrder)
+	{
+		const uint32_t localX{ localIndex % m_TileSize }, localY{ localIndex / m_TileSize };
+
+		//Tiles on the right and bottom edge of the screen can be partial
+		if (localX >= tile.width || localY >= tile.height)
+			continue;
+
+		const uint32_t px{ tile.x + localX }, py{ tile.y + localY };
+		const uint32_t pixelIndex{ px + py * m_Width };
+
+		RayDifferential differential{};
+		const Ray cameraRay = GetCameraRay(pixelIndex, fov, aspectRatio, cameraToWorld, cameraOrigin, differential);
+		rays.Push(cameraRay, { 1.f, 1.f, 1.f }, static_cast<uint32_t>(pixels.size()), FollowsRayDifferentials(pScene) ? differential : RayDifferential{});
+		pixels.push_back({ pixelIndex });
+	}
+
+	TracePaths(pScene, pixels, rays, tile.sampleCount, m_TileRayBudget);
+
+	for (const PixelState& pixel : pixels)
+	{
+		WritePixel(pixel.pixelIndex, tile.sampleCount, pixel.color);
+
+		if (!pixel.didHit)
+			continue;
+
+		tile.hitMin = tile.hasHit ? Vector3::Min(tile.hitMin, pixel.hitOrigin) : pixel.hitOrigin;
+		tile.hitMax = tile.hasHit ? Vector3::Max(tile.hitMax, pixel.hitOrigin) : pixel.hitOrigin;
+		tile.hasHit = true;
+	}
+
+	++tile.sampleCount;
+
+	m_SampleCount += static_cast<uint32_t>(pixels.size());
+	m_BusyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void Renderer::InitializeTiles()
+{
+	m_TilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	m_TilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+
+	m_Tiles.clear();
+	m_Tiles.reserve(m_TilesX * m_TilesY);
+
+	for (uint32_t ty{}; ty < m_TilesY; ++ty)
+	{
+		for (uint32_t tx{}; tx < m_TilesX; ++tx)
+		{
+			Tile tile{};
+			tile.x = tx * m_TileSize;
+			tile.y = ty * m_TileSize;
+			tile.width = std::min(m_TileSize, m_Width - tile.x);
+			tile.height = std::min(m_TileSize, m_Height - tile.y);
+			m_Tiles.push_back(tile);
+		}
+	}
+
+	m_IsTileDirty.assign(m_Tiles.size(), true);
+	m_DirtyTileIndices.reserve(m_Tiles.size());
+
+	UpdatePixelOrder();
+}
+
+void Renderer::UpdatePixelOrder()
+{
+	//Morton order needs square power of two tiles
+	assert((m_TileSize & (m_TileSize - 1)) == 0);
+
+	const auto sortByCurve = [this](std::vector<uint32_t>& indices, uint32_t rowLength)
+		{
+			if (m_CurrentPixelOrder == PixelOrder::Scanline)
+				return;
+
+			std::sort(indices.begin(), indices.end(), [rowLength](uint32_t a, uint32_t b) {
+				return MortonEncode2D(a % rowLength, a / rowLength) < MortonEncode2D(b % rowLength, b / rowLength);
+				});
+		};
+
+	m_TilePixelOrder.resize(m_TileSize * m_TileSize);
+	for (uint32_t i{}; i < m_TilePixelOrder.size(); ++i) m_TilePixelOrder[i] = i;
+	sortByCurve(m_TilePixelOrder, m_TileSize);
+
+	//Tiles are handed to the workers in the same order, so each worker gets a compact block of the screen
+	m_TileOrder.resize(m_Tiles.size());
+	for (uint32_t i{}; i < m_TileOrder.size(); ++i) m_TileOrder[i] = i;
+	sortByCurve(m_TileOrder, m_TilesX);
+}
+
+void Renderer::MarkDirtyTiles(Scene* pScene, const Matrix& cameraToWorld, float fov, float aspectRatio)
+{
+	const Camera& camera = pScene->GetFrameCamera();
+
+	//Anything that changes the view or the shading invalidates the whole frame
+	bool fullRedraw = pScene->IsFullRedraw() || m_FullRedraw;
+	fullRedraw |= camera.origin != m_PreviousCameraOrigin || camera.forward != m_PreviousCameraForward || camera.fovAngle != m_PreviousFovAngle;
+
+	//A changed object can show up in the reflections, refractions and indirect light of any tile
+	fullRedraw |= (m_MaxDepth > 0 || IsPathTracing()) && !pScene->GetDirtyBounds().empty();
+
+	m_PreviousCameraOrigin = camera.origin;
+	m_PreviousCameraForward = camera.forward;
+	m_PreviousFovAngle = camera.fovAngle;
+	m_FullRedraw = false;
+
+	m_IsTileDirty.assign(m_Tiles.size(), fullRedraw);
+
+	if (!fullRedraw)
+	{
+		for (const AABB& bounds : pScene->GetDirtyBounds())
+		{
+			MarkProjectedBounds(bounds, cameraToWorld, fov, aspectRatio);
+
+			if (m_ShadowsEnabled)
+				MarkShadowedBounds(pScene, bounds);
+		}
+	}
+
+	m_DirtyTileIndices.clear();
+	for (uint32_t i : m_TileOrder)
+	{
+		if (m_IsTileDirty[i])
+			m_Tiles[i].sampleCount = 0;
+
+		//While rendering progressively, clean tiles keep being traced to refine their estimate until they have enough samples
+		if (m_IsTileDirty[i] || (IsProgressive() && m_Tiles[i].sampleCount < m_MaxSampleCount))
+			m_DirtyTileIndices.push_back(i);
+	}
+}
+
+void Renderer::MarkProjectedBounds(const AABB& bounds, const Matrix& cameraToWorld, float fov, float aspectRatio)
+{
+	const Vector3 right = cameraToWorld.GetAxisX();
+	const Vector3 up = cameraToWorld.GetAxisY();
+	const Vector3 forward = cameraToWorld.GetAxisZ();
+	const Vector3 origin = cameraToWorld.GetTranslation();
+
+	//Camera axes are not guaranteed to be orthonormal (no roll is forced), so invert the basis with Cramer's rule
+	const Vector3 upCrossForward = Vector3::Cross(up, forward);
+	const Vector3 forwardCrossRight = Vector3::Cross(forward, right);
+	const Vector3 rightCrossUp = Vector3::Cross(right, up);
+	const float invDeterminant = 1.f / Vector3::Dot(right, upCrossForward);
+
+	float minX{ FLT_MAX }, minY{ FLT_MAX };
+	float maxX{ -FLT_MAX }, maxY{ -FLT_MAX };
+
+	for (int corner{}; corner < 8; ++corner)
+	{
+		const Vector3 point{
+			corner & 1 ? bounds.max.x : bounds.min.x,
+			corner & 2 ? bounds.max.y : bounds.min.y,
+			corner & 4 ? bounds.max.z : bounds.min.z };
+
+		const Vector3 toPoint = point - origin;
+		const float cameraX = Vector3::Dot(toPoint, upCrossForward) * invDeterminant;
+		const float cameraY = Vector3::Dot(toPoint, forwardCrossRight) * invDeterminant;
+		const float cameraZ = Vector3::Dot(toPoint, rightCrossUp) * invDeterminant;
+
+		//Bounds reaching behind the camera can cover any part of the screen
+		if (cameraZ <= FLT_EPSILON)
+		{
+			m_IsTileDirty.assign(m_Tiles.size(), true);
+			return;
+		}
+
+		const float cx = imagePlaneDistance * cameraX / cameraZ;
+		const float cy = imagePlaneDistance * cameraY / cameraZ;
+
+		const float px = (cx / (aspectRatio * fov) + 1.f) * 0.5f * m_Width;
+		const float py = (1.f - cy / fov) * 0.5f * m_Height;
+
+		minX = std::min(minX, px);
+		maxX = std::max(maxX, px);
+		minY = std::min(minY, py);
+		maxY = std::max(maxY, py);
+	}
+
+	if (maxX < 0.f || maxY < 0.f || minX >= m_Width || minY >= m_Height)
+		return;
+
+	//One pixel of slack on every side for rays that graze the bounds
+	const uint32_t firstTileX = static_cast<uint32_t>(std::max(minX - 1.f, 0.f)) / m_TileSize;
+	const uint32_t firstTileY = static_cast<uint32_t>(std::max(minY - 1.f, 0.f)) / m_TileSize;
+	const uint32_t lastTileX = std::min(static_cast<uint32_t>(std::min(maxX + 1.f, float(m_Width - 1))) / m_TileSize, m_TilesX - 1);
+	const uint32_t lastTileY = std::min(static_cast<uint32_t>(std::min(maxY + 1.f, float(m_Height - 1))) / m_TileSize, m_TilesY - 1);
+
+	for (uint32_t ty{ firstTileY }; ty <= lastTileY; ++ty)
+	{
+		for (uint32_t tx{ firstTileX }; tx <= lastTileX; ++tx)
+		{
+			m_IsTileDirty[tx + ty * m_TilesX] = true;
+		}
+	}
+}
+
+void Renderer::MarkShadowedBounds(Scene* pScene, const AABB& bounds)
+{
+	const auto& lights = pScene->GetLights();
+	const auto& influenceRadii = pScene->GetLightInfluenceRadii();
+
+	const Vector3 boundsCenter = (bounds.min + bounds.max) * 0.5f;
+	const float boundsRadius = (bounds.max - bounds.min).Magnitude() * 0.5f;
+
+	for (uint32_t i{}; i < m_Tiles.size(); ++i)
+	{
+		const Tile& tile = m_Tiles[i];
+		if (m_IsTileDirty[i] || !tile.hasHit)
+			continue;
+
+		const Vector3 tileCenter = (tile.hitMin + tile.hitMax) * 0.5f;
+		const float tileRadius = (tile.hitMax - tile.hitMin).Magnitude() * 0.5f;
+
+		for (uint32_t lightIndex{}; lightIndex < lights.size(); ++lightIndex)
+		{
+			const Light& l = lights[lightIndex];
+
+			//Culled lights cast no shadow rays from hits they do not reach, sampled lights can be picked from anywhere
+			if (m_LightCullingEnabled && !m_LightSamplingEnabled && influenceRadii[lightIndex] < FLT_MAX)
+			{
+				const Vector3 closest = Vector3::Max(tile.hitMin, Vector3::Min(l.origin, tile.hitMax));
+				if ((closest - l.origin).SqrMagnitude() > Square(influenceRadii[lightIndex]))
+					continue;
+			}
+
+			//Every shadow ray of the tile lies inside the box spanned by its hit points and the light
+			//(shadow rays are cast towards points on the light, towards light.origin also for directional lights)
+			const AABB lightBounds = LightUtils::GetBounds(l);
+			const Vector3 shadowMin = Vector3::Min(tile.hitMin, lightBounds.min);
+			const Vector3 shadowMax = Vector3::Max(tile.hitMax, lightBounds.max);
+
+			if (shadowMin.x > bounds.max.x || shadowMax.x < bounds.min.x ||
+				shadowMin.y > bounds.max.y || shadowMax.y < bounds.min.y ||
+				shadowMin.z > bounds.max.z || shadowMax.z < bounds.min.z)
+				continue;
+
+			//Seen from the light, the cone around the tile has to overlap the cone around the changed bounds
+			const Vector3 toTile = tileCenter - l.origin;
+			const Vector3 toBounds = boundsCenter - l.origin;
+			const float tileDistance = toTile.Magnitude();
+			const float boundsDistance = toBounds.Magnitude();
+
+			//The rays towards an area light do not share a starting point, only the box test applies to them
+			if (tileDistance > tileRadius && boundsDistance > boundsRadius && !LightUtils::IsAreaLight(l))
+			{
+				//Changed bounds behind the tile can not block its light
+				if (boundsDistance - boundsRadius > tileDistance + tileRadius)
+					continue;
+
+				const float angle = acosf(std::clamp(Vector3::Dot(toTile, toBounds) / (tileDistance * boundsDistance), -1.f, 1.f));
+				if (angle > asinf(tileRadius / tileDistance) + asinf(boundsRadius / boundsDistance))
+					continue;
+			}
+
+			m_IsTileDirty[i] = true;
+			break;
+		}
+	}
+}
+
+Ray Renderer::GetCameraRay(uint32_t pixelIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin, RayDifferential& differential) const
+{
 	const uint32_t px{ pixelIndex % m_Width }, py{ pixelIndex / m_Width };
 
-	float rx{ px + 0.5f }, ry{ py + 0.5f };
-	float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRation * fov };
-	float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
+	const float rx{ px + 0.5f }, ry{ py + 0.5f };
+	const float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov };
+	const float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
 
-	float aspect = static_cast<float>(m_Width) / static_cast<float>(m_Height);
-	Vector3 rayDirectionApplydCameraMovement;
+	Vector3 rayDirection(cx, cy, imagePlaneDistance);
+	rayDirection.Normalize();
 
 	Ray viewRay;
 	viewRay.origin = cameraOrigin;
-	ColorRGB finalColor;
+	viewRay.direction = cameraToWorld.TransformVector(rayDirection);
 
-	Vector3 rayDirection(cx, cy, 0.7f);
-	rayDirection.Normalize();
-	rayDirectionApplydCameraMovement = cameraToWorld.TransformVector(rayDirection);
+	//All camera rays start at the camera, only their directions differ from pixel to pixel
+	const Vector3 directionRight = Vector3(cx + 2.f / float(m_Width) * aspectRatio * fov, cy, imagePlaneDistance).Normalized();
+	const Vector3 directionDown = Vector3(cx, cy - 2.f / float(m_Height) * fov, imagePlaneDistance).Normalized();
+	differential.originX = {};
+	differential.originY = {};
+	differential.directionX = cameraToWorld.TransformVector(directionRight - rayDirection);
+	differential.directionY = cameraToWorld.TransformVector(directionDown - rayDirection);
+	differential.isValid = true;
+	return viewRay;
+}
 
-	viewRay.direction = rayDirectionApplydCameraMovement;
-	finalColor = {};
+void Renderer::TracePaths(Scene* pScene, std::vector<PixelState>& pixels, PathQueue& rays, uint32_t sampleIndex, uint32_t rayBudget) const
+{
+	const auto& materials{ pScene->GetMaterials() };
+	const uint32_t maxDepth{ IsPathTracing() ? m_MaxPathDepth : m_MaxDepth };
+	const bool usesLODSelectors{ pScene->UsesLODSelectors() };
+	const bool usesLODFootprints{ pScene->UsesLODFootprints() };
+	const bool usesTexFootprints{ pScene->UsesRayFootprints() };
 
-	HitRecord closestHit;
-	pScene->GetClosestHit(viewRay, closestHit);
+	//Secondary rays are queued for the next depth instead of being traced recursively, so every depth is one coherent batch
+	//and the direct lighting of all hits shares one batch of shadow rays
+	thread_local PathQueue nextRays{};
+	thread_local std::vector<HitRecord> hits{};
+	thread_local std::vector<ShadedHit> shadedHits{};
+	thread_local std::vector<ShadowRay> shadowRays{};
+	shadedHits.clear();
+	shadowRays.clear();
 
-	if (closestHit.didHit)
+	uint32_t spawnedRays{ 0 };
+	for (uint32_t depth{ 0 }; rays.GetSize() > 0; ++depth)
 	{
-		bool shadow = false;
-		int amountShadow = 0;
-		const float shadowIncrease = 0.1f;
-		ColorRGB totalLightColor = {};
+		//Extend, the closest hit of every queued ray
+		hits.assign(rays.GetSize(), HitRecord{});
+		for (uint32_t i{ 0 }; i < rays.GetSize(); ++i)
+		{
+			//Camera rays trace the level of detail picked for the frame, only wider rays after a bounce need their footprint
+			Ray ray = rays.GetRay(i, usesLODFootprints && depth > 0);
+			if (usesLODSelectors)
+				ray.lodSelector = GetLODSelector(pixels[rays.pixel[i]].pixelIndex, m_Width, sampleIndex);
+
+			pScene->GetClosestHit(ray, hits[i]);
+			if (usesTexFootprints && hits[i].didHit && rays.differential[i].isValid)
+				hits[i].texFootprint = GetTexFootprint(ray, rays.differential[i], hits[i]);
+			hits[i].lodSelector = ray.lodSelector;
+		}
 
-		for (const Light& l : lights)
+		//Shade, the direct lighting of every hit and the rays that continue its path
+		nextRays.Resize(0);
+		for (uint32_t i{ 0 }; i < rays.GetSize(); ++i)
 		{
-			float angleCos = 1.f;
-			ColorRGB irradiance = {};
+			const HitRecord& closestHit = hits[i];
+			if (!closestHit.didHit)
+				continue;
 
-			switch (l.type)
+			const uint32_t pixelSlot{ rays.pixel[i] };
+			PixelState& pixel = pixels[pixelSlot];
+			if (depth == 0)
 			{
-			case LightType::Point:
-				angleCos = Vector3::Dot(closestHit.normal, LightUtils::GetDirectionToLight(l, closestHit.origin).Normalized());
-				irradiance = LightUtils::GetRadiance(l, closestHit.origin, closestHit.normal);
-				break;
-			case LightType::Directional:
-				angleCos = Vector3::Dot(closestHit.normal, l.direction);
-				irradiance = l.color * l.intensity;
-				break;
-			default:
-
-				break;
+				pixel.hitOrigin = closestHit.origin;
+				pixel.didHit = true;
 			}
 
-			Vector3 directionToHit = (cameraOrigin - closestHit.origin).Normalized();
-			ColorRGB shading = {};
+			const Vector3 rayOrigin{ rays.originX[i], rays.originY[i], rays.originZ[i] };
+			const Vector3 directionToHit = (rayOrigin - closestHit.origin).Normalized();
+			const ColorRGB throughput = rays.GetThroughput(i);
 
-			switch (m_CurrentLightingMode)
+			ShadedHit shadedHit{ pixelSlot, 0, throughput, {} };
+			ShadeHit(pScene, closestHit, directionToHit, pixel.pixelIndex, sampleIndex, depth, shadedHit.color, shadowRays);
+			shadedHit.lastShadowRay = static_cast<uint32_t>(shadowRays.size());
+			shadedHits.push_back(shadedHit);
+
+			if (depth >= maxDepth)
+				continue;
+
+			Material* pMaterial = materials[closestHit.materialIndex];
+			const RayDifferential& differential = rays.differential[i];
+			if (IsPathTracing())
+				SpawnBounceRay(closestHit, pMaterial, directionToHit, differential, throughput, pixelSlot, pixel.pixelIndex, sampleIndex, depth, nextRays);
+			else
+				SpawnSecondaryRays(closestHit, pMaterial, directionToHit, differential, throughput, pixelSlot, pixel.pixelIndex, sampleIndex, depth, nextRays);
+		}
+
+		//Over budget an evenly spread subset of the rays is kept and weighted up, instead of starving the last pixels
+		//The offset of the subset changes every sample, so over time every ray is kept equally often
+		const uint32_t budgetLeft{ rayBudget - spawnedRays };
+		if (nextRays.GetSize() > budgetLeft)
+		{
+			const float keepProbability = float(budgetLeft) / float(nextRays.GetSize());
+			float position = GetRandom(pixels[0].pixelIndex, m_Width, sampleIndex, depth * dimensionsPerDepth + budgetDimension);
+
+			uint32_t keptCount{ 0 };
+			for (uint32_t i{ 0 }; i < nextRays.GetSize(); ++i)
 			{
-			case dae::Renderer::LightingMode::ObservedArea:
-				if (angleCos > 0) {
-					totalLightColor += ColorRGB{ 1.f,1.f,1.f } *angleCos;
-				}
-				break;
-			case dae::Renderer::LightingMode::Radiance:
-				if (!m_ShadowsEnabled)
-				{
-					totalLightColor += irradiance;
-				}
-				else
-				{
-					if (angleCos > 0) {
-						totalLightColor += irradiance;
-					}
-				}
-				break;
-			case dae::Renderer::LightingMode::BRDF:
-				if (angleCos > 0) {
-					shading = materials[closestHit.materialIndex]->Shade(closestHit, LightUtils::GetDirectionToLight(l, closestHit.origin).Normalized(), directionToHit);
-					totalLightColor += shading;
-				}
-				break;
-			case dae::Renderer::LightingMode::Combined:
-				if (angleCos > 0) {
-					shading = materials[closestHit.materialIndex]->Shade(closestHit, LightUtils::GetDirectionToLight(l, closestHit.origin).Normalized(), directionToHit);
-					totalLightColor += irradiance * shading * angleCos;
-				}
-				break;
-			default:
-				break;
+				const float nextPosition = position + keepProbability;
+				if (floorf(nextPosition) != floorf(position) && keptCount < budgetLeft)
+					nextRays.Keep(i, keptCount++, 1.f / keepProbability);
+				position = nextPosition;
 			}
 
-			if (m_ShadowsEnabled)
-			{
-				if (angleCos > 0) {
-					Vector3 originPointRay = closestHit.origin + closestHit.normal * 0.001f; 
-					Vector3 raydir = LightUtils::GetDirectionToLight(l, originPointRay);
-					float rayMagnitude = raydir.Magnitude();
-					raydir.Normalize();
+			nextRays.Resize(keptCount);
+		}
 
-					Ray raytoLight(originPointRay, raydir);
-					raytoLight.max = rayMagnitude - 0.001f; 
+		spawnedRays += nextRays.GetSize();
+		std::swap(rays, nextRays);
+	}
 
-					if (pScene->DoesHit(raytoLight))
-					{
-						amountShadow++;
-						shadow = true;
-					}
-				}
-			}
+	//The probes of the area lights decide which of their other samples still need a shadow ray
+	TraceShadowRays(pScene, shadowRays);
+	RefineShadowRays(shadowRays);
+	TraceShadowRays(pScene, shadowRays);
+
+	uint32_t firstShadowRay{ 0 };
+	for (ShadedHit& shadedHit : shadedHits)
+	{
+		ResolveShadows(shadedHit.color, shadowRays.data() + firstShadowRay, shadowRays.data() + shadedHit.lastShadowRay);
+		pixels[shadedHit.pixel].color += shadedHit.color * shadedHit.throughput;
+		firstShadowRay = shadedHit.lastShadowRay;
+	}
+}
+
+void Renderer::ShadeHit(Scene* pScene, const HitRecord& hit, const Vector3& directionToHit, uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays) const
+{
+	const auto& materials{ pScene->GetMaterials() };
+	auto& lights = pScene->GetLights();
+
+	Material* pMaterial = materials[hit.materialIndex];
+	finalColor = {};
+
+	//Path tracing needs the visibility of every light it shades (next event estimation)
+	const bool castShadows{ m_ShadowsEnabled || IsPathTracing() };
+
+	//Always empty between hits, every light queued below is shaded before returning
+	thread_local LightQueue queue{};
+
+	if (m_LightSamplingEnabled)
+	{
+		//Directional lights can not be sampled by position, they are shaded for every hit
+		for (uint32_t lightIndex : pScene->GetUnsampledLights())
+			ShadeLightSamples(lights[lightIndex], lightIndex, hit, pMaterial, directionToHit, 1.f, castShadows, pixelIndex, sampleIndex, depth, 0, finalColor, shadowRays, queue);
+
+		//Radiance without shadows also counts the lights behind the surface, so they have to stay in the sampled set
+		const bool usesCosine = m_ShadowsEnabled || m_CurrentLightingMode != LightingMode::Radiance;
+		const Vector3 samplingNormal = usesCosine ? hit.normal : Vector3{};
+
+		//Each of the K picked lights is weighted by 1 / (K * pdf), which keeps the sum over all lights as the expected value
+		//Only the sampled lights cast shadow rays, an occluded one contributes nothing
+		const float sampleWeight = 1.f / float(m_LightSampleCount);
+		for (uint32_t k{ 0 }; k < m_LightSampleCount; ++k)
+		{
+			uint32_t lightIndex{};
+			float pdf{};
+			if (!pScene->SampleLight(hit.origin, samplingNormal, GetRandom(pixelIndex, m_Width, sampleIndex, depth * dimensionsPerDepth + k), lightIndex, pdf))
+				break;
+
+			ShadeLightSamples(lights[lightIndex], lightIndex, hit, pMaterial, directionToHit, sampleWeight / pdf, castShadows, pixelIndex, sampleIndex, depth, k, finalColor, shadowRays, queue);
+		}
+	}
+	else
+	{
+		//Only the lights that reach the hit are shaded, all of them without culling
+		thread_local std::vector<uint32_t> lightIndices{};
+		if (m_LightCullingEnabled)
+		{
+			pScene->GetInfluencingLights(hit.origin, lightIndices);
+		}
+		else
+		{
+			lightIndices.resize(lights.size());
+			std::iota(lightIndices.begin(), lightIndices.end(), 0);
+		}
+
+		//Every visible light is added once its shadow rays are traced, see ResolveShadows
+		for (uint32_t lightIndex : lightIndices)
+			ShadeLightSamples(lights[lightIndex], lightIndex, hit, pMaterial, directionToHit, 1.f, castShadows, pixelIndex, sampleIndex, depth, 0, finalColor, shadowRays, queue);
+	}
+
+	ShadeLightQueue(queue, hit, pMaterial, directionToHit, castShadows, finalColor, shadowRays);
+}
+
+void Renderer::ShadeLightSamples(const Light& l, uint32_t lightIndex, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float weight, bool castShadows,
+	uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, uint32_t lightSample, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays, LightQueue& queue) const
+{
+	if (LightUtils::IsAreaLight(l))
+		ShadeAreaLightSamples(l, lightIndex, hit, pMaterial, directionToHit, weight, castShadows, pixelIndex, sampleIndex, depth, lightSample, finalColor, shadowRays, queue);
+	else if (UsesLightBatches() && l.type == LightType::Point)
+		QueuePointLight(l, lightIndex, hit, pMaterial, directionToHit, weight, castShadows, finalColor, shadowRays, queue);
+	else
+		ShadeLightPoint(l, lightIndex, l.origin, hit, pMaterial, directionToHit, weight, castShadows, finalColor, shadowRays, queue);
+}
+
+void Renderer::ShadeAreaLightSamples(const Light& l, uint32_t lightIndex, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float weight, bool castShadows,
+	uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, uint32_t lightSample, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays, LightQueue& queue) const
+{
+	//The shadow rays of the points are counted from firstRay below, the lights queued before have to be appended first
+	ShadeLightQueue(queue, hit, pMaterial, directionToHit, castShadows, finalColor, shadowRays);
+
+	//Jittered grid of points on the light, the jitter of every stratum is rotated by the low discrepancy sequence of the pixel
+	float shiftU{}, shiftV{};
+	GetRandom2D(pixelIndex, m_Width, sampleIndex, depth * dimensionsPerDepth + areaLightDimension, shiftU, shiftV);
+	const uint32_t seed{ PcgHash(pixelIndex ^ PcgHash(sampleIndex ^ PcgHash(lightIndex ^ PcgHash(depth * m_LightSampleCount + lightSample)))) };
+
+	const uint32_t sampleCount{ m_AreaLightStrata * m_AreaLightStrata };
+	const float invStrata{ 1.f / float(m_AreaLightStrata) };
+	const float pointWeight{ weight / float(sampleCount) };
+
+	const uint32_t firstRay{ static_cast<uint32_t>(shadowRays.size()) };
+	uint32_t probeCount{ 0 };
+
+	//The probes are pushed first, they are the points of the corner strata so an occluder reaching the light from any side meets one
+	const uint32_t lastStratum{ m_AreaLightStrata - 1 };
+	for (const bool probes : { true, false })
+	{
+		for (uint32_t i{ 0 }; i < sampleCount; ++i)
+		{
+			const uint32_t stratumX{ i % m_AreaLightStrata }, stratumY{ i / m_AreaLightStrata };
+			if (((stratumX == 0 || stratumX == lastStratum) && (stratumY == 0 || stratumY == lastStratum)) != probes)
+				continue;
+
+			const uint32_t jitter{ PcgHash(seed + i) };
+			const float jitterU = ToUnitFloat(jitter) + shiftU;
+			const float jitterV = ToUnitFloat(PcgHash(jitter)) + shiftV;
+			const float u1 = (float(stratumX) + jitterU - floorf(jitterU)) * invStrata;
+			const float u2 = (float(stratumY) + jitterV - floorf(jitterV)) * invStrata;
+			const Vector3 lightPoint = LightUtils::GetSamplePoint(l, hit.origin, u1, u2);
+
+			if (ShadeLightPoint(l, lightIndex, lightPoint, hit, pMaterial, directionToHit, pointWeight, castShadows, finalColor, shadowRays, queue))
+				probeCount += probes;
+		}
+	}
+	ShadeLightQueue(queue, hit, pMaterial, directionToHit, castShadows, finalColor, shadowRays);
+
+	const uint32_t rayCount{ static_cast<uint32_t>(shadowRays.size()) - firstRay };
+	if (rayCount == 0)
+		return;
+
+	//Without a probe above the horizon of the hit, every point is traced
+	if (!m_AdaptiveShadowsEnabled || probeCount == 0)
+		probeCount = rayCount;
+
+	shadowRays[firstRay].sampleCount = static_cast<uint16_t>(rayCount);
+	shadowRays[firstRay].probeCount = static_cast<uint16_t>(probeCount);
+	for (uint32_t i{ firstRay + probeCount }; i < firstRay + rayCount; ++i)
+		shadowRays[i].state = ShadowRayState::Deferred;
+}
+
+bool Renderer::ShadeLightPoint(const Light& l, uint32_t lightIndex, const Vector3& lightPoint, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float weight,
+	bool castShadows, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays, LightQueue& queue) const
+{
+	if (!UsesLightBatches())
+	{
+		float angleCos{};
+		const ColorRGB contribution = ShadeLight(l, lightPoint, hit, pMaterial, directionToHit, angleCos) * weight;
+
+		if (castShadows && angleCos > 0)
+		{
+			shadowRays.push_back({ GetShadowRay(lightPoint, hit), contribution, lightIndex });
+			return true;
+		}
+		finalColor += contribution;
+		return false;
+	}
+
+	//Lights below the surface add nothing in these modes, so they are not queued at all
+	Vector3 directionToLight{};
+	const ColorRGB radiance = GetIncidentLight(l, lightPoint, hit, directionToLight);
+	if (Vector3::Dot(hit.normal, directionToLight) <= 0)
+		return false;
+
+	const uint32_t lane{ queue.batch.count };
+	queue.batch.Add(directionToLight, radiance);
+	queue.pointX[lane] = lightPoint.x;
+	queue.pointY[lane] = lightPoint.y;
+	queue.pointZ[lane] = lightPoint.z;
+	queue.isPointLight[lane] = 0;
+	queue.lightIndices[lane] = lightIndex;
+	queue.weights[lane] = weight;
+
+	if (queue.batch.count == LightBatch::size)
+		ShadeLightQueue(queue, hit, pMaterial, directionToHit, castShadows, finalColor, shadowRays);
+	return castShadows;
+}
+
+void Renderer::QueuePointLight(const Light& l, uint32_t lightIndex, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float weight, bool castShadows,
+	ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays, LightQueue& queue) const
+{
+#if defined(__AVX2__)
+	const uint32_t lane{ queue.batch.count };
+	queue.batch.Add({}, l.color);
+	queue.pointX[lane] = l.origin.x;
+	queue.pointY[lane] = l.origin.y;
+	queue.pointZ[lane] = l.origin.z;
+	queue.intensities[lane] = l.intensity;
+	queue.isPointLight[lane] = ~0u;
+	queue.lightIndices[lane] = lightIndex;
+	queue.weights[lane] = weight;
+
+	if (queue.batch.count == LightBatch::size)
+		ShadeLightQueue(queue, hit, pMaterial, directionToHit, castShadows, finalColor, shadowRays);
+#else
+	ShadeLightPoint(l, lightIndex, l.origin, hit, pMaterial, directionToHit, weight, castShadows, finalColor, shadowRays, queue);
+#endif
+}
+
+void Renderer::ShadeLightQueue(LightQueue& queue, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, bool castShadows, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays) const
+{
+	LightBatch& batch = queue.batch;
+	if (batch.count == 0)
+		return;
+
+	//The point lights only know their cosine here, the other lanes were only queued when it is positive
+	alignas(32) float angleCos[LightBatch::size];
+#if defined(__AVX2__)
+	{
+		//Same operations as GetIncidentLight and the cosine of ShadeLight, for all lanes at once
+		const __m256 isPointLight = _mm256_load_ps(reinterpret_cast<const float*>(queue.isPointLight));
+		const __m256 toLightX = _mm256_sub_ps(_mm256_load_ps(queue.pointX), _mm256_set1_ps(hit.origin.x));
+		const __m256 toLightY = _mm256_sub_ps(_mm256_load_ps(queue.pointY), _mm256_set1_ps(hit.origin.y));
+		const __m256 toLightZ = _mm256_sub_ps(_mm256_load_ps(queue.pointZ), _mm256_set1_ps(hit.origin.z));
+		const __m256 distanceSq = BRDF::Dot(toLightX, toLightY, toLightZ, toLightX, toLightY, toLightZ);
+		const __m256 distance = _mm256_sqrt_ps(distanceSq);
+
+		const __m256 directionX = _mm256_blendv_ps(_mm256_load_ps(batch.directionX), _mm256_div_ps(toLightX, distance), isPointLight);
+		const __m256 directionY = _mm256_blendv_ps(_mm256_load_ps(batch.directionY), _mm256_div_ps(toLightY, distance), isPointLight);
+		const __m256 directionZ = _mm256_blendv_ps(_mm256_load_ps(batch.directionZ), _mm256_div_ps(toLightZ, distance), isPointLight);
+		_mm256_store_ps(batch.directionX, directionX);
+		_mm256_store_ps(batch.directionY, directionY);
+		_mm256_store_ps(batch.directionZ, directionZ);
+
+		const __m256 falloff = _mm256_blendv_ps(_mm256_set1_ps(1.f), _mm256_div_ps(_mm256_load_ps(queue.intensities), distanceSq), isPointLight);
+		_mm256_store_ps(batch.red, _mm256_mul_ps(_mm256_load_ps(batch.red), falloff));
+		_mm256_store_ps(batch.green, _mm256_mul_ps(_mm256_load_ps(batch.green), falloff));
+		_mm256_store_ps(batch.blue, _mm256_mul_ps(_mm256_load_ps(batch.blue), falloff));
+
+		_mm256_store_ps(angleCos, BRDF::Dot(_mm256_set1_ps(hit.normal.x), _mm256_set1_ps(hit.normal.y), _mm256_set1_ps(hit.normal.z), directionX, directionY, directionZ));
+	}
+#else
+	std::fill(angleCos, angleCos + batch.count, 1.f);
+#endif
+
+	pMaterial->ShadeBatch(hit, directionToHit, batch);
+
+	for (uint32_t i{ 0 }; i < batch.count; ++i)
+	{
+		if (!(angleCos[i] > 0))
+			continue;
+
+		const ColorRGB contribution = ColorRGB{ batch.red[i], batch.green[i], batch.blue[i] } * queue.weights[i];
+		if (castShadows)
+			shadowRays.push_back({ GetShadowRay({ queue.pointX[i], queue.pointY[i], queue.pointZ[i] }, hit), contribution, queue.lightIndices[i] });
+		else
+			finalColor += contribution;
+	}
+	batch.count = 0;
+}
+
+void Renderer::SpawnSecondaryRays(const HitRecord& hit, const Material* pMaterial, const Vector3& directionToHit, const RayDifferential& differential, const ColorRGB& throughput,
+	uint32_t pixelSlot, uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, PathQueue& rays) const
+{
+	ColorRGB reflectance = pMaterial->GetReflectance(hit, directionToHit);
+	const ColorRGB transmittance = pMaterial->GetTransmittance(hit, directionToHit);
+
+	//Normal on the side the ray arrives from, rays inside a refractive object hit its back faces
+	const float cosIncident = Vector3::Dot(hit.normal, directionToHit);
+	const Vector3 normal = cosIncident < 0.f ? -hit.normal : hit.normal;
+
+	if (std::max(transmittance.r, std::max(transmittance.g, transmittance.b)) > 0.f)
+	{
+		const float indexOfRefraction = pMaterial->GetIndexOfRefraction();
+		const float eta = cosIncident < 0.f ? indexOfRefraction : 1.f / indexOfRefraction;
+		const float cosI = std::abs(cosIncident);
+		const float sinSqrT = Square(eta) * (1.f - Square(cosI));
+
+		//Total internal reflection, the light that would be refracted is reflected as well
+		if (sinSqrT >= 1.f)
+		{
+			reflectance += transmittance;
+		}
+		else
+		{
+			const Vector3 direction = (-directionToHit * eta + normal * (eta * cosI - sqrtf(1.f - sinSqrT))).Normalized();
+			QueueRay(rays, { hit.origin - normal * 0.001f, direction }, RefractDifferential(-directionToHit, differential, hit, normal, eta), throughput * transmittance, pixelSlot,
+				GetRandom(pixelIndex, m_Width, sampleIndex, depth * dimensionsPerDepth + refractionDimension));
 		}
+	}
+
+	QueueRay(rays, { hit.origin + normal * 0.001f, Vector3::Reflect(-directionToHit, normal) }, ReflectDifferential(-directionToHit, differential, hit, normal),
+		throughput * reflectance, pixelSlot, GetRandom(pixelIndex, m_Width, sampleIndex, depth * dimensionsPerDepth + reflectionDimension));
+}
+
+void Renderer::SpawnBounceRay(const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, const RayDifferential& differential, const ColorRGB& throughput,
+	uint32_t pixelSlot, uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, PathQueue& rays) const
+{
+	//Glass has no lobe to sample, its paths continue along the reflected and refracted ray
+	const ColorRGB transmittance = pMaterial->GetTransmittance(hit, directionToHit);
+	if (std::max(transmittance.r, std::max(transmittance.g, transmittance.b)) > 0.f)
+	{
+		SpawnSecondaryRays(hit, pMaterial, directionToHit, differential, throughput, pixelSlot, pixelIndex, sampleIndex, depth, rays);
+		return;
+	}
+
+	//Like the lights, the BRDFs are only evaluated on the front of a surface
+	if (Vector3::Dot(hit.normal, directionToHit) <= 0.f)
+		return;
+
+	//The material picks the direction in proportion to its BRDF where it can, which keeps BRDF * cos / pdf close to constant
+	const uint32_t firstDimension{ depth * dimensionsPerDepth };
+	Vector3 direction{};
+	float pdf{};
+	float u1{}, u2{};
+	GetRandom2D(pixelIndex, m_Width, sampleIndex, firstDimension + bounceDimension, u1, u2);
+	const ColorRGB brdf = pMaterial->Sample(hit, directionToHit, u1, u2, direction, pdf);
+
+	if (pdf <= 0.f)
+		return;
 
-		totalLightColor.MaxToOne();
-		finalColor += totalLightColor;
+	const ColorRGB weight = brdf * (Vector3::Dot(hit.normal, direction) / pdf);
 
-		if (shadow)
+	//Differentials only exist for mirror reflections, the bounce is followed as the mirror reflection off the microfacet that
+	//reflects directionToHit into direction. A lower bound on the footprint of rough lobes, which never blurs the textures too much
+	RayDifferential bounceDifferential{};
+	if (differential.isValid)
+		bounceDifferential = ReflectDifferential(-directionToHit, differential, hit, (direction + directionToHit).Normalized());
+
+	QueueRay(rays, { hit.origin + hit.normal * 0.001f, direction }, bounceDifferential, throughput * weight, pixelSlot,
+		GetRandom(pixelIndex, m_Width, sampleIndex, firstDimension + reflectionDimension));
+}
+
+void Renderer::QueueRay(PathQueue& rays, const Ray& ray, const RayDifferential& differential, ColorRGB throughput, uint32_t pixelSlot, float u) const
+{
+	//Russian roulette, a path that adds little is stopped at random and the surviving ones are weighted up to keep the expected value
+	const float maxThroughput = std::max(throughput.r, std::max(throughput.g, throughput.b));
+	if (!(maxThroughput > 0.f))
+		return;
+
+	const float survival = std::min(maxThroughput / m_RouletteThreshold, 1.f);
+	if (survival < 1.f)
+	{
+		if (u >= survival)
+			return;
+		throughput /= survival;
+	}
+
+	rays.Push(ray, throughput, pixelSlot, differential);
+}
+
+void Renderer::RefineShadowRays(std::vector<ShadowRay>& shadowRays) const
+{
+	for (size_t first{ 0 }; first < shadowRays.size(); first += shadowRays[first].sampleCount)
+	{
+		ShadowRay* pSamples = shadowRays.data() + first;
+		const uint32_t sampleCount{ pSamples->sampleCount }, probeCount{ pSamples->probeCount };
+		if (probeCount == sampleCount)
+			continue;
+
+		uint32_t occludedProbes{ 0 };
+		for (uint32_t i{ 0 }; i < probeCount; ++i)
+			occludedProbes += pSamples[i].occluded;
+
+		//Probes that agree stand for the whole light, a small occluder that slips between them is missed
+		const bool isPenumbra = occludedProbes != 0 && occludedProbes != probeCount;
+		for (uint32_t i{ probeCount }; i < sampleCount; ++i)
 		{
-			finalColor *= 0.9f - amountShadow * shadowIncrease;
+			pSamples[i].state = isPenumbra ? ShadowRayState::Queued : ShadowRayState::Traced;
+			pSamples[i].occluded = occludedProbes == probeCount;
 		}
 	}
+}
+
+void Renderer::ResolveShadows(ColorRGB& finalColor, const ShadowRay* pFirst, const ShadowRay* pLast) const
+{
+	for (const ShadowRay* pShadowRay{ pFirst }; pShadowRay != pLast; ++pShadowRay)
+	{
+		if (!pShadowRay->occluded)
+			finalColor += pShadowRay->contribution;
+	}
 
-	finalColor.MaxToOne();
+	if (ClampsHitLight())
+		finalColor.MaxToOne();
+}
+
+void Renderer::WritePixel(uint32_t pixelIndex, uint32_t sampleIndex, ColorRGB finalColor) const
+{
+	const uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
+	if (IsProgressive())
+	{
+		//Progressive accumulation, the buffer holds the sum of every sample since the tile was last invalidated
+		float* pRed = m_pAccumulationBuffer.get();
+		float* pGreen = pRed + amountOfPixels;
+		float* pBlue = pGreen + amountOfPixels;
+
+		if (sampleIndex == 0)
+		{
+			pRed[pixelIndex] = finalColor.r;
+			pGreen[pixelIndex] = finalColor.g;
+			pBlue[pixelIndex] = finalColor.b;
+		}
+		else
+		{
+			pRed[pixelIndex] += finalColor.r;
+			pGreen[pixelIndex] += finalColor.g;
+			pBlue[pixelIndex] += finalColor.b;
+		}
+
+		const float invSampleCount = 1.f / float(sampleIndex + 1);
+		finalColor = ColorRGB{ pRed[pixelIndex], pGreen[pixelIndex], pBlue[pixelIndex] } * invSampleCount;
+	}
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+	//Tone mapping and conversion to the surface format happen afterwards in PackColorBuffer
+	m_pColorBuffer[pixelIndex] = finalColor.r;
+	m_pColorBuffer[amountOfPixels + pixelIndex] = finalColor.g;
+	m_pColorBuffer[2 * amountOfPixels + pixelIndex] = finalColor.b;
+}
+
+ColorRGB Renderer::ShadeLight(const Light& l, const Vector3& lightPoint, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float& angleCos) const
+{
+	Vector3 directionToLight{};
+	const ColorRGB irradiance = GetIncidentLight(l, lightPoint, hit, directionToLight);
+	angleCos = Vector3::Dot(hit.normal, directionToLight);
+
+	switch (m_CurrentLightingMode)
+	{
+	case dae::Renderer::LightingMode::ObservedArea:
+		if (angleCos > 0) {
+			return ColorRGB{ 1.f,1.f,1.f } *angleCos;
+		}
+		break;
+	case dae::Renderer::LightingMode::Radiance:
+		if (!m_ShadowsEnabled || angleCos > 0)
+		{
+			return irradiance;
+		}
+		break;
+	case dae::Renderer::LightingMode::BRDF:
+		if (angleCos > 0) {
+			return pMaterial->Shade(hit, directionToLight, directionToHit);
+		}
+		break;
+	case dae::Renderer::LightingMode::Combined:
+	case dae::Renderer::LightingMode::PathTracing:
+		if (angleCos > 0) {
+			const ColorRGB shading = pMaterial->Shade(hit, directionToLight, directionToHit);
+			return irradiance * shading * angleCos;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return {};
+}
+
+ColorRGB Renderer::GetIncidentLight(const Light& l, const Vector3& lightPoint, const HitRecord& hit, Vector3& directionToLight) const
+{
+	//Directional lights have no position, their light arrives from the same direction at every hit
+	if (l.type == LightType::Directional)
+	{
+		directionToLight = l.direction;
+		return l.color * l.intensity;
+	}
+
+	directionToLight = Vector3(hit.origin, lightPoint).Normalized();
+	return LightUtils::GetRadiance(l, hit.origin, lightPoint);
+}
+
+Ray Renderer::GetShadowRay(const Vector3& lightPoint, const HitRecord& hit) const
+{
+	Vector3 originPointRay = hit.origin + hit.normal * 0.001f;
+	Vector3 raydir = Vector3(originPointRay, lightPoint);
+	float rayMagnitude = raydir.Magnitude();
+	raydir.Normalize();
+
+	Ray raytoLight(originPointRay, raydir);
+	raytoLight.max = rayMagnitude - 0.001f;
+	//The same levels of detail as the surface the ray leaves, a coarser level could shadow it
+	raytoLight.lodSelector = hit.lodSelector;
+	raytoLight.lodMeshIndex = hit.lodMeshIndex;
+	raytoLight.lodMeshLevel = hit.lodMeshLevel;
+
+	return raytoLight;
+}
+
+void Renderer::TraceShadowRays(Scene* pScene, std::vector<ShadowRay>& shadowRays) const
+{
+	if (shadowRays.empty())
+		return;
+
+	//Counting sort of the rays by light and by the octant of their direction. It is stable, so inside a group the rays keep
+	//the Morton order their pixels were traced in, which keeps the origins of a packet close together
+	const uint32_t groupCount = static_cast<uint32_t>(pScene->GetLights().size()) * 8;
+	const auto getGroup = [](const ShadowRay& shadowRay)
+		{
+			const Vector3& direction = shadowRay.ray.direction;
+			return shadowRay.lightIndex * 8 + ((direction.x < 0) | (direction.y < 0) << 1 | (direction.z < 0) << 2);
+		};
+
+	thread_local std::vector<uint32_t> groupStarts{};
+	groupStarts.assign(groupCount + 1, 0);
+	for (const ShadowRay& shadowRay : shadowRays)
+	{
+		if (shadowRay.state == ShadowRayState::Queued)
+			++groupStarts[getGroup(shadowRay) + 1];
+	}
+	for (uint32_t i{ 1 }; i <= groupCount; ++i)
+		groupStarts[i] += groupStarts[i - 1];
+
+	thread_local std::vector<uint32_t> order{};
+	order.resize(groupStarts[groupCount]);
+	for (uint32_t i{ 0 }; i < shadowRays.size(); ++i)
+	{
+		if (shadowRays[i].state == ShadowRayState::Queued)
+			order[groupStarts[getGroup(shadowRays[i])]++] = i;
+	}
+
+	//Traced in chunks of whole packets that never mix lights
+	constexpr uint32_t chunkSize{ 8 * RayPacket::size };
+	Ray rays[chunkSize];
+	bool occluded[chunkSize];
+
+	for (size_t first{ 0 }; first < order.size();)
+	{
+		const uint32_t lightIndex = shadowRays[order[first]].lightIndex;
+
+		uint32_t count{ 0 };
+		while (first + count < order.size() && count < chunkSize && shadowRays[order[first + count]].lightIndex == lightIndex)
+		{
+			rays[count] = shadowRays[order[first + count]].ray;
+			++count;
+		}
+
+		pScene->DoesHit(rays, count, occluded);
+
+		for (uint32_t i{ 0 }; i < count; ++i)
+		{
+			shadowRays[order[first + i]].occluded = occluded[i];
+			shadowRays[order[first + i]].state = ShadowRayState::Traced;
+		}
+
+		first += count;
+	}
 }
 
 bool Renderer::SaveBufferToImage() const
@@ -199,12 +1295,10 @@ void  Renderer::RenderGradient(int px, int py) const
 	ColorRGB finalColor{ gradient, gradient, gradient };
 
 	//Update Color in Buffer
-	finalColor.MaxToOne();
-
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+	const uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
+	m_pColorBuffer[px + (py * m_Width)] = finalColor.r;
+	m_pColorBuffer[amountOfPixels + px + (py * m_Width)] = finalColor.g;
+	m_pColorBuffer[2 * amountOfPixels + px + (py * m_Width)] = finalColor.b;
 }
 
 
@@ -230,6 +1324,69 @@ void Renderer::Update()
 		if (m_F3Pressed) CycleLightingMode();
 		m_F3Pressed = false;
 	}
+	if (pKeyboardState[SDL_SCANCODE_F4])
+	{
+		m_F4Pressed = true;
+	}
+	else
+	{
+		if (m_F4Pressed) CyclePixelOrder();
+		m_F4Pressed = false;
+	}
+	if (pKeyboardState[SDL_SCANCODE_F5])
+	{
+		m_F5Pressed = true;
+	}
+	else
+	{
+		if (m_F5Pressed) ToggleGammaCorrection();
+		m_F5Pressed = false;
+	}
+	if (pKeyboardState[SDL_SCANCODE_F6])
+	{
+		m_F6Pressed = true;
+	}
+	else
+	{
+		if (m_F6Pressed) ToggleLightCulling();
+		m_F6Pressed = false;
+	}
+	if (pKeyboardState[SDL_SCANCODE_F7])
+	{
+		m_F7Pressed = true;
+	}
+	else
+	{
+		if (m_F7Pressed) ToggleLightSampling();
+		m_F7Pressed = false;
+	}
+	if (pKeyboardState[SDL_SCANCODE_F8])
+	{
+		m_F8Pressed = true;
+	}
+	else
+	{
+		if (m_F8Pressed) CycleMaxDepth();
+		m_F8Pressed = false;
+	}
+	if (pKeyboardState[SDL_SCANCODE_F9])
+	{
+		m_F9Pressed = true;
+	}
+	else
+	{
+		if (m_F9Pressed) ToggleAdaptiveShadows();
+		m_F9Pressed = false;
+	}
+	if (pKeyboardState[SDL_SCANCODE_F10])
+	{
+		m_F10Pressed = true;
+	}
+	else
+	{
+		if (m_F10Pressed) ToggleLightBatches();
+		m_F10Pressed = false;
+	}
 }
 
 void Renderer::CycleLightingMode()
@@ -245,12 +1402,86 @@ void Renderer::CycleLightingMode()
 		m_CurrentLightingMode = LightingMode::Combined;
 		break;
 	case LightingMode::Combined:
+		m_CurrentLightingMode = LightingMode::PathTracing;
+		break;
+	case LightingMode::PathTracing:
 		m_CurrentLightingMode = LightingMode::ObservedArea;
 		break;
 	}
+
+	m_FullRedraw = true;
+}
+
+void Renderer::CyclePixelOrder()
+{
+	switch (m_CurrentPixelOrder) {
+	case PixelOrder::Scanline:
+		m_CurrentPixelOrder = PixelOrder::Morton;
+		break;
+	case PixelOrder::Morton:
+		m_CurrentPixelOrder = PixelOrder::Scanline;
+		break;
+	}
+
+	UpdatePixelOrder();
+	std::cout << "Pixel order: " << GetPixelOrderName() << std::endl;
+}
+
+const char* Renderer::GetPixelOrderName() const
+{
+	switch (m_CurrentPixelOrder) {
+	case PixelOrder::Scanline:
+		return "Scanline";
+	case PixelOrder::Morton:
+		return "Morton";
+	}
+
+	return "";
+}
+
+void Renderer::ToggleGammaCorrection()
+{
+	//Only changes the pack pass, the traced colors stay valid
+	m_GammaCorrectionEnabled = !m_GammaCorrectionEnabled;
+}
+
+void Renderer::ToggleLightCulling()
+{
+	m_LightCullingEnabled = !m_LightCullingEnabled;
+	m_FullRedraw = true;
+	std::cout << "Light culling: " << (m_LightCullingEnabled ? "on" : "off") << std::endl;
+}
+
+void Renderer::ToggleLightSampling()
+{
+	m_LightSamplingEnabled = !m_LightSamplingEnabled;
+	m_FullRedraw = true;
+	std::cout << "Light sampling: " << (m_LightSamplingEnabled ? "on" : "off") << std::endl;
+}
+
+void Renderer::CycleMaxDepth()
+{
+	m_MaxDepth = (m_MaxDepth + 1) % (m_MaxDepthLimit + 1);
+	m_FullRedraw = true;
+	std::cout << "Max depth: " << m_MaxDepth << std::endl;
+}
+
+void Renderer::ToggleAdaptiveShadows()
+{
+	m_AdaptiveShadowsEnabled = !m_AdaptiveShadowsEnabled;
+	m_FullRedraw = true;
+	std::cout << "Adaptive area light shadows: " << (m_AdaptiveShadowsEnabled ? "on" : "off") << std::endl;
+}
+
+void Renderer::ToggleLightBatches()
+{
+	m_LightBatchesEnabled = !m_LightBatchesEnabled;
+	m_FullRedraw = true;
+	std::cout << "Light batches: " << (m_LightBatchesEnabled ? "on" : "off") << std::endl;
 }
 
 void Renderer::ToggleShadows()
 {
 	m_ShadowsEnabled = !m_ShadowsEnabled;
+	m_FullRedraw = true;
 }
\ No newline at end of file
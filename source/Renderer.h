@@ -1,7 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
 #include "Matrix.h"
+#include "DataTypes.h"
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -9,12 +15,14 @@ struct SDL_Surface;
 namespace dae
 {
 	class Scene;
+	class Material;
+	struct AABB;
 
 	class Renderer final
 	{
 	public:
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
@@ -23,16 +31,45 @@ namespace dae
 
 		void Update();
 
-		void Render(Scene* pScene) const;
+		void Render(Scene* pScene);
+		//Render on another thread, so the frame packed by the last Render can be presented meanwhile. Every call has to be followed
+		//by a Present, the new frame is only packed over the surface once that Present returned
+		std::future<void> RenderAsync(Scene* pScene);
 
-		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRation, const Matrix cameraToWorld, const Vector3 cameraOrigin) const;
+		void RenderTile(Scene* pScene, uint32_t tileIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin);
 
 		bool SaveBufferToImage() const;
+		//Shows the frame packed by the last Render, only called from the main thread. It may overlap the next RenderAsync
+		void Present();
+		//Saves the next presented frame
+		void RequestScreenshot() { m_ScreenshotRequested = true; }
+		void WaitForScreenshot();
 
 		void RenderGradient(int px, int py) const;
 
 		void ToggleShadows();
 		void CycleLightingMode();
+		void CyclePixelOrder();
+		void ToggleGammaCorrection();
+		void ToggleLightCulling();
+		void ToggleLightSampling();
+		void CycleMaxDepth();
+		void ToggleAdaptiveShadows();
+		void ToggleLightBatches();
+
+		//Makes the next frame trace every tile, used for benchmarking
+		void ForceFullRedraw() { m_FullRedraw = true; }
+		const char* GetPixelOrderName() const;
+
+		//Camera samples (one per traced pixel) of the last frame, the time the frame took to trace them and the time the
+		//worker threads spent tracing, which gives the samples per second of a single thread
+		struct FrameStats
+		{
+			uint32_t sampleCount{};
+			float traceSeconds{};
+			float busySeconds{};
+		};
+		const FrameStats& GetFrameStats() const { return m_FrameStats; }
 
 
 	private:
@@ -40,21 +77,295 @@ namespace dae
 			ObservedArea, //lambert cosine law
 			Radiance, // incident Radiance
 			BRDF, // scatering of the light
-			Combined // ObservedArea * Radiance * BRDF
+			Combined, // ObservedArea * Radiance * BRDF
+			PathTracing // Combined for every vertex of a path that bounces off the BRDFs (global illumination)
 		};
 
+		struct Tile
+		{
+			uint32_t x{};
+			uint32_t y{};
+			uint32_t width{};
+			uint32_t height{};
+
+			//World space bounds of the primary hits inside the tile, used to find tiles whose shadows changed
+			Vector3 hitMin{};
+			Vector3 hitMax{};
+			bool hasHit{ false };
+
+			//Frames accumulated since the tile was last invalidated, only used while rendering progressively
+			uint32_t sampleCount{};
+		};
+
+		void InitializeTiles();
+		void MarkDirtyTiles(Scene* pScene, const Matrix& cameraToWorld, float fov, float aspectRatio);
+		void MarkProjectedBounds(const AABB& bounds, const Matrix& cameraToWorld, float fov, float aspectRatio);
+		void MarkShadowedBounds(Scene* pScene, const AABB& bounds);
+
+		//Order in which tiles are handed out and pixels are traced inside a tile
+		enum class PixelOrder {
+			Scanline, // row by row
+			Morton // Z-order curve, consecutive rays stay close together on screen
+		};
+
+		void UpdatePixelOrder();
+		void PackColorBuffer() const;
+		void PackColorRange(uint32_t first, uint32_t last) const;
+
+		enum class ShadowRayState : uint8_t {
+			Queued, // traced by the next TraceShadowRays
+			Deferred, // area light sample waiting for the probes of its light, see RefineShadowRays
+			Traced
+		};
+
+		//Shadow ray of a light that shades a pixel, traced after shading together with the other shadow rays of the tile
+		struct ShadowRay
+		{
+			Ray ray{};
+			//Added to the pixel when the light is visible
+			ColorRGB contribution{};
+			uint32_t lightIndex{};
+			//The samples of an area light at one hit are consecutive, the first one holds their count and how many of them
+			//are probes, which come first
+			uint16_t sampleCount{ 1 };
+			uint16_t probeCount{ 1 };
+			ShadowRayState state{ ShadowRayState::Queued };
+			bool occluded{ false };
+		};
+
+		//Lights of one hit waiting to be shaded together by Material::ShadeBatch, with what is needed to add them once shaded
+		struct LightQueue
+		{
+			LightBatch batch{};
+			//Point on the light of every lane, the end of its shadow ray
+			alignas(32) float pointX[LightBatch::size]{};
+			alignas(32) float pointY[LightBatch::size]{};
+			alignas(32) float pointZ[LightBatch::size]{};
+			//Point lights are queued with their color in the batch and their intensity here, their direction, distance falloff and
+			//cosine are computed for the whole batch at once. The other lanes hold their direction and radiance in the batch already
+			alignas(32) float intensities[LightBatch::size]{};
+			alignas(32) uint32_t isPointLight[LightBatch::size]{};
+			uint32_t lightIndices[LightBatch::size]{};
+			float weights[LightBatch::size]{};
+		};
+
+		//Pixel traced by TracePaths, color is the sum of every shaded hit of its paths
+		struct PixelState
+		{
+			uint32_t pixelIndex{};
+			ColorRGB color{};
+			//Hit of the camera ray
+			Vector3 hitOrigin{};
+			bool didHit{ false };
+		};
+
+		//Rays waiting to be traced, the camera rays of the pixels and the rays that continue their paths from every hit
+		//Kept in SoA layout, so every pass over the queue only streams the fields it reads
+		struct PathQueue
+		{
+			std::vector<float> originX{}, originY{}, originZ{};
+			std::vector<float> directionX{}, directionY{}, directionZ{};
+			//Fraction of the color shaded at the hit that reaches the pixel
+			std::vector<float> throughputR{}, throughputG{}, throughputB{};
+			//Index into the traced pixels
+			std::vector<uint32_t> pixel{};
+			//Footprint of the pixel carried by the ray, only read when a hit is textured
+			std::vector<RayDifferential> differential{};
+
+			uint32_t GetSize() const { return static_cast<uint32_t>(pixel.size()); }
+			void Resize(uint32_t size)
+			{
+				for (auto* pField : { &originX, &originY, &originZ, &directionX, &directionY, &directionZ, &throughputR, &throughputG, &throughputB })
+					pField->resize(size);
+				pixel.resize(size);
+				differential.resize(size);
+			}
+
+			void Push(const Ray& ray, const ColorRGB& throughput, uint32_t pixelSlot, const RayDifferential& rayDifferential = {})
+			{
+				originX.push_back(ray.origin.x);
+				originY.push_back(ray.origin.y);
+				originZ.push_back(ray.origin.z);
+				directionX.push_back(ray.direction.x);
+				directionY.push_back(ray.direction.y);
+				directionZ.push_back(ray.direction.z);
+				throughputR.push_back(throughput.r);
+				throughputG.push_back(throughput.g);
+				throughputB.push_back(throughput.b);
+				pixel.push_back(pixelSlot);
+				differential.push_back(rayDifferential);
+			}
+
+			//withFootprint fills in the cone that holds the footprints towards both neighbouring pixels, only the levels of detail
+			//of the meshes read it
+			Ray GetRay(uint32_t i, bool withFootprint) const
+			{
+				Ray ray{};
+				ray.origin = { originX[i], originY[i], originZ[i] };
+				ray.direction = { directionX[i], directionY[i], directionZ[i] };
+
+				const RayDifferential& rayDifferential = differential[i];
+				if (withFootprint && rayDifferential.isValid)
+				{
+					ray.footprintWidth = std::max(rayDifferential.originX.Magnitude(), rayDifferential.originY.Magnitude());
+					ray.footprintSpread = std::max(rayDifferential.directionX.Magnitude(), rayDifferential.directionY.Magnitude());
+				}
+				return ray;
+			}
+
+			ColorRGB GetThroughput(uint32_t i) const { return { throughputR[i], throughputG[i], throughputB[i] }; }
+
+			//Moves a ray to a lower index with its throughput scaled by weight, used to compact the queue in place
+			void Keep(uint32_t from, uint32_t to, float weight)
+			{
+				for (auto* pField : { &originX, &originY, &originZ, &directionX, &directionY, &directionZ })
+					(*pField)[to] = (*pField)[from];
+				throughputR[to] = throughputR[from] * weight;
+				throughputG[to] = throughputG[from] * weight;
+				throughputB[to] = throughputB[from] * weight;
+				pixel[to] = pixel[from];
+				differential[to] = differential[from];
+			}
+		};
+
+		//Direct lighting of one hit, added to its pixel scaled by the throughput once its shadow rays are traced
+		struct ShadedHit
+		{
+			uint32_t pixel{};
+			uint32_t lastShadowRay{};
+			ColorRGB throughput{};
+			ColorRGB color{};
+		};
+
+		//The ray through the center of a pixel and its differentials towards the next pixel on the right and below
+		Ray GetCameraRay(uint32_t pixelIndex, float fov, float aspectRatio, const Matrix& cameraToWorld, const Vector3& cameraOrigin, RayDifferential& differential) const;
+		//Traces the queued rays and every secondary ray they spawn one depth at a time (wavefront), so all rays of a depth are
+		//traced together and then shaded together. At most rayBudget secondary rays are spawned, rays is used as scratch space
+		void TracePaths(Scene* pScene, std::vector<PixelState>& pixels, PathQueue& rays, uint32_t sampleIndex, uint32_t rayBudget) const;
+		//Direct lighting of a hit, the shadow rays it needs are appended and applied by ResolveShadows
+		void ShadeHit(Scene* pScene, const HitRecord& hit, const Vector3& directionToHit, uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays) const;
+		//Shades one light scaled by weight and appends its shadow rays, lights that cast no shadow are added to finalColor
+		//Area lights are shaded from a stratified grid of points on them, lightSample tells apart several picks of the same light
+		void ShadeLightSamples(const Light& l, uint32_t lightIndex, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float weight, bool castShadows,
+			uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, uint32_t lightSample, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays, LightQueue& queue) const;
+		void ShadeAreaLightSamples(const Light& l, uint32_t lightIndex, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float weight, bool castShadows,
+			uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, uint32_t lightSample, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays, LightQueue& queue) const;
+		//Shades lightPoint, a point on a light, or queues it for the next batch. Returns whether it casts a shadow ray
+		bool ShadeLightPoint(const Light& l, uint32_t lightIndex, const Vector3& lightPoint, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float weight,
+			bool castShadows, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays, LightQueue& queue) const;
+		//Queues a point light for the next batch without computing anything about it yet
+		void QueuePointLight(const Light& l, uint32_t lightIndex, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float weight, bool castShadows,
+			ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays, LightQueue& queue) const;
+		//Shades the queued lights with one call of Material::ShadeBatch and appends their shadow rays in the order they were queued
+		void ShadeLightQueue(LightQueue& queue, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, bool castShadows, ColorRGB& finalColor, std::vector<ShadowRay>& shadowRays) const;
+		//Queues the reflected and refracted ray of a hit, differential is that of the ray that arrived at the hit
+		void SpawnSecondaryRays(const HitRecord& hit, const Material* pMaterial, const Vector3& directionToHit, const RayDifferential& differential, const ColorRGB& throughput,
+			uint32_t pixelSlot, uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, PathQueue& rays) const;
+		//Queues a ray in a direction picked over the hemisphere of a hit, weighted by the BRDF
+		void SpawnBounceRay(const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, const RayDifferential& differential, const ColorRGB& throughput,
+			uint32_t pixelSlot, uint32_t pixelIndex, uint32_t sampleIndex, uint32_t depth, PathQueue& rays) const;
+		//Queues a ray unless russian roulette (decided by u) stops it
+		void QueueRay(PathQueue& rays, const Ray& ray, const RayDifferential& differential, ColorRGB throughput, uint32_t pixelSlot, float u) const;
+		//Traces the queued shadow rays
+		void TraceShadowRays(Scene* pScene, std::vector<ShadowRay>& shadowRays) const;
+		//Once the probes are traced, queues the other samples of the area lights whose probes disagree (a penumbra)
+		//and gives the samples of the others the visibility of their probes
+		void RefineShadowRays(std::vector<ShadowRay>& shadowRays) const;
+		void ResolveShadows(ColorRGB& finalColor, const ShadowRay* pFirst, const ShadowRay* pLast) const;
+		void WritePixel(uint32_t pixelIndex, uint32_t sampleIndex, ColorRGB finalColor) const;
+
+		//Contribution of lightPoint, a point on the light, to a hit in the current lighting mode, angleCos is the cosine towards it
+		ColorRGB ShadeLight(const Light& l, const Vector3& lightPoint, const HitRecord& hit, Material* pMaterial, const Vector3& directionToHit, float& angleCos) const;
+		//Radiance arriving at a hit from lightPoint, directionToLight is the normalized direction it arrives from
+		ColorRGB GetIncidentLight(const Light& l, const Vector3& lightPoint, const HitRecord& hit, Vector3& directionToLight) const;
+		Ray GetShadowRay(const Vector3& lightPoint, const HitRecord& hit) const;
+
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
+		PixelOrder m_CurrentPixelOrder{ PixelOrder::Morton };
 		bool m_ShadowsEnabled{ false };
+		bool m_GammaCorrectionEnabled{ false };
+		bool m_LightCullingEnabled{ true };
+
+		//Stochastic light sampling, K lights picked per hit by importance, converged by accumulating frames
+		bool m_LightSamplingEnabled{ false };
+		const uint32_t m_LightSampleCount{ 4 };
+		const uint32_t m_MaxSampleCount{ 256 };
+
+		//Reflections and refractions, secondary rays are traced up to m_MaxDepth bounces deep (0 is direct lighting only)
+		//Every frame may spawn m_SecondaryRaysPerPixel rays per pixel on average, shared evenly by the traced tiles
+		uint32_t m_MaxDepth{ 0 };
+		const uint32_t m_MaxDepthLimit{ 4 };
+		const float m_SecondaryRaysPerPixel{ 2.f };
+		uint32_t m_TileRayBudget{};
+		//Paths whose throughput drops below this are continued with a probability proportional to it (russian roulette)
+		const float m_RouletteThreshold{ 0.25f };
+
+		//Area lights are shaded from m_AreaLightStrata x m_AreaLightStrata stratified points. Only the probes, the points of the
+		//four corner strata, cast their shadow rays up front, the other points only where the probes disagree
+		const uint32_t m_AreaLightStrata{ 4 };
+		bool m_AdaptiveShadowsEnabled{ true };
+		//Whether the traced scene has area lights, updated every frame
+		bool m_HasAreaLights{ false };
+
+		//Path tracing follows paths of up to m_MaxPathDepth bounces, m_MaxDepth only limits the reflections and refractions
+		const uint32_t m_MaxPathDepth{ 8 };
+		bool IsPathTracing() const { return m_CurrentLightingMode == LightingMode::PathTracing; }
+		//Ray differentials are only followed for textures, or for the levels of detail the rays after a bounce pick from them
+		bool FollowsRayDifferentials(const Scene* pScene) const;
+		//The lighting modes that multiply the BRDF by the radiance and the cosine shade the lights of a hit 8 at a time
+		bool m_LightBatchesEnabled{ true };
+		bool UsesLightBatches() const { return m_LightBatchesEnabled && (m_CurrentLightingMode == LightingMode::Combined || IsPathTracing()); }
+
+		//Light sampling, path tracing, russian roulette and the points on area lights are random per frame and converge by accumulating frames
+		bool IsProgressive() const { return m_LightSamplingEnabled || m_MaxDepth > 0 || IsPathTracing() || m_HasAreaLights; }
+		//Shading every light of a hit without path tracing scales the light of the hit down to a maximum of one
+		bool ClampsHitLight() const { return !m_LightSamplingEnabled && !IsPathTracing(); }
 
 		bool m_F2Pressed{ false };
 		bool m_F3Pressed{ false };
+		bool m_F4Pressed{ false };
+		bool m_F5Pressed{ false };
+		bool m_F6Pressed{ false };
+		bool m_F7Pressed{ false };
+		bool m_F8Pressed{ false };
+		bool m_F9Pressed{ false };
+		bool m_F10Pressed{ false };
 
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pBuffer{};
 		uint32_t* m_pBufferPixels{};
 
+		std::future<void> m_ScreenshotJob{};
+		bool m_ScreenshotRequested{ false };
+		//Set by RenderAsync until the following Present has shown the surface
+		std::atomic<bool> m_IsPresentPending{ false };
+
+		//Linear color of every pixel as separate red, green and blue planes, packed into m_pBuffer once per frame
+		std::unique_ptr<float[]> m_pColorBuffer{};
+		//Sum of every sample of a pixel in the same layout while rendering progressively, m_pColorBuffer holds the average
+		std::unique_ptr<float[]> m_pAccumulationBuffer{};
+
 		int m_Width{};
 		int m_Height{};
+
+		//Dirty region tracking, only tiles touched by changed objects are traced again
+		const uint32_t m_TileSize{ 16 };
+		uint32_t m_TilesX{};
+		uint32_t m_TilesY{};
+		std::vector<Tile> m_Tiles{};
+		std::vector<uint32_t> m_TileOrder{};
+		std::vector<uint32_t> m_TilePixelOrder{};
+		std::vector<bool> m_IsTileDirty{};
+		std::vector<uint32_t> m_DirtyTileIndices{};
+
+		FrameStats m_FrameStats{};
+		std::atomic<uint64_t> m_BusyNanoseconds{};
+		std::atomic<uint32_t> m_SampleCount{};
+
+		bool m_FullRedraw{ true };
+		Vector3 m_PreviousCameraOrigin{};
+		Vector3 m_PreviousCameraForward{};
+		float m_PreviousFovAngle{};
 	};
 }
@@ -0,0 +1,200 @@
+#include "Sampler.h"
+#include "MathHelpers.h"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+namespace dae
+{
+	namespace
+	{
+#pragma region Sobol
+		//Direction numbers of the first two Sobol dimensions, van der Corput and the one of the polynomial x + 1
+		constexpr std::array<uint32_t, 32> MakeDirections(bool isFirstDimension)
+		{
+			std::array<uint32_t, 32> directions{};
+			uint32_t direction{ 1u << 31 };
+			for (uint32_t bit{ 0 }; bit < 32; ++bit)
+			{
+				directions[bit] = isFirstDimension ? 1u << (31 - bit) : direction;
+				direction ^= direction >> 1;
+			}
+			return directions;
+		}
+
+		constexpr std::array<uint32_t, 32> sobolDirections[2]{ MakeDirections(true), MakeDirections(false) };
+
+		uint32_t Sobol(uint32_t index, uint32_t dimension)
+		{
+			uint32_t value{ 0 };
+			for (uint32_t bit{ 0 }; index != 0; index >>= 1, ++bit)
+			{
+				if (index & 1)
+					value ^= sobolDirections[dimension][bit];
+			}
+			return value;
+		}
+
+		uint32_t ReverseBits(uint32_t a)
+		{
+			a = ((a >> 1) & 0x55555555) | ((a & 0x55555555) << 1);
+			a = ((a >> 2) & 0x33333333) | ((a & 0x33333333) << 2);
+			a = ((a >> 4) & 0x0F0F0F0F) | ((a & 0x0F0F0F0F) << 4);
+			a = ((a >> 8) & 0x00FF00FF) | ((a & 0x00FF00FF) << 8);
+			return (a >> 16) | (a << 16);
+		}
+
+		//Owen scrambling as a hash, every bit is flipped depending only on the bits above it (Laine-Karras, constants by Burley)
+		uint32_t NestedUniformScramble(uint32_t a, uint32_t seed)
+		{
+			a = ReverseBits(a);
+			a += seed;
+			a ^= a * 0x6c50b47cu;
+			a ^= a * 0xb82f1e52u;
+			a ^= a * 0xc7afe638u;
+			a ^= a * 0x8d22f6e6u;
+			return ReverseBits(a);
+		}
+
+		//The sample index is shuffled per dimension, which decorrelates the dimensions without needing more of them (padding)
+		uint32_t GetShuffledIndex(uint32_t sampleIndex, uint32_t dimension)
+		{
+			return NestedUniformScramble(sampleIndex, PcgHash(dimension));
+		}
+#pragma endregion
+
+#pragma region Blue Noise
+		constexpr uint32_t blueNoiseTileSize{ 64 };
+		constexpr uint32_t blueNoisePixelCount{ blueNoiseTileSize * blueNoiseTileSize };
+
+		//Rank of every pixel of a tiling blue-noise mask, made with void-and-cluster (Ulichney 1993)
+		std::vector<uint16_t> MakeBlueNoiseTile()
+		{
+			//Gaussian energy a set pixel adds around it, cut off where it no longer changes which pixel is picked
+			constexpr float sigma{ 1.5f };
+			constexpr int kernelRadius{ 6 };
+			float kernel[2 * kernelRadius + 1][2 * kernelRadius + 1]{};
+			for (int dy{ -kernelRadius }; dy <= kernelRadius; ++dy)
+			{
+				for (int dx{ -kernelRadius }; dx <= kernelRadius; ++dx)
+					kernel[dy + kernelRadius][dx + kernelRadius] = expf(-float(dx * dx + dy * dy) / (2.f * sigma * sigma));
+			}
+
+			std::vector<uint8_t> isSet(blueNoisePixelCount, 0);
+			std::vector<float> energy(blueNoisePixelCount, 0.f);
+			const auto toggle = [&](uint32_t pixel)
+				{
+					isSet[pixel] = !isSet[pixel];
+					const float sign = isSet[pixel] ? 1.f : -1.f;
+					const int px{ int(pixel % blueNoiseTileSize) }, py{ int(pixel / blueNoiseTileSize) };
+					for (int dy{ -kernelRadius }; dy <= kernelRadius; ++dy)
+					{
+						for (int dx{ -kernelRadius }; dx <= kernelRadius; ++dx)
+						{
+							//The tile wraps around, so it tiles without seams
+							const uint32_t x{ uint32_t(px + dx) & (blueNoiseTileSize - 1) }, y{ uint32_t(py + dy) & (blueNoiseTileSize - 1) };
+							energy[x + y * blueNoiseTileSize] += sign * kernel[dy + kernelRadius][dx + kernelRadius];
+						}
+					}
+				};
+			//The set pixel with the most energy around it, or the empty pixel with the least
+			const auto findExtreme = [&](bool tightestCluster)
+				{
+					uint32_t best{ 0 };
+					float bestEnergy{ tightestCluster ? -FLT_MAX : FLT_MAX };
+					for (uint32_t pixel{ 0 }; pixel < blueNoisePixelCount; ++pixel)
+					{
+						if (bool(isSet[pixel]) != tightestCluster)
+							continue;
+						if (tightestCluster ? energy[pixel] > bestEnergy : energy[pixel] < bestEnergy)
+						{
+							bestEnergy = energy[pixel];
+							best = pixel;
+						}
+					}
+					return best;
+				};
+
+			//Initial pattern of a tenth of the pixels, spread out by moving the tightest cluster into the largest void until stable
+			uint32_t setCount{ 0 };
+			for (uint32_t i{ 0 }; setCount < blueNoisePixelCount / 10; ++i)
+			{
+				const uint32_t pixel{ PcgHash(i) % blueNoisePixelCount };
+				if (!isSet[pixel])
+				{
+					toggle(pixel);
+					++setCount;
+				}
+			}
+
+			for (;;)
+			{
+				const uint32_t cluster = findExtreme(true);
+				toggle(cluster);
+				const uint32_t voidPixel = findExtreme(false);
+				toggle(voidPixel);
+				if (voidPixel == cluster)
+					break;
+			}
+
+			std::vector<uint16_t> ranks(blueNoisePixelCount);
+			const std::vector<uint8_t> initialPattern{ isSet };
+			const std::vector<float> initialEnergy{ energy };
+
+			//Ranks of the initial pixels, by removing the tightest cluster one at a time
+			for (uint32_t rank{ setCount }; rank-- > 0;)
+			{
+				const uint32_t cluster = findExtreme(true);
+				toggle(cluster);
+				ranks[cluster] = static_cast<uint16_t>(rank);
+			}
+
+			//Every other pixel by filling the largest void, with a gaussian energy this also covers the second half of the ranks
+			isSet = initialPattern;
+			energy = initialEnergy;
+			for (uint32_t rank{ setCount }; rank < blueNoisePixelCount; ++rank)
+			{
+				const uint32_t voidPixel = findExtreme(false);
+				toggle(voidPixel);
+				ranks[voidPixel] = static_cast<uint16_t>(rank);
+			}
+
+			return ranks;
+		}
+
+		//Blue-noise rotation of a pixel for a dimension, every dimension reads the tile at its own toroidal offset
+		uint32_t GetBlueNoise(uint32_t px, uint32_t py, uint32_t dimension)
+		{
+			//Built once on first use, afterwards it is only read
+			static const std::vector<uint16_t> tile{ MakeBlueNoiseTile() };
+
+			const uint32_t offset = PcgHash(dimension ^ 0x5bd1e995u);
+			const uint32_t x{ (px + offset) & (blueNoiseTileSize - 1) };
+			const uint32_t y{ (py + (offset >> 16)) & (blueNoiseTileSize - 1) };
+
+			//Rank in the upper bits, the rest of the rotation is filled in by a hash so it covers all of [0, 1)
+			return (uint32_t(tile[x + y * blueNoiseTileSize]) << 20) | (PcgHash(x + y * blueNoiseTileSize + offset) >> 12);
+		}
+#pragma endregion
+	}
+
+	float Sampler::Get1D(uint32_t px, uint32_t py, uint32_t sampleIndex, uint32_t dimension)
+	{
+		const uint32_t value = NestedUniformScramble(Sobol(GetShuffledIndex(sampleIndex, dimension), 0), PcgHash(dimension + 0x9e3779b9u));
+
+		//Cranley-Patterson rotation, wraps around in 32 bit fixed point
+		return ToUnitFloat(value + GetBlueNoise(px, py, dimension));
+	}
+
+	void Sampler::Get2D(uint32_t px, uint32_t py, uint32_t sampleIndex, uint32_t dimension, float& u1, float& u2)
+	{
+		const uint32_t index = GetShuffledIndex(sampleIndex, dimension);
+		const uint32_t value1 = NestedUniformScramble(Sobol(index, 0), PcgHash(dimension + 0x9e3779b9u));
+		const uint32_t value2 = NestedUniformScramble(Sobol(index, 1), PcgHash(dimension + 1 + 0x9e3779b9u));
+
+		u1 = ToUnitFloat(value1 + GetBlueNoise(px, py, dimension));
+		u2 = ToUnitFloat(value2 + GetBlueNoise(px, py, dimension + 1));
+	}
+}
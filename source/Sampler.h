@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+
+namespace dae
+{
+	//Low discrepancy random numbers without any state, a value only depends on the pixel, the sample number and the dimension
+	//so the workers share nothing and the image does not depend on which thread traced which tile
+	//Every dimension is an Owen scrambled Sobol sequence over the samples of a pixel (Burley 2020), the sequences of the pixels
+	//are rotated by a blue-noise tile so the error that is left is spread evenly over the screen
+	namespace Sampler
+	{
+		/**
+		 * \brief Value of one dimension of a sample
+		 * \param px Pixel column
+		 * \param py Pixel row
+		 * \param sampleIndex Index of the sample of the pixel
+		 * \param dimension Which random decision of the sample
+		 * \return Value in [0, 1)
+		 */
+		float Get1D(uint32_t px, uint32_t py, uint32_t sampleIndex, uint32_t dimension);
+
+		//Values of two dimensions (dimension and dimension + 1) that are stratified together, e.g. for a direction
+		void Get2D(uint32_t px, uint32_t py, uint32_t sampleIndex, uint32_t dimension, float& u1, float& u2);
+	}
+}
@@ -2,6 +2,8 @@
 #include "Utils.h"
 #include "Material.h"
 #include <algorithm>
+#include <execution>
+#include <random>
 namespace dae {
 
 #pragma region Base Scene
@@ -12,6 +14,8 @@ namespace dae {
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
+		m_SphereSetGeometries.reserve(32);
+		m_QuadSetGeometries.reserve(32);
 		m_Lights.reserve(32);
 		m_Triangles.reserve(32);
 	}
@@ -25,6 +29,15 @@ namespace dae {
 		}
 
 		m_Materials.clear();
+
+		//After the materials, which point to the textures
+		for (auto& pTexture : m_Textures)
+		{
+			delete pTexture;
+			pTexture = nullptr;
+		}
+
+		m_Textures.clear();
 	}
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
@@ -33,12 +46,26 @@ namespace dae {
 			GeometryUtils::HitTest_Sphere(s, ray, closestHit);
 		}
 
-		for (const Plane& p : m_PlaneGeometries) {
-			GeometryUtils::HitTest_Plane(p, ray, closestHit);
+		for (const SphereSet& s : m_SphereSetGeometries) {
+			GeometryUtils::HitTest_SphereSet(s, ray, closestHit);
 		}
 
-		for (const TriangleMesh& t : m_TriangleMeshGeometries) {
-			GeometryUtils::HitTest_TriangleMesh(t, ray, closestHit);
+		GeometryUtils::HitTest_PlaneSet(m_PlaneSet, ray, closestHit);
+
+		for (const QuadSet& q : m_QuadSetGeometries) {
+			GeometryUtils::HitTest_QuadSet(q, ray, closestHit);
+		}
+
+		for (uint32_t i{ 0 }; i < m_TriangleMeshGeometries.size(); ++i) {
+			const TriangleMesh& t = m_TriangleMeshGeometries[i];
+			const uint32_t level = ray.lodMeshIndex == i ? ray.lodMeshLevel : t.GetTracedLevel(ray);
+			if (level == TriangleMesh::missedLevel) {
+				continue;
+			}
+			if (GeometryUtils::HitTest_TriangleMesh(t.GetLOD(level), ray, closestHit)) {
+				closestHit.lodMeshIndex = static_cast<uint16_t>(i);
+				closestHit.lodMeshLevel = static_cast<uint16_t>(level);
+			}
 		}
 
 	}
@@ -51,20 +78,491 @@ namespace dae {
 				return true;
 			}
 		}
-		for (const Plane& p : m_PlaneGeometries)
+		for (const SphereSet& s : m_SphereSetGeometries)
 		{
-			if (GeometryUtils::TestIfRayHitPlane(p, ray)) {
+			if (GeometryUtils::HitTest_SphereSet(s, ray)) {
+				return true;
+			}
+		}
+		if (GeometryUtils::HitTest_PlaneSet(m_PlaneSet, ray)) {
+			return true;
+		}
+		for (const QuadSet& q : m_QuadSetGeometries)
+		{
+			if (GeometryUtils::HitTest_QuadSet(q, ray)) {
 				return true;
 			}
 		}
 
-		for (const TriangleMesh& t : m_TriangleMeshGeometries) {
-			return GeometryUtils::HitTest_TriangleMesh(t, ray);
+		for (uint32_t i{ 0 }; i < m_TriangleMeshGeometries.size(); ++i) {
+			const TriangleMesh& t = m_TriangleMeshGeometries[i];
+			const uint32_t level = ray.lodMeshIndex == i ? ray.lodMeshLevel : t.GetTracedLevel(ray);
+			if (level != TriangleMesh::missedLevel && GeometryUtils::HitTest_TriangleMesh(t.GetLOD(level), ray)) {
+				return true;
+			}
 		}
 
 		return false;
 	}
 
+	void Scene::DoesHit(const Ray* pRays, uint32_t rayCount, bool* pOccluded) const
+	{
+		for (uint32_t first{ 0 }; first < rayCount; first += RayPacket::size)
+		{
+			const Ray* pPacket = pRays + first;
+			const uint32_t count = std::min(RayPacket::size, rayCount - first);
+
+			//A ray leaves the packet as soon as anything occludes it
+			uint32_t activeMask = (1u << count) - 1;
+			const RayPacket packet = GeometryUtils::MakeRayPacket(pPacket, activeMask);
+
+			for (const Sphere& s : m_SphereGeometries)
+				activeMask &= ~GeometryUtils::HitTest_SpherePacket(s, packet, pPacket, activeMask);
+
+			for (const SphereSet& s : m_SphereSetGeometries)
+				activeMask &= ~GeometryUtils::HitTest_SphereSetPacket(s, packet, pPacket, activeMask);
+
+			if (activeMask)
+				activeMask &= ~GeometryUtils::HitTest_PlaneSetPacket(m_PlaneSet, packet, pPacket, activeMask);
+
+			for (const QuadSet& q : m_QuadSetGeometries)
+				activeMask &= ~GeometryUtils::HitTest_QuadSetPacket(q, packet, pPacket, activeMask);
+
+			//Lanes only trace another level of detail than the one of the frame where a mesh fades between two, for the mesh they
+			//leave or with a footprint
+			uint32_t firstLODMesh{ UINT16_MAX }, lastLODMesh{ 0 };
+			bool hasFootprints{ false };
+			for (uint32_t lane{ 0 }; lane < count; ++lane)
+			{
+				if (pPacket[lane].lodMeshIndex != UINT16_MAX)
+				{
+					firstLODMesh = std::min<uint32_t>(firstLODMesh, pPacket[lane].lodMeshIndex);
+					lastLODMesh = std::max<uint32_t>(lastLODMesh, pPacket[lane].lodMeshIndex);
+				}
+				hasFootprints |= pPacket[lane].footprintWidth > 0.f || pPacket[lane].footprintSpread > 0.f;
+			}
+
+			for (uint32_t i{ 0 }; i < m_TriangleMeshGeometries.size(); ++i)
+			{
+				const TriangleMesh& t = m_TriangleMeshGeometries[i];
+				if (t.lods.empty() || (t.lodBlend <= 0.f && !hasFootprints && (i < firstLODMesh || i > lastLODMesh)))
+				{
+					activeMask &= ~GeometryUtils::HitTest_TriangleMeshPacket(t.GetLOD(t.lodLevel), pPacket, activeMask);
+					continue;
+				}
+
+				//The lanes are split by the level they trace, one packet test per level
+				uint32_t levels[RayPacket::size]{};
+				bool isOneLevel{ true };
+				for (uint32_t lane{ 0 }; lane < count; ++lane)
+				{
+					levels[lane] = pPacket[lane].lodMeshIndex == i ? pPacket[lane].lodMeshLevel : t.GetTracedLevel(pPacket[lane]);
+					isOneLevel &= levels[lane] == levels[0];
+				}
+
+				if (isOneLevel)
+				{
+					if (levels[0] != TriangleMesh::missedLevel)
+						activeMask &= ~GeometryUtils::HitTest_TriangleMeshPacket(t.GetLOD(levels[0]), pPacket, activeMask);
+					continue;
+				}
+
+				uint32_t remainingMask = activeMask;
+				while (remainingMask)
+				{
+					const uint32_t level = levels[std::countr_zero(remainingMask)];
+					uint32_t levelMask{ 0 };
+					for (uint32_t lane{ 0 }; lane < count; ++lane)
+						levelMask |= uint32_t(levels[lane] == level) << lane;
+					levelMask &= remainingMask;
+
+					if (level != TriangleMesh::missedLevel)
+						activeMask &= ~GeometryUtils::HitTest_TriangleMeshPacket(t.GetLOD(level), pPacket, levelMask);
+					remainingMask &= ~levelMask;
+				}
+			}
+
+			for (uint32_t lane{ 0 }; lane < count; ++lane)
+				pOccluded[first + lane] = !(activeMask & (1u << lane));
+		}
+	}
+
+	void Scene::CommitFrame()
+	{
+		m_FrameCamera = m_Camera;
+
+		m_FrameFullRedraw = m_FullRedraw;
+		m_FullRedraw = false;
+
+		//Lights only change in frames that redraw everything (see m_FullRedraw), the others keep the light BVHs of the last build
+		if (m_FrameFullRedraw || m_LightInfluenceRadii.size() != m_Lights.size())
+			BuildLightBVH();
+
+		//Camera rays all start at the frame camera, their plane numerators are the same for every pixel
+		m_PlaneSet.Assign(m_PlaneGeometries);
+		m_PlaneSet.Precompute(m_FrameCamera.origin);
+
+		//Sphere and quad sets sort their primitives while building, so they are only built between frames and redraw everything
+		for (SphereSet& s : m_SphereSetGeometries)
+		{
+			if (!s.needsBvhBuild)
+				continue;
+
+			s.BuildBVH();
+			m_FrameFullRedraw = true;
+		}
+		for (QuadSet& q : m_QuadSetGeometries)
+		{
+			if (!q.needsBvhBuild)
+				continue;
+
+			q.BuildBVH();
+			m_FrameFullRedraw = true;
+		}
+
+		//Meshes edited without a call to UpdateBVHs (e.g. right after Initialize) still need their BVH before it is swapped in
+		UpdateBVHs();
+
+		m_DirtyBounds.clear();
+		m_HasLODTransitions = false;
+		m_HasMeshLODs = false;
+		for (TriangleMesh& m : m_TriangleMeshGeometries)
+		{
+			const AABB previousBounds{ m.transformedMinAABB, m.transformedMaxAABB };
+			const bool wasTraced = !m.transformedPositions.empty();
+
+			const bool moved = m.SwapTransforms();
+			//A mesh that switches to another level of detail changes in place
+			const bool switchedLOD = SelectMeshLOD(m);
+			m_HasLODTransitions |= m.lodBlend > 0.f;
+			m_HasMeshLODs |= m.lodFootprintScale > 0.f;
+
+			if (!moved && !switchedLOD)
+				continue;
+
+			//Both where the mesh was last drawn and where it is now need to be redrawn
+			if (wasTraced && moved)
+				m_DirtyBounds.push_back(previousBounds);
+			m_DirtyBounds.push_back({ m.transformedMinAABB, m.transformedMaxAABB });
+		}
+	}
+
+	bool Scene::SelectMeshLOD(TriangleMesh& mesh) const
+	{
+		if (mesh.lods.empty())
+			return false;
+
+		uint32_t level{ 0 };
+		float blend{ 0.f };
+		float footprintScale{ 0.f };
+		if (m_MeshLODMode != MeshLODMode::Off)
+		{
+			//The closest point of the bounds is where the error of the mesh looks largest, inside them the mesh is traced in full
+			const Vector3& origin = m_FrameCamera.origin;
+			const Vector3 closestPoint = Vector3::Max(mesh.transformedMinAABB, Vector3::Min(origin, mesh.transformedMaxAABB));
+			const float screenHeight = 2.f * (closestPoint - origin).Magnitude() * tanf(TO_RADIANS * m_FrameCamera.fovAngle / 2.f);
+
+			//The errors are in object space, the largest scale of the transform brings them into world space
+			const Matrix& transform = mesh.lastTransform;
+			const float scale = std::max({ transform.GetAxisX().Magnitude(), transform.GetAxisY().Magnitude(), transform.GetAxisZ().Magnitude() });
+			const float maxError = m_LODScreenError * screenHeight / scale;
+			footprintScale = m_LODFootprintsEnabled ? m_LODFootprintError / scale : 0.f;
+
+			while (level < mesh.lods.size() && mesh.lodErrors[level] <= maxError)
+				++level;
+
+			//The next level fades in while its error shrinks from twice the largest error to the largest error, so no frame
+			//shows a mesh pop from one level to the next
+			if (m_MeshLODMode == MeshLODMode::Stochastic && level < mesh.lods.size())
+				blend = std::clamp(2.f - mesh.lodErrors[level] / maxError, 0.f, 1.f);
+		}
+
+		const bool changed = level != mesh.lodLevel || blend != mesh.lodBlend || footprintScale != mesh.lodFootprintScale;
+		mesh.lodLevel = level;
+		mesh.lodBlend = blend;
+		mesh.lodFootprintScale = footprintScale;
+		return changed;
+	}
+
+	void Scene::CycleMeshLODMode()
+	{
+		switch (m_MeshLODMode) {
+		case MeshLODMode::Off:
+			m_MeshLODMode = MeshLODMode::Discrete;
+			break;
+		case MeshLODMode::Discrete:
+			m_MeshLODMode = MeshLODMode::Stochastic;
+			break;
+		case MeshLODMode::Stochastic:
+			m_MeshLODMode = MeshLODMode::Off;
+			break;
+		}
+
+		std::cout << "Mesh levels of detail: " << GetMeshLODModeName() << std::endl;
+	}
+
+	void Scene::ToggleLODFootprints()
+	{
+		m_LODFootprintsEnabled = !m_LODFootprintsEnabled;
+		std::cout << "Level of detail footprints: " << (m_LODFootprintsEnabled ? "on" : "off") << std::endl;
+	}
+
+	const char* Scene::GetMeshLODModeName() const
+	{
+		switch (m_MeshLODMode) {
+		case MeshLODMode::Off:
+			return "Off";
+		case MeshLODMode::Discrete:
+			return "Discrete";
+		case MeshLODMode::Stochastic:
+			return "Stochastic";
+		}
+
+		return "";
+	}
+
+	void Scene::BuildLightBVH()
+	{
+		m_LightInfluenceRadii.resize(m_Lights.size());
+		m_UnboundedLights.clear();
+		m_BoundedLights.clear();
+
+		std::vector<AABB> bounds{};
+		for (uint32_t i{ 0 }; i < m_Lights.size(); ++i)
+		{
+			const float radius = LightUtils::GetInfluenceRadius(m_Lights[i], m_LightCutoff);
+			m_LightInfluenceRadii[i] = radius;
+
+			if (radius == FLT_MAX)
+			{
+				m_UnboundedLights.push_back(i);
+				continue;
+			}
+
+			const Vector3 extent{ radius, radius, radius };
+			bounds.push_back({ m_Lights[i].origin - extent, m_Lights[i].origin + extent });
+			m_BoundedLights.push_back(i);
+		}
+
+		m_LightBvh.Build(bounds, {});
+
+		//The sampling BVH holds every point and area light that emits anything, regardless of the cutoff
+		std::vector<float> lightPower{};
+		bounds.clear();
+		m_SampledLights.clear();
+		for (uint32_t i{ 0 }; i < m_Lights.size(); ++i)
+		{
+			const Light& l = m_Lights[i];
+			const float power = l.intensity * std::max({ l.color.r, l.color.g, l.color.b });
+			if (l.type == LightType::Directional || power <= 0.f)
+				continue;
+
+			bounds.push_back(LightUtils::GetBounds(l));
+			lightPower.push_back(power);
+			m_SampledLights.push_back(i);
+		}
+
+		m_LightSamplingBvh.Build(bounds, {});
+
+		//Children are always stored after their parent, so walking the nodes backwards sums the power bottom up
+		const auto& nodes = m_LightSamplingBvh.nodes;
+		m_LightSamplingNodePower.assign(nodes.size(), 0.f);
+		for (size_t i{ nodes.size() }; i-- > 0;)
+		{
+			if (nodes[i].count == 0)
+			{
+				m_LightSamplingNodePower[i] = m_LightSamplingNodePower[nodes[i].leftFirst] + m_LightSamplingNodePower[nodes[i].leftFirst + 1];
+				continue;
+			}
+
+			for (uint32_t j{ nodes[i].leftFirst }; j < nodes[i].leftFirst + nodes[i].count; ++j)
+				m_LightSamplingNodePower[i] += lightPower[m_LightSamplingBvh.triangleIndices[j]];
+		}
+	}
+
+	void Scene::GetInfluencingLights(const Vector3& point, std::vector<uint32_t>& lightIndices) const
+	{
+		lightIndices.assign(m_UnboundedLights.begin(), m_UnboundedLights.end());
+
+		//The SAH builder limits the depth so the stack does not fill up, clustered lights in a deeper tree spill into the vector
+		uint32_t stack[64];
+		int stackSize{ 0 };
+		std::vector<uint32_t> overflow{};
+		const auto push = [&](uint32_t nodeIndex) {
+			if (stackSize < static_cast<int>(std::size(stack)))
+				stack[stackSize++] = nodeIndex;
+			else
+				overflow.push_back(nodeIndex);
+			};
+
+		if (!m_LightBvh.nodes.empty())
+			push(0);
+
+		while (stackSize > 0 || !overflow.empty())
+		{
+			uint32_t nodeIndex{};
+			if (!overflow.empty())
+			{
+				nodeIndex = overflow.back();
+				overflow.pop_back();
+			}
+			else
+				nodeIndex = stack[--stackSize];
+
+			const BVHNode& node = m_LightBvh.nodes[nodeIndex];
+			if (point.x < node.min.x || point.y < node.min.y || point.z < node.min.z ||
+				point.x > node.max.x || point.y > node.max.y || point.z > node.max.z)
+				continue;
+
+			if (node.count > 0)
+			{
+				for (uint32_t i{ node.leftFirst }; i < node.leftFirst + node.count; ++i)
+				{
+					const uint32_t light = m_BoundedLights[m_LightBvh.triangleIndices[i]];
+					if ((point - m_Lights[light].origin).SqrMagnitude() <= Square(m_LightInfluenceRadii[light]))
+						lightIndices.push_back(light);
+				}
+				continue;
+			}
+
+			push(node.leftFirst);
+			push(node.leftFirst + 1);
+		}
+
+		//Shading in light order keeps the sums the same as without culling
+		std::sort(lightIndices.begin(), lightIndices.end());
+	}
+
+	bool Scene::SampleLight(const Vector3& point, const Vector3& normal, float u, uint32_t& lightIndex, float& pdf) const
+	{
+		const auto& nodes = m_LightSamplingBvh.nodes;
+		if (nodes.empty())
+			return false;
+
+		const bool hasNormal = normal != Vector3{};
+
+		//Estimated contribution of the lights inside a box, power over squared distance times a bound on the cosine
+		//Both terms only ever overestimate, so every light that can shade the point keeps a non zero probability
+		const auto importance = [&](const Vector3& min, const Vector3& max, float power)
+			{
+				const Vector3 toCenter = (min + max) * 0.5f - point;
+				const float distanceSq = toCenter.SqrMagnitude();
+				const float radiusSq = (max - min).SqrMagnitude() * 0.25f;
+
+				float cosine = 1.f;
+				if (hasNormal && distanceSq > radiusSq)
+				{
+					//The smallest angle between the normal and a direction into the bounding sphere of the box
+					const float cosTheta = Vector3::Dot(normal, toCenter) / sqrtf(distanceSq);
+					const float sinBox = sqrtf(radiusSq / distanceSq);
+					const float cosBox = sqrtf(1.f - sinBox * sinBox);
+
+					if (cosTheta < cosBox)
+					{
+						const float sinTheta = sqrtf(std::max(1.f - cosTheta * cosTheta, 0.f));
+						cosine = std::max(cosTheta * cosBox + sinTheta * sinBox, 0.f);
+					}
+				}
+
+				return power * cosine / std::max({ distanceSq, radiusSq, FLT_EPSILON });
+			};
+
+		//u is reused at every level by rescaling it to the branch that was taken
+		const auto choose = [&u](float probability)
+			{
+				const bool first = u < probability;
+				u = first ? u / probability : (u - probability) / (1.f - probability);
+				u = std::min(u, 1.f - FLT_EPSILON);
+				return first;
+			};
+
+		pdf = 1.f;
+		uint32_t nodeIndex{ 0 };
+		while (nodes[nodeIndex].count == 0)
+		{
+			const uint32_t left{ nodes[nodeIndex].leftFirst };
+			const float leftImportance = importance(nodes[left].min, nodes[left].max, m_LightSamplingNodePower[left]);
+			const float rightImportance = importance(nodes[left + 1].min, nodes[left + 1].max, m_LightSamplingNodePower[left + 1]);
+
+			const float total = leftImportance + rightImportance;
+			if (total <= 0.f)
+				return false;
+
+			const float leftProbability = leftImportance / total;
+			if (choose(leftProbability))
+			{
+				pdf *= leftProbability;
+				nodeIndex = left;
+			}
+			else
+			{
+				pdf *= 1.f - leftProbability;
+				nodeIndex = left + 1;
+			}
+		}
+
+		//The lights of a leaf are weighted one by one, once for the total and again until the chosen one (leaves can be any size)
+		const BVHNode& leaf = nodes[nodeIndex];
+		const auto lightImportance = [&](uint32_t i)
+			{
+				const Light& l = m_Lights[m_SampledLights[m_LightSamplingBvh.triangleIndices[leaf.leftFirst + i]]];
+				const AABB lightBounds = LightUtils::GetBounds(l);
+				return importance(lightBounds.min, lightBounds.max, l.intensity * std::max({ l.color.r, l.color.g, l.color.b }));
+			};
+
+		float total{ 0.f };
+		for (uint32_t i{ 0 }; i < leaf.count; ++i)
+			total += lightImportance(i);
+
+		if (total <= 0.f)
+			return false;
+
+		uint32_t chosen{ 0 };
+		float chosenImportance{ 0.f };
+		float cumulative{ 0.f };
+		for (uint32_t i{ 0 }; i < leaf.count; ++i)
+		{
+			const float weight = lightImportance(i);
+			if (weight <= 0.f)
+				continue;
+
+			chosen = i;
+			chosenImportance = weight;
+			cumulative += weight;
+			if (u * total < cumulative)
+				break;
+		}
+
+		pdf *= chosenImportance / total;
+		lightIndex = m_SampledLights[m_LightSamplingBvh.triangleIndices[leaf.leftFirst + chosen]];
+		return true;
+	}
+
+	void Scene::UpdateBVHs()
+	{
+		std::for_each(std::execution::par, m_TriangleMeshGeometries.begin(), m_TriangleMeshGeometries.end(), [](TriangleMesh& m) {
+			m.UpdateBVH();
+			});
+	}
+
+	Scene::BVHStats Scene::RebuildBVHs(const BVHBuildSettings& settings)
+	{
+		BVHStats stats{};
+		for (TriangleMesh& m : m_TriangleMeshGeometries)
+		{
+			m.bvhSettings = settings;
+			m.BuildBVH();
+
+			stats.buildTimeMs += m.bvh.buildTimeMs;
+			stats.triangleCount += m.indices.size() / 3;
+			stats.referenceCount += m.bvh.triangleIndices.size();
+			stats.nodeCount += m.bvh.nodes.size() + m.bvh.quantizedNodes.size();
+			stats.memoryBytes += m.bvh.GetMemorySize();
+		}
+
+		return stats;
+	}
+
 #pragma region Scene Helpers
 	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
 	{
@@ -98,6 +596,18 @@ namespace dae {
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	SphereSet* Scene::AddSphereSet()
+	{
+		m_SphereSetGeometries.emplace_back();
+		return &m_SphereSetGeometries.back();
+	}
+
+	QuadSet* Scene::AddQuadSet()
+	{
+		m_QuadSetGeometries.emplace_back();
+		return &m_QuadSetGeometries.back();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -122,11 +632,45 @@ namespace dae {
 		return &m_Lights.back();
 	}
 
+	Light* Scene::AddRectangleLight(const Vector3& center, const Vector3& edge1, const Vector3& edge2, float intensity, const ColorRGB& color)
+	{
+		Light l;
+		l.origin = center;
+		l.edge1 = edge1;
+		l.edge2 = edge2;
+		l.direction = Vector3::Cross(edge1, edge2).Normalized();
+		l.intensity = intensity;
+		l.color = color;
+		l.type = LightType::Rectangle;
+
+		m_Lights.emplace_back(l);
+		return &m_Lights.back();
+	}
+
+	Light* Scene::AddSphereLight(const Vector3& center, float radius, float intensity, const ColorRGB& color)
+	{
+		Light l;
+		l.origin = center;
+		l.radius = radius;
+		l.intensity = intensity;
+		l.color = color;
+		l.type = LightType::Sphere;
+
+		m_Lights.emplace_back(l);
+		return &m_Lights.back();
+	}
+
 	unsigned char Scene::AddMaterial(Material* pMaterial)
 	{
 		m_Materials.push_back(pMaterial);
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
+
+	const Texture* Scene::AddTexture(const std::string& path)
+	{
+		m_Textures.push_back(new Texture(path, &m_TextureCache));
+		return m_Textures.back();
+	}
 #pragma endregion
 #pragma endregion
 
@@ -322,7 +866,6 @@ namespace dae {
 		const auto yawAngle = (cos(pTimer->GetTotal()) + 1.f) / 2.f * PI_2;
 		for (const auto m : m_Meshes) {
 			m->RotateY(yawAngle);
-			m->UpdateAABB();
 			m->UpdateTransforms();
 		}
 
@@ -358,8 +901,13 @@ namespace dae {
 		Utils::ParseOBJ("Resources/lowpoly_bunny.obj",
 			pMesh->positions,
 			pMesh->normals,
+			pMesh->vertexNormals,
 			pMesh->indices);
 
+		//Smooth shading, the low poly bunny has no normals of its own
+		if (!pMesh->HasVertexNormals())
+			pMesh->CalculateVertexNormals();
+
 		pMesh->Scale({ 2.f,2.f,2.f });
 		pMesh->RotateY(M_PI);
 		pMesh->UpdateAABB();
@@ -376,9 +924,339 @@ namespace dae {
 		const auto yawAngle = (cos(pTimer->GetTotal()) + 1.f) / 2.f * PI_2;
 
 		pMesh->RotateY(yawAngle);
+		pMesh->UpdateTransforms();
+
+	}
+
+	void Scene_ManyLights::Initialize()
+	{
+		sceneName = "Many Lights";
+		m_Camera.origin = { 0,3,-9 };
+		m_Camera.fovAngle = 45.f;
+
+		//Each light only reaches a few units, instead of the whole scene
+		m_LightCutoff = .01f;
+
+		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
+
+		AddSphere(Vector3{ -1.75f, 1.f, 2.f }, .75f, matCT_GraySmoothMetal);
+		AddSphere(Vector3{ 0.f, 1.f, 2.f }, .75f, matCT_GrayMediumPlastic);
+		AddSphere(Vector3{ 1.75f, 1.f, 2.f }, .75f, matCT_GraySmoothMetal);
+
+		std::mt19937 generator{ 7 };
+		std::uniform_real_distribution<float> channel{ .2f, 1.f };
+		for (int z{ 0 }; z < 20; ++z)
+		{
+			for (int x{ 0 }; x < 20; ++x)
+			{
+				const Vector3 origin{ -5.f + x * .5f, .4f, -2.f + z * .5f };
+				AddPointLight(origin, .4f, ColorRGB{ channel(generator), channel(generator), channel(generator) });
+			}
+		}
+	}
+
+	void Scene_SphereCloud::Initialize()
+	{
+		sceneName = "Sphere Cloud";
+		m_Camera.origin = { 0,3,-9 };
+		m_Camera.fovAngle = 45.f;
+
+		const unsigned char materials[]
+		{
+			AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .3f)),
+			AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .6f)),
+			AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f)),
+			AddMaterial(new Material_Lambert(colors::White, 1.f))
+		};
+		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
+
+		//Pedestal and backdrop, bounded by the quads
+		QuadSet* pQuads = AddQuadSet();
+		pQuads->AddQuad({ -3.f, .3f, -3.f }, { 0.f, 0.f, 6.f }, { 6.f, 0.f, 0.f }, materials[1]); //TOP
+		pQuads->AddQuad({ -3.f, .3f, 3.f }, { 0.f, 6.f, 0.f }, { 6.f, 0.f, 0.f }, materials[0]); //BACK
+		pQuads->AddQuad({ -3.f, 0.f, -3.f }, { 0.f, .3f, 0.f }, { 6.f, 0.f, 0.f }, materials[3]); //FRONT
+
+		//A million spheres, the linear builder keeps the load time down
+		SphereSet* pSpheres = AddSphereSet();
+		pSpheres->bvhSettings.mode = BVHBuildMode::Linear;
+
+		std::mt19937 generator{ 42 };
+		std::uniform_real_distribution<float> position{ -2.5f, 2.5f };
+		std::uniform_real_distribution<float> radius{ .01f, .04f };
+		for (int i{ 0 }; i < 1'000'000; ++i)
+		{
+			const Vector3 center{ position(generator), position(generator) + 3.f, position(generator) };
+			pSpheres->AddSphere(center, radius(generator), materials[i % std::size(materials)]);
+		}
+
+		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
+		AddPointLight(Vector3{ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f, .8f, .45f }); //Front Light Left
+		AddPointLight(Vector3{ 2.5f, 2.5f, -5.f }, 50.f, ColorRGB{ .34f, .47f, .68f });
+	}
+
+	void Scene_Glass::Initialize()
+	{
+		sceneName = "Glass";
+		m_Camera.origin = { 0,3,-9 };
+		m_Camera.fovAngle = 45.f;
+
+		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+		const auto matGlass_Clear = AddMaterial(new Material_Dielectric(colors::White, 1.5f));
+		const auto matGlass_Green = AddMaterial(new Material_Dielectric({ .6f, .9f, .7f }, 1.33f));
+		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_Red = AddMaterial(new Material_Lambert({ .8f, .2f, .2f }, 1.f));
+
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
+		AddPlane(Vector3{ 0.f, 10.f, 0.f }, Vector3{ 0.f, -1.f, 0.f }, matLambert_GrayBlue); //TOP
+		AddPlane(Vector3{ 5.f, 0.f, 0.f }, Vector3{ -1.f, 0.f, 0.f }, matLambert_Red); //RIGHT
+		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
+
+		AddSphere(Vector3{ -1.75f, 1.f, 0.f }, .75f, matCT_GraySmoothMetal);
+		AddSphere(Vector3{ 0.f, 1.f, 0.f }, .75f, matGlass_Clear);
+		AddSphere(Vector3{ 1.75f, 1.f, 0.f }, .75f, matCT_GraySmoothMetal);
+		AddSphere(Vector3{ -1.75f, 3.f, 0.f }, .75f, matGlass_Green);
+		AddSphere(Vector3{ 0.f, 3.f, 3.f }, .75f, matCT_GrayMediumPlastic);
+		AddSphere(Vector3{ 1.75f, 3.f, 0.f }, .75f, matGlass_Clear);
+
+		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
+		AddPointLight(Vector3{ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f, .8f, .45f }); //Front Light Left
+		AddPointLight(Vector3{ 2.5f, 2.5f, -5.f }, 50.f, ColorRGB{ .34f, .47f, .68f });
+	}
+
+	void Scene_AreaLights::Initialize()
+	{
+		sceneName = "Area Lights";
+		m_Camera.origin = { 0,3,-9 };
+		m_Camera.fovAngle = 45.f;
+
+		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .6f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, .6f));
+		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_White); //BOTTOM
+		AddPlane(Vector3{ 5.f, 0.f, 0.f }, Vector3{ -1.f, 0.f, 0.f }, matLambert_GrayBlue); //RIGHT
+		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
+
+		AddSphere(Vector3{ -1.75f, 1.f, 0.f }, .75f, matCT_GrayMediumPlastic);
+		AddSphere(Vector3{ 0.f, 1.f, 1.5f }, .75f, matCT_GrayMediumMetal);
+		AddSphere(Vector3{ 1.75f, 1.f, 0.f }, .75f, matCT_GrayMediumPlastic);
+		AddSphere(Vector3{ 0.f, 2.5f, -1.f }, .5f, matCT_GrayMediumPlastic);
+
+		//A panel above the spheres facing down and a round lamp to the front right, both cast soft shadows
+		AddRectangleLight(Vector3{ -1.f, 6.f, 0.f }, Vector3{ 3.f, 0.f, 0.f }, Vector3{ 0.f, 0.f, 2.f }, 100.f, ColorRGB{ 1.f, .9f, .8f });
+		AddSphereLight(Vector3{ 3.f, 3.5f, -3.f }, .6f, 25.f, ColorRGB{ .5f, .6f, 1.f });
+	}
+
+	void Scene_Textures::Initialize()
+	{
+		sceneName = "Textures";
+		m_Camera.origin = { 0,2,-9 };
+		m_Camera.fovAngle = 45.f;
+
+		//Two 4096x4096 textures, 170 MB of tiles with their mip levels, read through a cache of a tenth of that
+		m_TextureCache.SetBudget(size_t(16) << 20);
+		constexpr uint32_t textureSize{ 4096 };
+		constexpr uint32_t tileTexels{ 256 }, mortarTexels{ 8 };
+		const std::string albedoPath{ "Resources/tiles_albedo.dtex" };
+		const std::string roughnessMetalnessPath{ "Resources/tiles_roughness_metalness.dtex" };
+
+		//Tiles of a random color with fine speckles and a gold tile here and there, the speckles alias without the mip levels
+		const auto isMortar = [=](uint32_t x, uint32_t y) { return x % tileTexels < mortarTexels || y % tileTexels < mortarTexels; };
+		const auto getTileHash = [=](uint32_t x, uint32_t y) { return PcgHash(x / tileTexels + (y / tileTexels) * (textureSize / tileTexels)); };
+
+		if (!Texture(albedoPath, &m_TextureCache).IsValid())
+		{
+			std::cout << "Generating " << albedoPath << std::endl;
+			Texture::WriteTiled(albedoPath, textureSize, textureSize, [&](uint32_t x, uint32_t y)
+				{
+					if (isMortar(x, y))
+						return ColorRGB{ .35f, .33f, .3f };
+
+					const uint32_t hash = getTileHash(x, y);
+					const float speckle = .8f + .2f * ToUnitFloat(PcgHash(x + y * textureSize));
+					if (hash % 13 == 0)
+						return ColorRGB{ 1.f, .78f, .34f } * speckle;
+
+					const float shade = .5f + .5f * ToUnitFloat(hash);
+					return ColorRGB{ .8f * shade, .45f * shade, .3f * shade } * speckle;
+				});
+		}
+
+		if (!Texture(roughnessMetalnessPath, &m_TextureCache).IsValid())
+		{
+			std::cout << "Generating " << roughnessMetalnessPath << std::endl;
+			Texture::WriteTiled(roughnessMetalnessPath, textureSize, textureSize, [&](uint32_t x, uint32_t y)
+				{
+					if (isMortar(x, y))
+						return ColorRGB{ 0.f, .9f, 0.f };
+
+					const uint32_t hash = getTileHash(x, y);
+					const float roughness = .3f + .3f * ToUnitFloat(PcgHash(hash)) + .1f * ToUnitFloat(PcgHash(x + y * textureSize));
+					return ColorRGB{ 0.f, roughness, hash % 13 == 0 ? 1.f : 0.f };
+				});
+		}
+
+		const auto matTextured_Tiles = AddMaterial(new Material_TexturedCookTorrence(AddTexture(albedoPath), AddTexture(roughnessMetalnessPath)));
+		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f, .960f, .915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ .75f, .75f, .75f }, .0f, 1.f));
+
+		//A floor running to the horizon and a wall on the left
+		AddTexturedRectangle(Vector3{ -40.f, 0.f, -10.f }, Vector3{ 0.f, 0.f, 80.f }, Vector3{ 80.f, 0.f, 0.f }, 8.f, matTextured_Tiles);
+		AddTexturedRectangle(Vector3{ -4.f, 0.f, -10.f }, Vector3{ 0.f, 4.f, 0.f }, Vector3{ 0.f, 0.f, 80.f }, 8.f, matTextured_Tiles);
+
+		AddSphere(Vector3{ 0.f, 1.f, 0.f }, 1.f, matCT_GraySmoothMetal);
+		AddSphere(Vector3{ 2.5f, 1.f, 3.f }, 1.f, matCT_GrayRoughPlastic);
+
+		AddPointLight(Vector3{ 10.f, 30.f, 20.f }, 2000.f, ColorRGB{ 1.f, .95f, .85f });
+		AddPointLight(Vector3{ 0.f, 5.f, -5.f }, 50.f, ColorRGB{ 1.f, .8f, .45f });
+	}
+
+	void Scene_Textures::AddTexturedRectangle(const Vector3& corner, const Vector3& edge1, const Vector3& edge2, float textureSize, unsigned char materialIndex)
+	{
+		TriangleMesh* pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, materialIndex);
+		pMesh->positions = { corner, corner + edge1, corner + edge1 + edge2, corner + edge2 };
+
+		const float u = edge1.Magnitude() / textureSize, v = edge2.Magnitude() / textureSize;
+		pMesh->texCoords = { { 0.f, 0.f }, { u, 0.f }, { u, v }, { 0.f, v } };
+		pMesh->indices = { 0, 1, 2, 0, 2, 3 };
+		pMesh->CalculateNormals();
 		pMesh->UpdateAABB();
 		pMesh->UpdateTransforms();
+	}
+
+	void Scene_MeshLOD::Initialize()
+	{
+		sceneName = "Mesh LOD";
+		m_Camera.origin = { 0,3,-9 };
+		m_Camera.fovAngle = 45.f;
+
+		const auto matLambert_Rock = AddMaterial(new Material_Lambert({ .55f, .5f, .45f }, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.f));
+
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
+
+		//One rock of 20480 triangles is simplified once and copied, the rows are further apart the further away they are and the
+		//last ones only cover a few pixels each
+		TriangleMesh rock{};
+		GenerateRock(rock, 5);
+		rock.materialIndex = matLambert_Rock;
+		rock.GenerateLODs();
+
+		constexpr int columnCount{ 6 }, rowCount{ 10 };
+		m_TriangleMeshGeometries.reserve(columnCount * rowCount);
+
+		std::mt19937 generator{ 11 };
+		std::uniform_real_distribution<float> angle{ 0.f, PI_2 };
+		std::uniform_real_distribution<float> size{ .8f, 1.2f };
+		for (int row{ 0 }; row < rowCount; ++row)
+		{
+			for (int column{ 0 }; column < columnCount; ++column)
+			{
+				const float scale = size(generator);
+
+				TriangleMesh* pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_Rock);
+				*pMesh = rock;
+				pMesh->Scale({ scale, .7f * scale, scale });
+				pMesh->RotateY(angle(generator));
+				pMesh->Translate({ -10.f + column * 4.f, .5f * scale, 3.f * row * (row + 2) });
+				pMesh->UpdateTransforms();
+			}
+		}
+
+		AddPointLight(Vector3{ 10.f, 30.f, 20.f }, 2000.f, ColorRGB{ 1.f, .95f, .85f });
+		AddPointLight(Vector3{ 0.f, 5.f, -5.f }, 50.f, ColorRGB{ 1.f, .8f, .45f });
+	}
+
+	void Scene_MeshLOD::Update(Timer* pTimer)
+	{
+		Scene::Update(pTimer);
+
+		const uint8_t* pKeyboardState = SDL_GetKeyboardState(nullptr);
+		if (pKeyboardState[SDL_SCANCODE_F11])
+		{
+			m_F11Pressed = true;
+		}
+		else
+		{
+			if (m_F11Pressed) CycleMeshLODMode();
+			m_F11Pressed = false;
+		}
+
+		if (pKeyboardState[SDL_SCANCODE_F12])
+		{
+			m_F12Pressed = true;
+		}
+		else
+		{
+			if (m_F12Pressed) ToggleLODFootprints();
+			m_F12Pressed = false;
+		}
+	}
+
+	void Scene_MeshLOD::GenerateRock(TriangleMesh& mesh, uint32_t subdivisionCount)
+	{
+		const float t = (1.f + sqrtf(5.f)) / 2.f;
+		mesh.positions = {
+			{ -1.f, t, 0.f }, { 1.f, t, 0.f }, { -1.f, -t, 0.f }, { 1.f, -t, 0.f },
+			{ 0.f, -1.f, t }, { 0.f, 1.f, t }, { 0.f, -1.f, -t }, { 0.f, 1.f, -t },
+			{ t, 0.f, -1.f }, { t, 0.f, 1.f }, { -t, 0.f, -1.f }, { -t, 0.f, 1.f } };
+		//CW Winding Order!
+		mesh.indices = {
+			0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+			1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+			3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+			4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1 };
+
+		//Every edge is split once, the triangles on both sides of it share the vertex in its middle
+		for (uint32_t subdivision{ 0 }; subdivision < subdivisionCount; ++subdivision)
+		{
+			std::unordered_map<uint64_t, int> middles{};
+			const auto getMiddle = [&](int v0, int v1)
+				{
+					const uint64_t key = uint64_t(std::min(v0, v1)) << 32 | uint32_t(std::max(v0, v1));
+					const auto it = middles.find(key);
+					if (it != middles.end())
+						return it->second;
+
+					mesh.positions.push_back((mesh.positions[v0] + mesh.positions[v1]) / 2.f);
+					return middles[key] = static_cast<int>(mesh.positions.size() - 1);
+				};
+
+			std::vector<int> indices{};
+			indices.reserve(mesh.indices.size() * 4);
+			for (size_t i{ 0 }; i < mesh.indices.size(); i += 3)
+			{
+				const int v0{ mesh.indices[i] }, v1{ mesh.indices[i + 1] }, v2{ mesh.indices[i + 2] };
+				const int m01{ getMiddle(v0, v1) }, m12{ getMiddle(v1, v2) }, m20{ getMiddle(v2, v0) };
+				indices.insert(indices.end(), { v0, m01, m20, v1, m12, m01, v2, m20, m12, m01, m12, m20 });
+			}
+			mesh.indices.swap(indices);
+		}
+
+		for (Vector3& position : mesh.positions)
+		{
+			const Vector3 n = position.Normalized();
+			const float radius = 1.f + .15f * sinf(3.1f * n.x + 1.7f) * sinf(2.3f * n.y + .5f) * sinf(2.9f * n.z + 2.1f)
+				+ .06f * sinf(7.3f * n.x + 4.f * n.z) * sinf(6.1f * n.y + .3f) + .02f * sinf(17.f * n.y + 13.f * n.z) * sinf(19.f * n.x);
+			position = n * radius;
+		}
 
+		mesh.cullMode = TriangleCullMode::BackFaceCulling;
+		mesh.CalculateNormals();
+		mesh.CalculateVertexNormals();
+		mesh.UpdateAABB();
 	}
 
 #pragma endregion
@@ -5,6 +5,7 @@
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "Texture.h"
 
 namespace dae
 {
@@ -34,14 +35,70 @@ namespace dae
 		}
 
 		Camera& GetCamera() { return m_Camera; }
+
+		//Frame pipeline: Update prepares the next frame while the committed one is traced
+		void CommitFrame();
+
+		//Builds the BVHs of every mesh whose vertices changed concurrently, called after Update so they overlap tracing
+		void UpdateBVHs();
+		Camera& GetFrameCamera() { return m_FrameCamera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
 		bool DoesHit(const Ray& ray) const;
+		//DoesHit for a batch of rays, traced in packets of 8. Coherent batches (e.g. shadow rays of one tile towards one light) trace fastest
+		void DoesHit(const Ray* pRays, uint32_t rayCount, bool* pOccluded) const;
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Triangle>& GetTriangles() const { return m_Triangles; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const std::vector<Material*>& GetMaterials() const { return m_Materials; }
+		TextureCache& GetTextureCache() { return m_TextureCache; }
+		//Whether anything reads the pixel footprints of the hits (textures)
+		bool UsesRayFootprints() const { return !m_Textures.empty(); }
+
+		//Levels of detail of the meshes that have them, picked per mesh when a frame is committed from how large their error would
+		//look at the distance of the mesh. Stochastic fades the next coarser level in over a range of distances, ray by ray
+		enum class MeshLODMode
+		{
+			Off,
+			Discrete,
+			Stochastic
+		};
+		void CycleMeshLODMode();
+		const char* GetMeshLODModeName() const;
+		//Lets rays after a bounce trace coarser levels than the frame picked when their footprint is wide enough
+		void ToggleLODFootprints();
+		//Whether a mesh is between two levels this frame, the renderer only fills in Ray::lodSelector if so
+		bool UsesLODSelectors() const { return m_HasLODTransitions; }
+		//Whether a mesh has levels of detail this frame, the renderer only fills in the footprints of the rays (Ray::GetFootprint) if so
+		bool UsesLODFootprints() const { return m_HasMeshLODs; }
+
+		//Dirty region tracking, world bounds of what changed in the committed frame (old and new position)
+		const std::vector<AABB>& GetDirtyBounds() const { return m_DirtyBounds; }
+		bool IsFullRedraw() const { return m_FrameFullRedraw; }
+
+		//Light culling, the lights whose influence radius reaches point as indices into GetLights, in order
+		void GetInfluencingLights(const Vector3& point, std::vector<uint32_t>& lightIndices) const;
+		const std::vector<float>& GetLightInfluenceRadii() const { return m_LightInfluenceRadii; }
+
+		//Light sampling, picks one point or area light with a probability proportional to its estimated unoccluded contribution at point
+		//u is a uniform random number in [0, 1), returns false when no light can reach the front of the surface
+		//A zero normal also samples the lights behind the point
+		bool SampleLight(const Vector3& point, const Vector3& normal, float u, uint32_t& lightIndex, float& pdf) const;
+		//The lights that can not be sampled (directional lights), they are shaded for every hit
+		const std::vector<uint32_t>& GetUnsampledLights() const { return m_UnboundedLights; }
+
+		struct BVHStats
+		{
+			float buildTimeMs{};
+			size_t triangleCount{};
+			size_t referenceCount{};
+			size_t nodeCount{};
+			size_t memoryBytes{};
+		};
+
+		//Rebuilds the BVH of every mesh with the given settings, only called while the scene is not being traced
+		BVHStats RebuildBVHs(const BVHBuildSettings& settings);
 
 	protected:
 		std::string	sceneName;
@@ -49,19 +106,76 @@ namespace dae
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<SphereSet> m_SphereSetGeometries{};
+		std::vector<QuadSet> m_QuadSetGeometries{};
+
+		//The planes as they are traced, packed from m_PlaneGeometries when a frame is committed
+		PlaneSet m_PlaneSet{};
 		std::vector<Triangle> m_Triangles{};
 		std::vector<Light> m_Lights{};
 		std::vector<Material*> m_Materials{};
 
+		//Textures of the materials, their tiles are only read from the files through the cache
+		TextureCache m_TextureCache{};
+		std::vector<Texture*> m_Textures{};
+
 		Camera m_Camera{};
+		Camera m_FrameCamera{};
+
+		//Redraws every tile in the next committed frame, set until the first frame is drawn. Meshes are tracked through their bounds
+		//in CommitFrame and the camera by the renderer, a scene that moves spheres, planes or lights in Update has to set it itself.
+		//The light BVHs are only rebuilt in those frames
+		bool m_FullRedraw{ true };
+		bool m_FrameFullRedraw{ true };
+		std::vector<AABB> m_DirtyBounds{};
+
+		//Radiance below which a point light no longer shades a point, scenes with many weak lights can raise it
+		float m_LightCutoff{ 1.f / 255.f };
+
+		//Off by default, picking the levels has not yet measured faster than tracing every mesh in full
+		MeshLODMode m_MeshLODMode{ MeshLODMode::Off };
+		//Largest error of the traced level of a mesh as a part of the screen height at the distance of the mesh, a pixel at 480 lines
+		float m_LODScreenError{ 1.f / 480.f };
+		//Largest error of the level a ray traces as a part of its footprint where it enters the bounds of the mesh. The footprint of
+		//a camera ray is about the pixel m_LODScreenError allows, half of it keeps camera rays on the level picked for the frame
+		//and only lets rays whose footprint at least doubled after a bounce trace coarser levels
+		float m_LODFootprintError{ .5f };
+		//Off by default, following the footprints through every bounce costs more than the coarser levels save so far
+		bool m_LODFootprintsEnabled{ false };
+		bool m_HasLODTransitions{ false };
+		bool m_HasMeshLODs{ false };
+
+		//Influence radius per light and a BVH over the influence spheres of the point and area lights, built when a frame that
+		//redraws everything is committed
+		std::vector<float> m_LightInfluenceRadii{};
+		std::vector<uint32_t> m_UnboundedLights{};
+		std::vector<uint32_t> m_BoundedLights{};
+		BVH m_LightBvh{};
+
+		//BVH over the bounds of the point and area lights with the summed power of the lights below every node, used to sample them
+		BVH m_LightSamplingBvh{};
+		std::vector<float> m_LightSamplingNodePower{};
+		std::vector<uint32_t> m_SampledLights{};
 
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		SphereSet* AddSphereSet();
+		QuadSet* AddQuadSet();
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
+		//Area lights, intensity is that of a point light seen from straight in front of them (along the normal of a rectangle)
+		Light* AddRectangleLight(const Vector3& center, const Vector3& edge1, const Vector3& edge2, float intensity, const ColorRGB& color);
+		Light* AddSphereLight(const Vector3& center, float radius, float intensity, const ColorRGB& color);
 		unsigned char AddMaterial(Material* pMaterial);
+		//Opens a tiled texture file, a texture whose file can not be read samples as white
+		const Texture* AddTexture(const std::string& path);
+
+	private:
+		void BuildLightBVH();
+		//Picks the level of detail of a mesh for the frame camera, true if it changed
+		bool SelectMeshLOD(TriangleMesh& mesh) const;
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -148,6 +262,108 @@ namespace dae
 		TriangleMesh* pMesh{};
 	};
 
+	//400 weak point lights over a floor, only practical with light culling
+	class Scene_ManyLights final : public Scene
+	{
+	public:
+		Scene_ManyLights() = default;
+		~Scene_ManyLights() override = default;
+
+		Scene_ManyLights(const Scene_ManyLights&) = delete;
+		Scene_ManyLights(Scene_ManyLights&&) noexcept = delete;
+		Scene_ManyLights& operator=(const Scene_ManyLights&) = delete;
+		Scene_ManyLights& operator=(Scene_ManyLights&&) noexcept = delete;
+
+		void Initialize() override;
+	};
+
+	//A million small spheres in a cube, traced through a SphereSet, on a pedestal of quads
+	class Scene_SphereCloud final : public Scene
+	{
+	public:
+		Scene_SphereCloud() = default;
+		~Scene_SphereCloud() override = default;
+
+		Scene_SphereCloud(const Scene_SphereCloud&) = delete;
+		Scene_SphereCloud(Scene_SphereCloud&&) noexcept = delete;
+		Scene_SphereCloud& operator=(const Scene_SphereCloud&) = delete;
+		Scene_SphereCloud& operator=(Scene_SphereCloud&&) noexcept = delete;
+
+		void Initialize() override;
+	};
+
+	//Smooth metal and glass spheres, only shaded fully with reflections and refractions enabled
+	class Scene_Glass final : public Scene
+	{
+	public:
+		Scene_Glass() = default;
+		~Scene_Glass() override = default;
+
+		Scene_Glass(const Scene_Glass&) = delete;
+		Scene_Glass(Scene_Glass&&) noexcept = delete;
+		Scene_Glass& operator=(const Scene_Glass&) = delete;
+		Scene_Glass& operator=(Scene_Glass&&) noexcept = delete;
+
+		void Initialize() override;
+	};
+
+	//Spheres lit by a rectangle and a sphere light, shows soft shadows with shadows enabled
+	class Scene_AreaLights final : public Scene
+	{
+	public:
+		Scene_AreaLights() = default;
+		~Scene_AreaLights() override = default;
+
+		Scene_AreaLights(const Scene_AreaLights&) = delete;
+		Scene_AreaLights(Scene_AreaLights&&) noexcept = delete;
+		Scene_AreaLights& operator=(const Scene_AreaLights&) = delete;
+		Scene_AreaLights& operator=(Scene_AreaLights&&) noexcept = delete;
+
+		void Initialize() override;
+	};
+
+	//Floor and walls with large image textures that do not fit the texture cache, generated into Resources on the first run
+	class Scene_Textures final : public Scene
+	{
+	public:
+		Scene_Textures() = default;
+		~Scene_Textures() override = default;
+
+		Scene_Textures(const Scene_Textures&) = delete;
+		Scene_Textures(Scene_Textures&&) noexcept = delete;
+		Scene_Textures& operator=(const Scene_Textures&) = delete;
+		Scene_Textures& operator=(Scene_Textures&&) noexcept = delete;
+
+		void Initialize() override;
+
+	private:
+		//Rectangle of two triangles from corner along edge1 and edge2, the texture repeats every textureSize units along both
+		void AddTexturedRectangle(const Vector3& corner, const Vector3& edge1, const Vector3& edge2, float textureSize, unsigned char materialIndex);
+	};
+
+	//Rows of detailed rocks running into the distance, traced through their levels of detail. F11 cycles the level of detail mode
+	class Scene_MeshLOD final : public Scene
+	{
+	public:
+		Scene_MeshLOD() = default;
+		~Scene_MeshLOD() override = default;
+
+		Scene_MeshLOD(const Scene_MeshLOD&) = delete;
+		Scene_MeshLOD(Scene_MeshLOD&&) noexcept = delete;
+		Scene_MeshLOD& operator=(const Scene_MeshLOD&) = delete;
+		Scene_MeshLOD& operator=(Scene_MeshLOD&&) noexcept = delete;
+
+		void Initialize() override;
+		void Update(Timer*) override;
+
+	private:
+		bool m_F11Pressed{ false };
+		bool m_F12Pressed{ false };
+
+		//Unit sphere subdivided subdivisionCount times from an icosahedron, its radius displaced by a few waves
+		static void GenerateRock(TriangleMesh& mesh, uint32_t subdivisionCount);
+	};
+
 
 
 }
@@ -0,0 +1,361 @@
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Project includes
+#include "Texture.h"
+#include "MathHelpers.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace dae
+{
+	namespace
+	{
+		struct TextureFileHeader
+		{
+			char magic[4]{ 'D', 'T', 'E', 'X' };
+			uint32_t width{};
+			uint32_t height{};
+			uint32_t levelCount{};
+			uint32_t tileSize{ TextureTile::size };
+		};
+
+		//Every texture gets its own id, so the keys of the cache never mix up the tiles of two textures
+		std::atomic<uint32_t> nextTextureId{ 0 };
+
+		//Texture (16 bits), level (6 bits), tile row and tile column (21 bits each)
+		uint64_t GetTileKey(uint32_t textureId, uint32_t level, uint32_t tileX, uint32_t tileY)
+		{
+			return (uint64_t(textureId & 0xFFFF) << 48) | (uint64_t(level) << 42) | (uint64_t(tileY) << 21) | tileX;
+		}
+
+		uint32_t PackTexel(const ColorRGB& color)
+		{
+			const auto toByte = [](float value) { return static_cast<uint32_t>(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f); };
+			return toByte(color.r) | (toByte(color.g) << 8) | (toByte(color.b) << 16) | (255u << 24);
+		}
+
+		ColorRGB UnpackTexel(uint32_t texel)
+		{
+			constexpr float scale{ 1.f / 255.f };
+			return { float(texel & 0xFF) * scale, float((texel >> 8) & 0xFF) * scale, float((texel >> 16) & 0xFF) * scale };
+		}
+
+		ColorRGB LerpColor(const ColorRGB& a, const ColorRGB& b, float factor)
+		{
+			return { Lerpf(a.r, b.r, factor), Lerpf(a.g, b.g, factor), Lerpf(a.b, b.b, factor) };
+		}
+
+		//Per channel rounded average of 4 texels
+		uint32_t AverageTexels(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+		{
+			uint32_t result{ 0 };
+			for (uint32_t shift{ 0 }; shift < 32; shift += 8)
+			{
+				const uint32_t sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+				result |= ((sum + 2) / 4) << shift;
+			}
+			return result;
+		}
+	}
+
+#pragma region TextureCache
+	TextureCache::TextureCache(size_t budgetBytes) :
+		m_BudgetBytes(budgetBytes)
+	{
+	}
+
+	const TextureTile& TextureCache::GetTile(const Texture& texture, uint32_t level, uint32_t tileX, uint32_t tileY)
+	{
+		//Neighbouring texels of a lookup are nearly always in the tile of the previous lookup, a small direct mapped cache per thread
+		//answers those without a lock. It keeps its tiles alive, so an evicted tile stays valid for the thread still using it
+		struct RecentTile
+		{
+			uint64_t key{ UINT64_MAX };
+			std::shared_ptr<const TextureTile> pTile{};
+		};
+		thread_local RecentTile recentTiles[16]{};
+
+		const uint64_t key = GetTileKey(texture.GetId(), level, tileX, tileY);
+		RecentTile& recent = recentTiles[(tileX ^ (tileY << 1) ^ (level << 2)) & 15];
+		if (recent.key != key || !recent.pTile)
+		{
+			recent.pTile = FindOrLoad(texture, key, level, tileX, tileY);
+			recent.key = key;
+		}
+		return *recent.pTile;
+	}
+
+	std::shared_ptr<const TextureTile> TextureCache::FindOrLoad(const Texture& texture, uint64_t key, uint32_t level, uint32_t tileX, uint32_t tileY)
+	{
+		Shard& shard = m_Shards[(key ^ (key >> 21) ^ (key >> 48)) % m_ShardCount];
+		{
+			const std::lock_guard lock{ shard.mutex };
+			const auto it = shard.entries.find(key);
+			if (it != shard.entries.end())
+			{
+				shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruPosition);
+				++m_Hits;
+				return it->second.pTile;
+			}
+		}
+
+		//The file is read without holding the shard, other threads keep using the tiles that are resident
+		++m_Misses;
+		auto pTile = std::make_shared<TextureTile>();
+		texture.LoadTile(level, tileX, tileY, *pTile);
+
+		const std::lock_guard lock{ shard.mutex };
+		const auto [it, isInserted] = shard.entries.try_emplace(key);
+		if (!isInserted)
+		{
+			//Another thread loaded the same tile meanwhile
+			return it->second.pTile;
+		}
+
+		shard.lru.push_front(key);
+		it->second.pTile = std::move(pTile);
+		it->second.lruPosition = shard.lru.begin();
+		shard.residentBytes += sizeof(TextureTile);
+
+		std::shared_ptr<const TextureTile> pResult = it->second.pTile;
+		Evict(shard);
+		return pResult;
+	}
+
+	void TextureCache::Evict(Shard& shard)
+	{
+		//Every shard gets an equal part of the budget, the most recently used tile always stays
+		const size_t shardBudget = std::max(m_BudgetBytes / m_ShardCount, sizeof(TextureTile));
+		while (shard.residentBytes > shardBudget && shard.lru.size() > 1)
+		{
+			shard.entries.erase(shard.lru.back());
+			shard.lru.pop_back();
+			shard.residentBytes -= sizeof(TextureTile);
+			++m_Evictions;
+		}
+	}
+
+	void TextureCache::SetBudget(size_t budgetBytes)
+	{
+		m_BudgetBytes = budgetBytes;
+		for (Shard& shard : m_Shards)
+		{
+			const std::lock_guard lock{ shard.mutex };
+			Evict(shard);
+		}
+	}
+
+	TextureCache::Stats TextureCache::GetStats() const
+	{
+		Stats stats{ m_Hits, m_Misses, m_Evictions, 0 };
+		for (const Shard& shard : m_Shards)
+		{
+			const std::lock_guard lock{ shard.mutex };
+			stats.residentBytes += shard.residentBytes;
+		}
+		return stats;
+	}
+
+	void TextureCache::ResetStats()
+	{
+		m_Hits = 0;
+		m_Misses = 0;
+		m_Evictions = 0;
+	}
+#pragma endregion
+
+#pragma region Texture
+	Texture::Texture(const std::string& path, TextureCache* pCache) :
+		m_pCache(pCache),
+		m_Id(nextTextureId++),
+		m_File(path, std::ios::binary)
+	{
+		TextureFileHeader header{};
+		if (!m_File.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::string(header.magic, 4) != "DTEX" ||
+			header.tileSize != TextureTile::size || header.width == 0 || header.height == 0)
+			return;
+
+		m_Levels = GetLevels(header.width, header.height);
+		if (header.levelCount != m_Levels.size())
+			return;
+
+		m_Width = header.width;
+		m_Height = header.height;
+		m_LevelCount = header.levelCount;
+	}
+
+	std::vector<Texture::Level> Texture::GetLevels(uint32_t width, uint32_t height)
+	{
+		std::vector<Level> levels{};
+		uint64_t fileOffset{ sizeof(TextureFileHeader) };
+		while (true)
+		{
+			Level level{ width, height, (width + TextureTile::size - 1) / TextureTile::size, fileOffset };
+			levels.push_back(level);
+			fileOffset += uint64_t(level.tilesX) * ((height + TextureTile::size - 1) / TextureTile::size) * sizeof(TextureTile);
+
+			if (width == 1 && height == 1)
+				return levels;
+
+			width = std::max(width >> 1, 1u);
+			height = std::max(height >> 1, 1u);
+		}
+	}
+
+	bool Texture::WriteTiled(const std::string& path, uint32_t width, uint32_t height, const std::function<ColorRGB(uint32_t x, uint32_t y)>& texel)
+	{
+		if (width == 0 || height == 0 || std::max(width, height) > (TextureTile::size << 21))
+			return false;
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		const std::vector<Level> levels = GetLevels(width, height);
+		TextureFileHeader header{};
+		header.width = width;
+		header.height = height;
+		header.levelCount = static_cast<uint32_t>(levels.size());
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		//Per level the tiles of the row of tiles being filled and the even row waiting for the odd one to filter the next level
+		struct LevelRows
+		{
+			std::vector<TextureTile> tiles{};
+			std::vector<uint32_t> pendingRow{};
+		};
+		std::vector<LevelRows> levelRows(levels.size());
+		for (size_t i{ 0 }; i < levels.size(); ++i)
+			levelRows[i].tiles.resize(levels[i].tilesX);
+
+		//Adds row y of a level, writes the row of tiles once it is complete and filters the next level from every pair of rows
+		const std::function<void(uint32_t, uint32_t, const std::vector<uint32_t>&)> addRow =
+			[&](uint32_t levelIndex, uint32_t y, const std::vector<uint32_t>& row)
+			{
+				const Level& level = levels[levelIndex];
+				LevelRows& rows = levelRows[levelIndex];
+
+				for (uint32_t x{ 0 }; x < level.width; ++x)
+					rows.tiles[x / TextureTile::size].texels[(x % TextureTile::size) + (y % TextureTile::size) * TextureTile::size] = row[x];
+
+				if (y % TextureTile::size == TextureTile::size - 1 || y == level.height - 1)
+				{
+					const uint64_t tileRowOffset = level.fileOffset + uint64_t(y / TextureTile::size) * level.tilesX * sizeof(TextureTile);
+					file.seekp(static_cast<std::streamoff>(tileRowOffset));
+					file.write(reinterpret_cast<const char*>(rows.tiles.data()), rows.tiles.size() * sizeof(TextureTile));
+					std::fill(rows.tiles.begin(), rows.tiles.end(), TextureTile{});
+				}
+
+				if (levelIndex + 1 == levels.size())
+					return;
+
+				//Texel x, y of the next level averages the texels 2x, 2y to 2x + 1, 2y + 1, clamped to the edge of odd sized levels
+				const Level& nextLevel = levels[levelIndex + 1];
+				if (y / 2 >= nextLevel.height)
+					return;
+
+				const bool isEvenRow = y % 2 == 0;
+				if (isEvenRow)
+					rows.pendingRow = row;
+				if (isEvenRow && y + 1 < level.height)
+					return;
+
+				std::vector<uint32_t> nextRow(nextLevel.width);
+				for (uint32_t x{ 0 }; x < nextLevel.width; ++x)
+				{
+					const uint32_t x0 = x * 2, x1 = std::min(x * 2 + 1, level.width - 1);
+					nextRow[x] = AverageTexels(rows.pendingRow[x0], rows.pendingRow[x1], row[x0], row[x1]);
+				}
+				addRow(levelIndex + 1, y / 2, nextRow);
+			};
+
+		std::vector<uint32_t> row(width);
+		for (uint32_t y{ 0 }; y < height; ++y)
+		{
+			for (uint32_t x{ 0 }; x < width; ++x)
+				row[x] = PackTexel(texel(x, y));
+			addRow(0, y, row);
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	bool Texture::ConvertBMP(const std::string& bmpPath, const std::string& path)
+	{
+		SDL_Surface* pLoaded = SDL_LoadBMP(bmpPath.c_str());
+		if (!pLoaded)
+			return false;
+
+		SDL_Surface* pImage = SDL_ConvertSurfaceFormat(pLoaded, SDL_PIXELFORMAT_RGBA32, 0);
+		SDL_FreeSurface(pLoaded);
+		if (!pImage)
+			return false;
+
+		const auto* pPixels = static_cast<const uint8_t*>(pImage->pixels);
+		const bool isWritten = WriteTiled(path, pImage->w, pImage->h, [&](uint32_t x, uint32_t y)
+			{
+				const uint8_t* pTexel = pPixels + y * pImage->pitch + x * 4;
+				return ColorRGB{ pTexel[0] / 255.f, pTexel[1] / 255.f, pTexel[2] / 255.f };
+			});
+
+		SDL_FreeSurface(pImage);
+		return isWritten;
+	}
+
+	void Texture::LoadTile(uint32_t level, uint32_t tileX, uint32_t tileY, TextureTile& tile) const
+	{
+		const Level& mipLevel = m_Levels[level];
+		const uint64_t offset = mipLevel.fileOffset + (uint64_t(tileY) * mipLevel.tilesX + tileX) * sizeof(TextureTile);
+
+		const std::lock_guard lock{ m_FileMutex };
+		m_File.seekg(static_cast<std::streamoff>(offset));
+		m_File.read(reinterpret_cast<char*>(tile.texels), sizeof(tile.texels));
+	}
+
+	uint32_t Texture::GetTexel(uint32_t level, uint32_t x, uint32_t y) const
+	{
+		const TextureTile& tile = m_pCache->GetTile(*this, level, x / TextureTile::size, y / TextureTile::size);
+		return tile.texels[(x % TextureTile::size) + (y % TextureTile::size) * TextureTile::size];
+	}
+
+	ColorRGB Texture::SampleBilinear(uint32_t level, float u, float v) const
+	{
+		const Level& mipLevel = m_Levels[level];
+
+		//Texel centers are at half integers, the texture repeats
+		const float x = (u - floorf(u)) * mipLevel.width - 0.5f;
+		const float y = (v - floorf(v)) * mipLevel.height - 0.5f;
+		const float x0f = floorf(x), y0f = floorf(y);
+		const float fx = x - x0f, fy = y - y0f;
+
+		const auto wrap = [](int coordinate, uint32_t size) { return static_cast<uint32_t>(coordinate < 0 ? coordinate + int(size) : coordinate % int(size)); };
+		const uint32_t x0 = wrap(int(x0f), mipLevel.width), x1 = wrap(int(x0f) + 1, mipLevel.width);
+		const uint32_t y0 = wrap(int(y0f), mipLevel.height), y1 = wrap(int(y0f) + 1, mipLevel.height);
+
+		const ColorRGB top = LerpColor(UnpackTexel(GetTexel(level, x0, y0)), UnpackTexel(GetTexel(level, x1, y0)), fx);
+		const ColorRGB bottom = LerpColor(UnpackTexel(GetTexel(level, x0, y1)), UnpackTexel(GetTexel(level, x1, y1)), fx);
+		return LerpColor(top, bottom, fy);
+	}
+
+	ColorRGB Texture::Sample(float u, float v, float footprint) const
+	{
+		if (!IsValid() || !std::isfinite(u) || !std::isfinite(v))
+			return { 1.f, 1.f, 1.f };
+
+		//The level whose texels are as large as the footprint, blended with the next one
+		const float lod = std::clamp(log2f(std::max(footprint * float(std::max(m_Width, m_Height)), 1.f)), 0.f, float(m_LevelCount - 1));
+		const uint32_t level = static_cast<uint32_t>(lod);
+		const float blend = lod - float(level);
+
+		const ColorRGB color = SampleBilinear(level, u, v);
+		if (blend <= 0.f || level + 1 >= m_LevelCount)
+			return color;
+
+		return LerpColor(color, SampleBilinear(level + 1, u, v), blend);
+	}
+#pragma endregion
+}
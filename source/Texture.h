@@ -0,0 +1,147 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ColorRGB.h"
+
+namespace dae
+{
+	//Texels of one tile of a mip level, 8 bits per channel packed as RGBA (R in the lowest byte)
+	struct TextureTile
+	{
+		static constexpr uint32_t size{ 8 };
+		uint32_t texels[size * size]{};
+	};
+
+	class Texture;
+
+	//Bounded memory cache of the tiles of every texture of a scene, least recently used tiles are evicted once the budget is used
+	//Split in shards with a lock each so the workers rarely wait on each other, a tile is loaded from its file outside the lock
+	class TextureCache final
+	{
+	public:
+		explicit TextureCache(size_t budgetBytes = size_t(256) << 20);
+		~TextureCache() = default;
+
+		TextureCache(const TextureCache&) = delete;
+		TextureCache(TextureCache&&) noexcept = delete;
+		TextureCache& operator=(const TextureCache&) = delete;
+		TextureCache& operator=(TextureCache&&) noexcept = delete;
+
+		//Tile tileX, tileY of a mip level, loaded from the file of the texture on a miss. Valid until the next GetTile of the same thread
+		const TextureTile& GetTile(const Texture& texture, uint32_t level, uint32_t tileX, uint32_t tileY);
+
+		void SetBudget(size_t budgetBytes);
+		size_t GetBudget() const { return m_BudgetBytes; }
+
+		struct Stats
+		{
+			uint64_t hits{};
+			uint64_t misses{};
+			uint64_t evictions{};
+			size_t residentBytes{};
+		};
+		//Lookups answered by the per thread tile of the last lookup are not counted
+		Stats GetStats() const;
+		void ResetStats();
+
+	private:
+		static constexpr uint32_t m_ShardCount{ 16 };
+
+		struct Entry
+		{
+			std::shared_ptr<const TextureTile> pTile{};
+			std::list<uint64_t>::iterator lruPosition{};
+		};
+
+		struct Shard
+		{
+			//Mutable so GetStats can read residentBytes under it
+			mutable std::mutex mutex{};
+			std::unordered_map<uint64_t, Entry> entries{};
+			//Most recently used first
+			std::list<uint64_t> lru{};
+			size_t residentBytes{};
+		};
+
+		Shard m_Shards[m_ShardCount]{};
+		size_t m_BudgetBytes{};
+
+		std::atomic<uint64_t> m_Hits{};
+		std::atomic<uint64_t> m_Misses{};
+		std::atomic<uint64_t> m_Evictions{};
+
+		std::shared_ptr<const TextureTile> FindOrLoad(const Texture& texture, uint64_t key, uint32_t level, uint32_t tileX, uint32_t tileY);
+		void Evict(Shard& shard);
+	};
+
+	//Image texture stored in a tiled file with its whole mip pyramid. Only the tiles that are sampled are read, through a TextureCache
+	//File layout: a header, then the tiles of every level from the largest to 1x1, the tiles of a level row by row
+	class Texture final
+	{
+	public:
+		Texture(const std::string& path, TextureCache* pCache);
+		~Texture() = default;
+
+		Texture(const Texture&) = delete;
+		Texture(Texture&&) noexcept = delete;
+		Texture& operator=(const Texture&) = delete;
+		Texture& operator=(Texture&&) noexcept = delete;
+
+		//Writes a tiled texture file, texel is called row by row for the largest level and the smaller levels are box filtered
+		//while the rows stream in, so only a row of tiles of every level is in memory at once
+		static bool WriteTiled(const std::string& path, uint32_t width, uint32_t height, const std::function<ColorRGB(uint32_t x, uint32_t y)>& texel);
+		//Converts a BMP image into a tiled texture file
+		static bool ConvertBMP(const std::string& bmpPath, const std::string& path);
+
+		bool IsValid() const { return m_LevelCount > 0; }
+		uint32_t GetWidth() const { return m_Width; }
+		uint32_t GetHeight() const { return m_Height; }
+		uint32_t GetLevelCount() const { return m_LevelCount; }
+		uint32_t GetId() const { return m_Id; }
+
+		/**
+		 * \brief Trilinear filtered color, the texture repeats outside [0, 1]
+		 * \param u horizontal texture coordinate
+		 * \param v vertical texture coordinate, 0 is the top row
+		 * \param footprint size of the area to filter in texture coordinates, picks the mip level. Zero samples the largest level
+		 * \return color
+		 */
+		ColorRGB Sample(float u, float v, float footprint) const;
+
+		//Reads a tile from the file, called by the cache on a miss
+		void LoadTile(uint32_t level, uint32_t tileX, uint32_t tileY, TextureTile& tile) const;
+
+	private:
+		struct Level
+		{
+			uint32_t width{};
+			uint32_t height{};
+			uint32_t tilesX{};
+			uint64_t fileOffset{};
+		};
+
+		TextureCache* m_pCache{};
+		uint32_t m_Id{};
+		uint32_t m_Width{};
+		uint32_t m_Height{};
+		uint32_t m_LevelCount{};
+		std::vector<Level> m_Levels{};
+
+		mutable std::ifstream m_File{};
+		mutable std::mutex m_FileMutex{};
+
+		ColorRGB SampleBilinear(uint32_t level, float u, float v) const;
+		uint32_t GetTexel(uint32_t level, uint32_t x, uint32_t y) const;
+
+		static std::vector<Level> GetLevels(uint32_t width, uint32_t height);
+	};
+}
@@ -1,11 +1,16 @@
 #pragma once
+#include <bit>
 #include <cassert>
 #include <fstream>
 #include "Math.h"
 #include "DataTypes.h"
+#include "BRDFs.h"
 #include <math.h>
+#include <immintrin.h>
 
 #include <iostream>
+#include <string>
+#include <unordered_map>
 namespace dae
 {
 	namespace GeometryUtils
@@ -43,6 +48,7 @@ namespace dae
 				hitRecord.didHit = true;
 				hitRecord.origin = ray.origin + ray.direction * t0;
 				hitRecord.normal = (hitRecord.origin - sphere.origin).Normalized();
+				hitRecord.curvature = 1.f / sphere.radius;
 				return true;
 			}
 
@@ -84,6 +90,7 @@ namespace dae
 				hitRecord.didHit = true;
 				hitRecord.origin = ray.origin + ray.direction * t0;
 				hitRecord.normal = (hitRecord.origin - sphere.origin).Normalized();
+				hitRecord.curvature = 1.f / sphere.radius;
 				return true;
 			}
 
@@ -171,6 +178,7 @@ namespace dae
 					hitRecord.materialIndex = plane.materialIndex;
 					hitRecord.origin = ray.origin + ray.direction * t;
 					hitRecord.normal = plane.normal;
+					hitRecord.curvature = 0.f;
 
 					return true;
 				}
@@ -185,6 +193,131 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_Plane(plane, ray, temp, true);
 		}
+
+		//All planes of the set 8 at a time without branching per plane, same results as HitTest_Plane and TestIfRayHitPlane
+		//over the planes in order. ignoreHitRecord returns whether any plane is hit within the ray
+		inline bool HitTest_PlaneSet(const PlaneSet& planeSet, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			const uint32_t count = static_cast<uint32_t>(planeSet.Size());
+			const bool isPrecomputed = ray.origin == planeSet.precomputedOrigin && planeSet.precomputedNumerators.size() == count;
+
+			float tClosest = hitRecord.t;
+			int hitPlane{ -1 };
+
+#if defined(__AVX2__)
+			const __m256 rayOriginX = _mm256_set1_ps(ray.origin.x), rayOriginY = _mm256_set1_ps(ray.origin.y), rayOriginZ = _mm256_set1_ps(ray.origin.z);
+			const __m256 directionX = _mm256_set1_ps(ray.direction.x), directionY = _mm256_set1_ps(ray.direction.y), directionZ = _mm256_set1_ps(ray.direction.z);
+			const __m256 rayMin = _mm256_set1_ps(ray.min), rayMax = _mm256_set1_ps(ray.max);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+			//Closest t and plane per lane, reduced once after all batches
+			__m256 bestT = _mm256_set1_ps(tClosest);
+			__m256i bestPlane = _mm256_set1_epi32(-1);
+
+			for (uint32_t batch{ 0 }; batch < count; batch += 8)
+			{
+				const __m256i loadMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - batch)), lanes);
+				const __m256 normalX = _mm256_maskload_ps(planeSet.normals.x.data() + batch, loadMask);
+				const __m256 normalY = _mm256_maskload_ps(planeSet.normals.y.data() + batch, loadMask);
+				const __m256 normalZ = _mm256_maskload_ps(planeSet.normals.z.data() + batch, loadMask);
+
+				__m256 numerator{};
+				if (isPrecomputed)
+				{
+					numerator = _mm256_maskload_ps(planeSet.precomputedNumerators.data() + batch, loadMask);
+				}
+				else
+				{
+					const __m256 toPlaneX = _mm256_sub_ps(_mm256_maskload_ps(planeSet.origins.x.data() + batch, loadMask), rayOriginX);
+					const __m256 toPlaneY = _mm256_sub_ps(_mm256_maskload_ps(planeSet.origins.y.data() + batch, loadMask), rayOriginY);
+					const __m256 toPlaneZ = _mm256_sub_ps(_mm256_maskload_ps(planeSet.origins.z.data() + batch, loadMask), rayOriginZ);
+					numerator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toPlaneX, normalX), _mm256_mul_ps(toPlaneY, normalY)), _mm256_mul_ps(toPlaneZ, normalZ));
+				}
+
+				const __m256 denominator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, normalX), _mm256_mul_ps(directionY, normalY)), _mm256_mul_ps(directionZ, normalZ));
+				const __m256 t = _mm256_div_ps(numerator, denominator);
+
+				__m256 isHit = _mm256_and_ps(_mm256_castsi256_ps(loadMask), _mm256_cmp_ps(denominator, zero, _CMP_NEQ_OQ));
+				if (ignoreHitRecord)
+				{
+					isHit = _mm256_and_ps(isHit, _mm256_and_ps(_mm256_cmp_ps(t, rayMin, _CMP_GE_OQ), _mm256_cmp_ps(t, rayMax, _CMP_LE_OQ)));
+					if (_mm256_movemask_ps(isHit) != 0)
+						return true;
+					continue;
+				}
+
+				isHit = _mm256_and_ps(isHit, _mm256_and_ps(_mm256_cmp_ps(t, rayMin, _CMP_GT_OQ), _mm256_cmp_ps(t, rayMax, _CMP_LT_OQ)));
+				isHit = _mm256_and_ps(isHit, _mm256_cmp_ps(t, bestT, _CMP_LT_OQ));
+
+				bestT = _mm256_blendv_ps(bestT, t, isHit);
+				bestPlane = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestPlane),
+					_mm256_castsi256_ps(_mm256_add_epi32(lanes, _mm256_set1_epi32(static_cast<int>(batch)))), isHit));
+			}
+
+			if (ignoreHitRecord)
+				return false;
+
+			//Lowest plane index on ties, like testing the planes in order
+			float laneT[8];
+			int lanePlane[8];
+			_mm256_storeu_ps(laneT, bestT);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanePlane), bestPlane);
+			for (int lane{ 0 }; lane < 8; ++lane)
+			{
+				if (lanePlane[lane] >= 0 && (laneT[lane] < tClosest || (laneT[lane] == tClosest && lanePlane[lane] < hitPlane)))
+				{
+					tClosest = laneT[lane];
+					hitPlane = lanePlane[lane];
+				}
+			}
+#else
+			for (uint32_t plane{ 0 }; plane < count; ++plane)
+			{
+				const Vector3 normal{ planeSet.normals.x[plane], planeSet.normals.y[plane], planeSet.normals.z[plane] };
+				const float denominator = Vector3::Dot(ray.direction, normal);
+				if (denominator == 0)
+					continue;
+
+				const float numerator = isPrecomputed ? planeSet.precomputedNumerators[plane] :
+					Vector3::Dot(Vector3{ planeSet.origins.x[plane], planeSet.origins.y[plane], planeSet.origins.z[plane] } - ray.origin, normal);
+				const float t = numerator / denominator;
+
+				if (ignoreHitRecord)
+				{
+					if (t >= ray.min && t <= ray.max)
+						return true;
+					continue;
+				}
+
+				if (t > ray.min && t < ray.max && t < tClosest)
+				{
+					tClosest = t;
+					hitPlane = static_cast<int>(plane);
+				}
+			}
+
+			if (ignoreHitRecord)
+				return false;
+#endif
+
+			if (hitPlane < 0)
+				return false;
+
+			hitRecord.t = tClosest;
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = planeSet.materialIndices[hitPlane];
+			hitRecord.origin = ray.origin + ray.direction * tClosest;
+			hitRecord.normal = { planeSet.normals.x[hitPlane], planeSet.normals.y[hitPlane], planeSet.normals.z[hitPlane] };
+			hitRecord.curvature = 0.f;
+			return true;
+		}
+
+		inline bool HitTest_PlaneSet(const PlaneSet& planeSet, const Ray& ray)
+		{
+			HitRecord temp{};
+			return HitTest_PlaneSet(planeSet, ray, temp, true);
+		}
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
@@ -228,19 +361,26 @@ namespace dae
 			Vector3 CrossC = Vector3::Cross(EdgeC, C2);
 
 			// Perform the same-side test to determine if P is inside the triangle
-			if ((Vector3::Dot(triangle.normal, CrossA) < 0) ||
-				(Vector3::Dot(triangle.normal, CrossB) < 0) ||
-				(Vector3::Dot(triangle.normal, CrossC) < 0)) {
+			const float areaV0 = Vector3::Dot(triangle.normal, CrossB);
+			const float areaV1 = Vector3::Dot(triangle.normal, CrossC);
+			const float areaV2 = Vector3::Dot(triangle.normal, CrossA);
+			if (areaV0 < 0 || areaV1 < 0 || areaV2 < 0) {
 				return false;
 			}
 
 			// At this point, the ray intersects the triangle
 			// If ignoreHitRecord is true, no need to record the hit
 			if (!ignoreHitRecord) {
+				// The sub-triangle areas opposite each vertex are its barycentric weights
+				const float invArea = 1.f / (areaV0 + areaV1 + areaV2);
+
 				hitRecord.didHit = true;
 				hitRecord.normal = triangle.normal;
+				hitRecord.curvature = 0.f;
 				hitRecord.origin = P;
 				hitRecord.t = t;
+				hitRecord.u = areaV1 * invArea;
+				hitRecord.v = areaV2 * invArea;
 				hitRecord.materialIndex = triangle.materialIndex;
 			}
 
@@ -279,30 +419,292 @@ namespace dae
 		}
 
 		
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Slab test of a BVH node against an object space ray, tEntry is where the ray enters the node
+		inline bool SlabTest_BVHNode(const BVHNode& node, const Vector3& origin, const Vector3& invDirection, float tMax, float& tEntry) {
+			const float tx1 = (node.min.x - origin.x) * invDirection.x;
+			const float tx2 = (node.max.x - origin.x) * invDirection.x;
+			float tmin = std::min(tx1, tx2);
+			float tmax = std::max(tx1, tx2);
+
+			const float ty1 = (node.min.y - origin.y) * invDirection.y;
+			const float ty2 = (node.max.y - origin.y) * invDirection.y;
+			tmin = std::max(tmin, std::min(ty1, ty2));
+			tmax = std::min(tmax, std::max(ty1, ty2));
+
+			const float tz1 = (node.min.z - origin.z) * invDirection.z;
+			const float tz2 = (node.max.z - origin.z) * invDirection.z;
+			tmin = std::max(tmin, std::min(tz1, tz2));
+			tmax = std::min(tmax, std::max(tz1, tz2));
+
+			tEntry = tmin;
+			return tmax >= 0 && tmax >= tmin && tmin <= tMax;
+		}
+
+		//A single triangle of the mesh, in world space
+		inline Triangle GetMeshTriangle(const TriangleMesh& mesh, uint32_t triangleIndex)
 		{
-			if (!SlabTest_TriangleMesh(mesh, ray)) {
-				return false;
+			Triangle t{};
+			t.v0 = mesh.transformedPositions[mesh.indices[triangleIndex * 3]];
+			t.v1 = mesh.transformedPositions[mesh.indices[triangleIndex * 3 + 1]];
+			t.v2 = mesh.transformedPositions[mesh.indices[triangleIndex * 3 + 2]];
+			t.normal = mesh.transformedNormals[triangleIndex].Normalized();
+			t.cullMode = mesh.cullMode;
+			t.materialIndex = mesh.materialIndex;
+			return t;
+		}
+
+		//Tests a single triangle of the mesh, in world space
+		inline bool HitTest_MeshTriangle(const TriangleMesh& mesh, uint32_t triangleIndex, const Ray& ray, HitRecord& hitRecord)
+		{
+			return HitTest_Triangle(GetMeshTriangle(mesh, triangleIndex), ray, hitRecord);
+		}
+
+		//Closest (or with ignoreHitRecord any) hit of the float BVH, returns the triangle that was hit or -1
+		inline int Traverse_BVH(const TriangleMesh& mesh, const Ray& ray, const Vector3& origin, const Vector3& invDirection, HitRecord& hitRecord, bool ignoreHitRecord)
+		{
+			struct StackEntry
+			{
+				uint32_t nodeIndex;
+				float tEntry;
+			};
+			StackEntry stack[64];
+			int stackSize{ 0 };
+
+			int hitTriangle{ -1 };
+
+			float tEntry{};
+			if (SlabTest_BVHNode(mesh.bvh.nodes[0], origin, invDirection, std::min(hitRecord.t, ray.max), tEntry))
+				stack[stackSize++] = { 0, tEntry };
+
+			while (stackSize > 0) {
+				const StackEntry entry = stack[--stackSize];
+
+				// A closer hit was found after this node was pushed
+				if (entry.tEntry > hitRecord.t) {
+					continue;
+				}
+
+				const BVHNode& node = mesh.bvh.nodes[entry.nodeIndex];
+				if (node.count > 0) {
+					for (uint32_t i{ node.leftFirst }; i < node.leftFirst + node.count; ++i) {
+						const uint32_t triangle = mesh.bvh.triangleIndices[i];
+						if (HitTest_MeshTriangle(mesh, triangle, ray, hitRecord)) {
+							hitTriangle = static_cast<int>(triangle);
+
+							if (ignoreHitRecord) {
+								return hitTriangle;
+							}
+						}
+					}
+					continue;
+				}
+
+				// Visit the nearest child first by pushing it last
+				const float tMax = std::min(hitRecord.t, ray.max);
+				float tLeft{}, tRight{};
+				const bool hitLeft = SlabTest_BVHNode(mesh.bvh.nodes[node.leftFirst], origin, invDirection, tMax, tLeft);
+				const bool hitRight = SlabTest_BVHNode(mesh.bvh.nodes[node.leftFirst + 1], origin, invDirection, tMax, tRight);
+
+				if (hitLeft && hitRight) {
+					if (tLeft <= tRight) {
+						stack[stackSize++] = { node.leftFirst + 1, tRight };
+						stack[stackSize++] = { node.leftFirst, tLeft };
+					}
+					else {
+						stack[stackSize++] = { node.leftFirst, tLeft };
+						stack[stackSize++] = { node.leftFirst + 1, tRight };
+					}
+				}
+				else if (hitLeft) {
+					stack[stackSize++] = { node.leftFirst, tLeft };
+				}
+				else if (hitRight) {
+					stack[stackSize++] = { node.leftFirst + 1, tRight };
+				}
 			}
 
-			Triangle t{};
-			bool hitOccurred = false;
-			
-			for (int i{ 0 }; i < mesh.indices.size() / 3; ++i) {
-				if (hitOccurred && ignoreHitRecord) {
-					break;
+			return hitTriangle;
+		}
+
+		//Slab test of one child of a quantized node, the 8 bit bounds are decoded with the power of two scales of the node
+		inline bool SlabTest_QuantizedChild(const QuantizedBVHNode& node, int child, const Vector3& scale, const Vector3& origin, const Vector3& invDirection, float tMax, float& tEntry) {
+			const Vector3 min{
+				node.origin.x + node.childMin[child][0] * scale.x,
+				node.origin.y + node.childMin[child][1] * scale.y,
+				node.origin.z + node.childMin[child][2] * scale.z };
+			const Vector3 max{
+				node.origin.x + node.childMax[child][0] * scale.x,
+				node.origin.y + node.childMax[child][1] * scale.y,
+				node.origin.z + node.childMax[child][2] * scale.z };
+
+			return SlabTest_BVHNode(BVHNode{ min, 0, max, 0 }, origin, invDirection, tMax, tEntry);
+		}
+
+		//Same as Traverse_BVH for a BVH of QuantizedBVHNodes
+		inline int Traverse_QuantizedBVH(const TriangleMesh& mesh, const Ray& ray, const Vector3& origin, const Vector3& invDirection, HitRecord& hitRecord, bool ignoreHitRecord)
+		{
+			// Count 0 is an inner node, otherwise index is the first triangle reference of a leaf
+			struct StackEntry
+			{
+				uint32_t index;
+				uint32_t count;
+				float tEntry;
+			};
+			StackEntry stack[64];
+			int stackSize{ 0 };
+
+			int hitTriangle{ -1 };
+
+			const AABB& rootBounds = mesh.bvh.quantizedRootBounds;
+			float tEntry{};
+			if (SlabTest_BVHNode(BVHNode{ rootBounds.min, 0, rootBounds.max, 0 }, origin, invDirection, std::min(hitRecord.t, ray.max), tEntry))
+				stack[stackSize++] = { 0, 0, tEntry };
+
+			while (stackSize > 0) {
+				const StackEntry entry = stack[--stackSize];
+
+				// A closer hit was found after this node was pushed
+				if (entry.tEntry > hitRecord.t) {
+					continue;
 				}
-				t.v0 = mesh.transformedPositions[mesh.indices[i * 3]];
-				t.v1 = mesh.transformedPositions[mesh.indices[i * 3 + 1]];
-				t.v2 = mesh.transformedPositions[mesh.indices[i * 3 + 2]];
-				t.normal = mesh.transformedNormals[i].Normalized();
-				t.cullMode = mesh.cullMode;
-				t.materialIndex = mesh.materialIndex;
 
-				if (HitTest_Triangle(t, ray, hitRecord)) {
-					hitOccurred = true;
+				if (entry.count > 0) {
+					for (uint32_t i{ entry.index }; i < entry.index + entry.count; ++i) {
+						const uint32_t triangle = mesh.bvh.triangleIndices[i];
+						if (HitTest_MeshTriangle(mesh, triangle, ray, hitRecord)) {
+							hitTriangle = static_cast<int>(triangle);
+
+							if (ignoreHitRecord) {
+								return hitTriangle;
+							}
+						}
+					}
+					continue;
+				}
+
+				const QuantizedBVHNode& node = mesh.bvh.quantizedNodes[entry.index];
+				const Vector3 scale{
+					std::bit_cast<float>(static_cast<uint32_t>(node.exponents[0] + 127) << 23),
+					std::bit_cast<float>(static_cast<uint32_t>(node.exponents[1] + 127) << 23),
+					std::bit_cast<float>(static_cast<uint32_t>(node.exponents[2] + 127) << 23) };
+
+				// Leaves come first in childTriangles, inner children in childNodes
+				StackEntry children[2]{};
+				children[0] = node.IsLeaf(0) ?
+					StackEntry{ node.childTriangles, node.GetLeafCount(0), 0.f } :
+					StackEntry{ node.childNodes, 0, 0.f };
+				children[1] = node.IsLeaf(1) ?
+					StackEntry{ node.childTriangles + node.GetLeafCount(0), node.GetLeafCount(1), 0.f } :
+					StackEntry{ node.childNodes + !node.IsLeaf(0), 0, 0.f };
+
+				// Empty leaves only occur next to a root leaf, their bounds cannot be decoded
+				const float tMax = std::min(hitRecord.t, ray.max);
+				const bool hitLeft = !(node.IsLeaf(0) && children[0].count == 0) &&
+					SlabTest_QuantizedChild(node, 0, scale, origin, invDirection, tMax, children[0].tEntry);
+				const bool hitRight = !(node.IsLeaf(1) && children[1].count == 0) &&
+					SlabTest_QuantizedChild(node, 1, scale, origin, invDirection, tMax, children[1].tEntry);
+
+				// Visit the nearest child first by pushing it last
+				if (hitLeft && hitRight) {
+					if (children[0].tEntry <= children[1].tEntry) {
+						stack[stackSize++] = children[1];
+						stack[stackSize++] = children[0];
+					}
+					else {
+						stack[stackSize++] = children[0];
+						stack[stackSize++] = children[1];
+					}
+				}
+				else if (hitLeft) {
+					stack[stackSize++] = children[0];
+				}
+				else if (hitRight) {
+					stack[stackSize++] = children[1];
+				}
+			}
 
-					
+			return hitTriangle;
+		}
+
+		// Interpolates the texture coordinates of a triangle at the barycentrics of the hit and computes their gradients
+		// along the triangle. The gradients use the dual basis of the edges: dUdP . edge1 = u1 - u0 and dUdP . edge2 = u2 - u0
+		inline void SetTexCoords(const TriangleMesh& mesh, int triangle, HitRecord& hitRecord)
+		{
+			const int i0{ mesh.indices[triangle * 3] }, i1{ mesh.indices[triangle * 3 + 1] }, i2{ mesh.indices[triangle * 3 + 2] };
+			const TexCoord& t0 = mesh.texCoords[i0];
+			const TexCoord& t1 = mesh.texCoords[i1];
+			const TexCoord& t2 = mesh.texCoords[i2];
+
+			const float w0 = 1.f - hitRecord.u - hitRecord.v;
+			hitRecord.texCoord = { t0.u * w0 + t1.u * hitRecord.u + t2.u * hitRecord.v, t0.v * w0 + t1.v * hitRecord.u + t2.v * hitRecord.v };
+
+			const Vector3 edge1 = mesh.transformedPositions[i1] - mesh.transformedPositions[i0];
+			const Vector3 edge2 = mesh.transformedPositions[i2] - mesh.transformedPositions[i0];
+			const Vector3 normal = Vector3::Cross(edge1, edge2);
+			const float sqrArea = normal.SqrMagnitude();
+			if (sqrArea <= 0.f) {
+				hitRecord.dUdP = {};
+				hitRecord.dVdP = {};
+				return;
+			}
+
+			const Vector3 dual1 = Vector3::Cross(edge2, normal) / sqrArea;
+			const Vector3 dual2 = Vector3::Cross(normal, edge1) / sqrArea;
+			hitRecord.dUdP = dual1 * (t1.u - t0.u) + dual2 * (t2.u - t0.u);
+			hitRecord.dVdP = dual1 * (t1.v - t0.v) + dual2 * (t2.v - t0.v);
+		}
+
+		// Curvature of the surface the vertex normals of a triangle describe, how fast the normal turns per unit along its edges
+		// (1 / radius for the triangles of a sphere), positive where the surface bends away from its normals
+		inline float GetVertexNormalCurvature(const TriangleMesh& mesh, int triangle)
+		{
+			float curvature{ 0.f };
+			for (int edge{ 0 }; edge < 3; ++edge) {
+				const int i0{ mesh.indices[triangle * 3 + edge] }, i1{ mesh.indices[triangle * 3 + (edge + 1) % 3] };
+				const Vector3 positionDelta = mesh.transformedPositions[i1] - mesh.transformedPositions[i0];
+				const float sqrLength = positionDelta.SqrMagnitude();
+				if (sqrLength > 0.f) {
+					curvature += Vector3::Dot(mesh.transformedVertexNormals[i1] - mesh.transformedVertexNormals[i0], positionDelta) / sqrLength;
+				}
+			}
+			return curvature / 3.f;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (mesh.bvh.IsEmpty() || !SlabTest_TriangleMesh(mesh, ray)) {
+				return false;
+			}
+
+			// The BVH is built in object space, an affine transform keeps the ray distances the same
+			const Vector3 origin = mesh.worldToObject.TransformPoint(ray.origin);
+			const Vector3 direction = mesh.worldToObject.TransformVector(ray.direction);
+			const Vector3 invDirection{ 1.f / direction.x, 1.f / direction.y, 1.f / direction.z };
+
+			const int hitTriangle = mesh.bvh.quantizedNodes.empty() ?
+				Traverse_BVH(mesh, ray, origin, invDirection, hitRecord, ignoreHitRecord) :
+				Traverse_QuantizedBVH(mesh, ray, origin, invDirection, hitRecord, ignoreHitRecord);
+			const bool hitOccurred = hitTriangle >= 0;
+
+			// Smooth shading: interpolate the vertex normals of the closest triangle
+			if (hitTriangle >= 0 && !ignoreHitRecord && mesh.HasVertexNormals()) {
+				const float w0 = 1.f - hitRecord.u - hitRecord.v;
+				const Vector3 normal = mesh.transformedVertexNormals[mesh.indices[hitTriangle * 3]] * w0 +
+					mesh.transformedVertexNormals[mesh.indices[hitTriangle * 3 + 1]] * hitRecord.u +
+					mesh.transformedVertexNormals[mesh.indices[hitTriangle * 3 + 2]] * hitRecord.v;
+				hitRecord.normal = normal.Normalized();
+				hitRecord.curvature = GetVertexNormalCurvature(mesh, hitTriangle);
+			}
+
+			// Texture coordinates of the closest triangle, cleared for meshes without them so no earlier hit leaks its coordinates
+			if (hitTriangle >= 0 && !ignoreHitRecord) {
+				if (mesh.HasTexCoords()) {
+					SetTexCoords(mesh, hitTriangle, hitRecord);
+				}
+				else {
+					hitRecord.texCoord = {};
+					hitRecord.dUdP = {};
+					hitRecord.dVdP = {};
 				}
 			}
 
@@ -316,6 +718,549 @@ namespace dae
 		}
 
 
+#pragma endregion
+#pragma region Primitive BVH HitTest
+		//Traverses a world space BVH whose leaves index primitives directly. testLeaf(first, count, tClosest) tests the
+		//primitives of a leaf, lowers tClosest and returns the closest one or -1. With anyHit the first hit is returned
+		template<typename LeafTest>
+		inline int Traverse_PrimitiveBVH(const BVH& bvh, const Ray& ray, float& tClosest, bool anyHit, const LeafTest& testLeaf)
+		{
+			if (bvh.nodes.empty()) {
+				return -1;
+			}
+
+			const Vector3 invDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			struct StackEntry
+			{
+				uint32_t nodeIndex;
+				float tEntry;
+			};
+			StackEntry stack[64];
+			int stackSize{ 0 };
+
+			int hitPrimitive{ -1 };
+
+			float tEntry{};
+			if (SlabTest_BVHNode(bvh.nodes[0], ray.origin, invDirection, std::min(tClosest, ray.max), tEntry))
+				stack[stackSize++] = { 0, tEntry };
+
+			while (stackSize > 0) {
+				const StackEntry entry = stack[--stackSize];
+
+				// A closer hit was found after this node was pushed
+				if (entry.tEntry > tClosest) {
+					continue;
+				}
+
+				const BVHNode& node = bvh.nodes[entry.nodeIndex];
+				if (node.count > 0) {
+					const int primitive = testLeaf(node.leftFirst, node.count, tClosest);
+					if (primitive >= 0) {
+						hitPrimitive = primitive;
+
+						if (anyHit) {
+							return hitPrimitive;
+						}
+					}
+					continue;
+				}
+
+				// Visit the nearest child first by pushing it last
+				const float tMax = std::min(tClosest, ray.max);
+				float tLeft{}, tRight{};
+				const bool hitLeft = SlabTest_BVHNode(bvh.nodes[node.leftFirst], ray.origin, invDirection, tMax, tLeft);
+				const bool hitRight = SlabTest_BVHNode(bvh.nodes[node.leftFirst + 1], ray.origin, invDirection, tMax, tRight);
+
+				if (hitLeft && hitRight) {
+					if (tLeft <= tRight) {
+						stack[stackSize++] = { node.leftFirst + 1, tRight };
+						stack[stackSize++] = { node.leftFirst, tLeft };
+					}
+					else {
+						stack[stackSize++] = { node.leftFirst, tLeft };
+						stack[stackSize++] = { node.leftFirst + 1, tRight };
+					}
+				}
+				else if (hitLeft) {
+					stack[stackSize++] = { node.leftFirst, tLeft };
+				}
+				else if (hitRight) {
+					stack[stackSize++] = { node.leftFirst + 1, tRight };
+				}
+			}
+
+			return hitPrimitive;
+		}
+#pragma endregion
+#pragma region SphereSet HitTest
+		//SPHERE SET HIT-TESTS
+
+		//Tests spheres [first, first + count) of the set with the same quadratic as hitTestSphereAnalytical, 8 at a time.
+		//Returns the closest sphere with a t below tClosest and lowers tClosest to it, or -1
+		inline int HitTest_SphereBatch(const SphereSet& sphereSet, uint32_t first, uint32_t count, const Ray& ray, float& tClosest)
+		{
+			int hitSphere{ -1 };
+			const float a = Vector3::Dot(ray.direction, ray.direction);
+			const float invA = 1.0f / (2.0f * a);
+
+#if defined(__AVX2__)
+			const __m256 originX = _mm256_set1_ps(ray.origin.x), originY = _mm256_set1_ps(ray.origin.y), originZ = _mm256_set1_ps(ray.origin.z);
+			const __m256 directionX = _mm256_set1_ps(ray.direction.x), directionY = _mm256_set1_ps(ray.direction.y), directionZ = _mm256_set1_ps(ray.direction.z);
+			const __m256 fourA = _mm256_set1_ps(4 * a);
+			const __m256 invA8 = _mm256_set1_ps(invA);
+			const __m256 two = _mm256_set1_ps(2.0f);
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 rayMin = _mm256_set1_ps(ray.min), rayMax = _mm256_set1_ps(ray.max);
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+			for (uint32_t batch{ first }; batch < first + count; batch += SphereSet::batchSize)
+			{
+				//Masked loads stay inside the arrays for the last, partial batch
+				const __m256i loadMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(first + count - batch)), lanes);
+				const __m256 centerX = _mm256_maskload_ps(sphereSet.centers.x.data() + batch, loadMask);
+				const __m256 centerY = _mm256_maskload_ps(sphereSet.centers.y.data() + batch, loadMask);
+				const __m256 centerZ = _mm256_maskload_ps(sphereSet.centers.z.data() + batch, loadMask);
+				const __m256 radius = _mm256_maskload_ps(sphereSet.radii.data() + batch, loadMask);
+
+				const __m256 sphereToRayX = _mm256_sub_ps(originX, centerX);
+				const __m256 sphereToRayY = _mm256_sub_ps(originY, centerY);
+				const __m256 sphereToRayZ = _mm256_sub_ps(originZ, centerZ);
+
+				const __m256 b = _mm256_mul_ps(two, _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(directionX, sphereToRayX), _mm256_mul_ps(directionY, sphereToRayY)), _mm256_mul_ps(directionZ, sphereToRayZ)));
+				const __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(sphereToRayX, sphereToRayX), _mm256_mul_ps(sphereToRayY, sphereToRayY)), _mm256_mul_ps(sphereToRayZ, sphereToRayZ)),
+					_mm256_mul_ps(radius, radius));
+
+				const __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(fourA, c));
+				const __m256 sqrtDiscriminant = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+				const __m256 minusB = _mm256_sub_ps(zero, b);
+
+				const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(minusB, sqrtDiscriminant), invA8);
+				const __m256 t1 = _mm256_mul_ps(_mm256_add_ps(minusB, sqrtDiscriminant), invA8);
+
+				//The far intersection when the near one is outside the ray
+				const __m256 t0InRange = _mm256_and_ps(_mm256_cmp_ps(t0, rayMin, _CMP_GE_OQ), _mm256_cmp_ps(t0, rayMax, _CMP_LE_OQ));
+				const __m256 t = _mm256_blendv_ps(t1, t0, t0InRange);
+
+				__m256 isHit = _mm256_and_ps(_mm256_castsi256_ps(loadMask), _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ));
+				isHit = _mm256_and_ps(isHit, _mm256_and_ps(_mm256_cmp_ps(t, rayMin, _CMP_GE_OQ), _mm256_cmp_ps(t, rayMax, _CMP_LE_OQ)));
+				isHit = _mm256_and_ps(isHit, _mm256_cmp_ps(t, _mm256_set1_ps(tClosest), _CMP_LT_OQ));
+
+				if (_mm256_movemask_ps(isHit) == 0)
+					continue;
+
+				//Closest lane, the lowest one on ties like the scalar loop
+				float hitT[SphereSet::batchSize];
+				_mm256_storeu_ps(hitT, _mm256_blendv_ps(_mm256_set1_ps(FLT_MAX), t, isHit));
+				const int hitMask = _mm256_movemask_ps(isHit);
+				for (uint32_t lane{ 0 }; lane < SphereSet::batchSize; ++lane)
+				{
+					if ((hitMask >> lane) & 1 && hitT[lane] < tClosest)
+					{
+						tClosest = hitT[lane];
+						hitSphere = static_cast<int>(batch + lane);
+					}
+				}
+			}
+#else
+			for (uint32_t sphere{ first }; sphere < first + count; ++sphere)
+			{
+				const Vector3 sphereToRay = ray.origin - Vector3{ sphereSet.centers.x[sphere], sphereSet.centers.y[sphere], sphereSet.centers.z[sphere] };
+				const float b = 2.0f * Vector3::Dot(ray.direction, sphereToRay);
+				const float c = Vector3::Dot(sphereToRay, sphereToRay) - (sphereSet.radii[sphere] * sphereSet.radii[sphere]);
+
+				const float discriminant = b * b - 4 * a * c;
+				if (discriminant < 0)
+					continue;
+
+				const float sqrtDiscriminant = sqrtf(discriminant);
+				float t = (-b - sqrtDiscriminant) * invA;
+				if (t < ray.min || t > ray.max)
+					t = (-b + sqrtDiscriminant) * invA;
+
+				if (t >= ray.min && t <= ray.max && t < tClosest)
+				{
+					tClosest = t;
+					hitSphere = static_cast<int>(sphere);
+				}
+			}
+#endif
+
+			return hitSphere;
+		}
+
+		inline bool HitTest_SphereSet(const SphereSet& sphereSet, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float tClosest = hitRecord.t;
+			const int hitSphere = Traverse_PrimitiveBVH(sphereSet.bvh, ray, tClosest, ignoreHitRecord,
+				[&](uint32_t first, uint32_t count, float& t) { return HitTest_SphereBatch(sphereSet, first, count, ray, t); });
+
+			if (hitSphere < 0 || ignoreHitRecord) {
+				return hitSphere >= 0;
+			}
+
+			const Vector3 center{ sphereSet.centers.x[hitSphere], sphereSet.centers.y[hitSphere], sphereSet.centers.z[hitSphere] };
+			hitRecord.t = tClosest;
+			hitRecord.materialIndex = sphereSet.materialIndices[hitSphere];
+			hitRecord.didHit = true;
+			hitRecord.origin = ray.origin + ray.direction * tClosest;
+			hitRecord.normal = (hitRecord.origin - center).Normalized();
+			hitRecord.curvature = 1.f / sphereSet.radii[hitSphere];
+			return true;
+		}
+
+		inline bool HitTest_SphereSet(const SphereSet& sphereSet, const Ray& ray)
+		{
+			HitRecord temp{};
+			return HitTest_SphereSet(sphereSet, ray, temp, true);
+		}
+#pragma endregion
+#pragma region QuadSet HitTest
+		//QUAD HIT-TESTS
+
+		//Plane test of HitTest_Plane, then the hit point has to lie within both edges. u and v are the edge coordinates
+		inline bool HitTest_Quad(const Quad& quad, const Ray& ray, float& tClosest, float& u, float& v)
+		{
+			const float dotDirectionNormal = Vector3::Dot(ray.direction, quad.normal);
+			if (dotDirectionNormal == 0) {
+				return false;
+			}
+
+			const float t = Vector3::Dot((quad.origin - ray.origin), quad.normal) / dotDirectionNormal;
+			if (t <= ray.min || t >= ray.max || t >= tClosest) {
+				return false;
+			}
+
+			const Vector3 planar = ray.origin + ray.direction * t - quad.origin;
+			const float alpha = Vector3::Dot(quad.w, Vector3::Cross(planar, quad.edge2));
+			const float beta = Vector3::Dot(quad.w, Vector3::Cross(quad.edge1, planar));
+			if (alpha < 0.f || alpha > 1.f || beta < 0.f || beta > 1.f) {
+				return false;
+			}
+
+			tClosest = t;
+			u = alpha;
+			v = beta;
+			return true;
+		}
+
+		inline bool HitTest_QuadSet(const QuadSet& quadSet, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float tClosest = hitRecord.t;
+			float u{}, v{};
+			const int hitQuad = Traverse_PrimitiveBVH(quadSet.bvh, ray, tClosest, ignoreHitRecord,
+				[&](uint32_t first, uint32_t count, float& t) {
+					int closest{ -1 };
+					for (uint32_t i{ first }; i < first + count; ++i) {
+						if (HitTest_Quad(quadSet.quads[i], ray, t, u, v))
+							closest = static_cast<int>(i);
+					}
+					return closest;
+				});
+
+			if (hitQuad < 0 || ignoreHitRecord) {
+				return hitQuad >= 0;
+			}
+
+			const Quad& quad = quadSet.quads[hitQuad];
+			hitRecord.t = tClosest;
+			hitRecord.u = u;
+			hitRecord.v = v;
+			hitRecord.materialIndex = quad.materialIndex;
+			hitRecord.didHit = true;
+			hitRecord.origin = ray.origin + ray.direction * tClosest;
+			hitRecord.normal = quad.normal;
+			hitRecord.curvature = 0.f;
+			return true;
+		}
+
+		inline bool HitTest_QuadSet(const QuadSet& quadSet, const Ray& ray)
+		{
+			HitRecord temp{};
+			return HitTest_QuadSet(quadSet, ray, temp, true);
+		}
+#pragma endregion
+#pragma region Ray Packet HitTest
+		//RAY PACKET HIT-TESTS
+
+		//SlabTest_BVHNode for every ray of the packet at once, returns a bit per ray that enters the node
+		inline uint32_t SlabTest_PacketNode(const BVHNode& node, const RayPacket& packet)
+		{
+#if defined(__AVX2__)
+			//The operand order of min and max matches std::min and std::max, so the result is the same as the scalar test
+			const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min.x), _mm256_load_ps(packet.originX)), _mm256_load_ps(packet.invDirectionX));
+			const __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max.x), _mm256_load_ps(packet.originX)), _mm256_load_ps(packet.invDirectionX));
+			__m256 tmin = _mm256_min_ps(tx2, tx1);
+			__m256 tmax = _mm256_max_ps(tx2, tx1);
+
+			const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min.y), _mm256_load_ps(packet.originY)), _mm256_load_ps(packet.invDirectionY));
+			const __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max.y), _mm256_load_ps(packet.originY)), _mm256_load_ps(packet.invDirectionY));
+			tmin = _mm256_max_ps(_mm256_min_ps(ty2, ty1), tmin);
+			tmax = _mm256_min_ps(_mm256_max_ps(ty2, ty1), tmax);
+
+			const __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min.z), _mm256_load_ps(packet.originZ)), _mm256_load_ps(packet.invDirectionZ));
+			const __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max.z), _mm256_load_ps(packet.originZ)), _mm256_load_ps(packet.invDirectionZ));
+			tmin = _mm256_max_ps(_mm256_min_ps(tz2, tz1), tmin);
+			tmax = _mm256_min_ps(_mm256_max_ps(tz2, tz1), tmax);
+
+			const __m256 hit = _mm256_and_ps(
+				_mm256_and_ps(_mm256_cmp_ps(tmax, _mm256_setzero_ps(), _CMP_GE_OQ), _mm256_cmp_ps(tmax, tmin, _CMP_GE_OQ)),
+				_mm256_cmp_ps(tmin, _mm256_load_ps(packet.tMax), _CMP_LE_OQ));
+			return static_cast<uint32_t>(_mm256_movemask_ps(hit));
+#else
+			uint32_t mask{ 0 };
+			for (uint32_t lane{ 0 }; lane < RayPacket::size; ++lane) {
+				const Vector3 origin{ packet.originX[lane], packet.originY[lane], packet.originZ[lane] };
+				const Vector3 invDirection{ packet.invDirectionX[lane], packet.invDirectionY[lane], packet.invDirectionZ[lane] };
+				float tEntry{};
+				if (SlabTest_BVHNode(node, origin, invDirection, packet.tMax[lane], tEntry))
+					mask |= 1u << lane;
+			}
+			return mask;
+#endif
+		}
+
+		//Any hit traversal of a packet, every node is tested against all of its rays at once. testLeaf(first, count, mask)
+		//tests the primitives of a leaf against the rays in mask and returns the ones that hit. Occluded rays are cleared from activeMask
+		template<typename LeafTest>
+		inline void Traverse_PacketBVH(const BVH& bvh, const RayPacket& packet, uint32_t& activeMask, const LeafTest& testLeaf)
+		{
+			struct StackEntry
+			{
+				uint32_t nodeIndex;
+				uint32_t mask;
+			};
+			StackEntry stack[64];
+			int stackSize{ 0 };
+
+			const auto overlapsPacket = [&packet](const BVHNode& node) {
+				return node.min.x <= packet.bounds.max.x && node.max.x >= packet.bounds.min.x &&
+					node.min.y <= packet.bounds.max.y && node.max.y >= packet.bounds.min.y &&
+					node.min.z <= packet.bounds.max.z && node.max.z >= packet.bounds.min.z;
+				};
+
+			if (overlapsPacket(bvh.nodes[0])) {
+				const uint32_t mask = SlabTest_PacketNode(bvh.nodes[0], packet) & activeMask;
+				if (mask)
+					stack[stackSize++] = { 0, mask };
+			}
+
+			while (stackSize > 0 && activeMask) {
+				const StackEntry entry = stack[--stackSize];
+
+				// Rays that were occluded after this node was pushed are done
+				const uint32_t mask = entry.mask & activeMask;
+				if (!mask) {
+					continue;
+				}
+
+				const BVHNode& node = bvh.nodes[entry.nodeIndex];
+				if (node.count > 0) {
+					activeMask &= ~testLeaf(node.leftFirst, node.count, mask);
+					continue;
+				}
+
+				for (uint32_t child{ node.leftFirst }; child < node.leftFirst + 2; ++child) {
+					if (!overlapsPacket(bvh.nodes[child])) {
+						continue;
+					}
+
+					const uint32_t childMask = SlabTest_PacketNode(bvh.nodes[child], packet) & mask;
+					if (childMask)
+						stack[stackSize++] = { child, childMask };
+				}
+			}
+		}
+
+		//Calls test(lane) for every set bit of mask and returns the lanes it returned true for
+		template<typename LaneTest>
+		inline uint32_t TestLanes(uint32_t mask, const LaneTest& test)
+		{
+			uint32_t hits{ 0 };
+			for (; mask; mask &= mask - 1) {
+				const uint32_t lane = static_cast<uint32_t>(std::countr_zero(mask));
+				if (test(lane))
+					hits |= 1u << lane;
+			}
+			return hits;
+		}
+
+		//Any hit of the rays in activeMask (up to 8 world space rays) against a mesh, returns the rays that hit it
+		inline uint32_t HitTest_TriangleMeshPacket(const TriangleMesh& mesh, const Ray* pRays, uint32_t activeMask)
+		{
+			if (mesh.bvh.IsEmpty()) {
+				return 0;
+			}
+
+			// Quantized BVHs are traced ray by ray
+			if (!mesh.bvh.quantizedNodes.empty()) {
+				return TestLanes(activeMask, [&](uint32_t lane) { return HitTest_TriangleMesh(mesh, pRays[lane]); });
+			}
+
+			// The packet is traced in object space, the triangles are tested against the world space rays
+			RayPacket packet{};
+			const uint32_t mask = TestLanes(activeMask, [&](uint32_t lane) {
+				const Ray& ray = pRays[lane];
+				if (!SlabTest_TriangleMesh(mesh, ray)) {
+					return false;
+				}
+
+				packet.SetRay(lane, mesh.worldToObject.TransformPoint(ray.origin), mesh.worldToObject.TransformVector(ray.direction), ray.min, ray.max);
+				return true;
+				});
+
+			if (!mask) {
+				return 0;
+			}
+			packet.PadBounds();
+
+			// Every triangle of a leaf is fetched once and tested against all rays that reached it
+			uint32_t remaining{ mask };
+			Traverse_PacketBVH(mesh.bvh, packet, remaining, [&](uint32_t first, uint32_t count, uint32_t leafMask) {
+				uint32_t hits{ 0 };
+				for (uint32_t i{ first }; i < first + count && hits != leafMask; ++i) {
+					const Triangle triangle = GetMeshTriangle(mesh, mesh.bvh.triangleIndices[i]);
+					hits |= TestLanes(leafMask & ~hits, [&](uint32_t lane) {
+						HitRecord temp{};
+						return HitTest_Triangle(triangle, pRays[lane], temp);
+						});
+				}
+				return hits;
+				});
+
+			return mask & ~remaining;
+		}
+
+		//World space packet of the rays in activeMask, for spheres, planes and the BVHs of the primitive sets
+		inline RayPacket MakeRayPacket(const Ray* pRays, uint32_t activeMask)
+		{
+			RayPacket packet{};
+			TestLanes(activeMask, [&](uint32_t lane) {
+				packet.SetRay(lane, pRays[lane].origin, pRays[lane].direction, pRays[lane].min, pRays[lane].max);
+				return true;
+				});
+			packet.PadBounds();
+			return packet;
+		}
+
+		//TestIfRayHitSphere for every ray of a world space packet, returns the rays of activeMask that hit the sphere
+		inline uint32_t HitTest_SpherePacket(const Sphere& sphere, [[maybe_unused]] const RayPacket& packet, [[maybe_unused]] const Ray* pRays, uint32_t activeMask)
+		{
+#if defined(__AVX2__)
+			//Same operations in the same order as the scalar test
+			const __m256 directionX = _mm256_load_ps(packet.directionX), directionY = _mm256_load_ps(packet.directionY), directionZ = _mm256_load_ps(packet.directionZ);
+			const __m256 sphereToRayX = _mm256_sub_ps(_mm256_load_ps(packet.originX), _mm256_set1_ps(sphere.origin.x));
+			const __m256 sphereToRayY = _mm256_sub_ps(_mm256_load_ps(packet.originY), _mm256_set1_ps(sphere.origin.y));
+			const __m256 sphereToRayZ = _mm256_sub_ps(_mm256_load_ps(packet.originZ), _mm256_set1_ps(sphere.origin.z));
+
+			const auto dot = [](__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+				return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+				};
+
+			const __m256 a = dot(directionX, directionY, directionZ, directionX, directionY, directionZ);
+			const __m256 b = _mm256_mul_ps(_mm256_set1_ps(2.f), dot(directionX, directionY, directionZ, sphereToRayX, sphereToRayY, sphereToRayZ));
+			const __m256 c = _mm256_sub_ps(dot(sphereToRayX, sphereToRayY, sphereToRayZ, sphereToRayX, sphereToRayY, sphereToRayZ), _mm256_set1_ps(sphere.radius * sphere.radius));
+
+			const __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(4.f), a), c));
+			const __m256 sqrtDiscriminant = _mm256_sqrt_ps(discriminant);
+			const __m256 invA = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_mul_ps(_mm256_set1_ps(2.f), a));
+
+			const __m256 minusB = _mm256_sub_ps(_mm256_setzero_ps(), b);
+			const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(minusB, sqrtDiscriminant), invA);
+			const __m256 t1 = _mm256_mul_ps(_mm256_add_ps(minusB, sqrtDiscriminant), invA);
+
+			const __m256 rayMin = _mm256_load_ps(packet.tMin), rayMax = _mm256_load_ps(packet.tMax);
+			const __m256 hitT0 = _mm256_and_ps(_mm256_cmp_ps(t0, rayMin, _CMP_GE_OQ), _mm256_cmp_ps(t0, rayMax, _CMP_LE_OQ));
+			const __m256 hitT1 = _mm256_and_ps(_mm256_cmp_ps(t1, rayMin, _CMP_GE_OQ), _mm256_cmp_ps(t1, rayMax, _CMP_LE_OQ));
+			const __m256 hit = _mm256_and_ps(_mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ), _mm256_or_ps(hitT0, hitT1));
+
+			return static_cast<uint32_t>(_mm256_movemask_ps(hit)) & activeMask;
+#else
+			return TestLanes(activeMask, [&](uint32_t lane) { return TestIfRayHitSphere(sphere, pRays[lane]); });
+#endif
+		}
+
+		//Any hit HitTest_PlaneSet for every ray of a world space packet, one plane at a time for all rays
+		inline uint32_t HitTest_PlaneSetPacket(const PlaneSet& planeSet, [[maybe_unused]] const RayPacket& packet, const Ray* pRays, uint32_t activeMask)
+		{
+			// Rays starting at the precomputed origin use the stored numerators, they are tested on their own
+			const uint32_t count = static_cast<uint32_t>(planeSet.Size());
+			const bool hasPrecomputed = planeSet.precomputedNumerators.size() == count;
+			const uint32_t precomputedMask = !hasPrecomputed ? 0 :
+				TestLanes(activeMask, [&](uint32_t lane) { return pRays[lane].origin == planeSet.precomputedOrigin; });
+
+			uint32_t hits = TestLanes(precomputedMask, [&](uint32_t lane) { return HitTest_PlaneSet(planeSet, pRays[lane]); });
+			const uint32_t mask = activeMask & ~precomputedMask;
+
+#if defined(__AVX2__)
+			const __m256 originX = _mm256_load_ps(packet.originX), originY = _mm256_load_ps(packet.originY), originZ = _mm256_load_ps(packet.originZ);
+			const __m256 directionX = _mm256_load_ps(packet.directionX), directionY = _mm256_load_ps(packet.directionY), directionZ = _mm256_load_ps(packet.directionZ);
+			const __m256 rayMin = _mm256_load_ps(packet.tMin), rayMax = _mm256_load_ps(packet.tMax);
+
+			uint32_t planeHits{ 0 };
+			for (uint32_t plane{ 0 }; plane < count && (planeHits & mask) != mask; ++plane)
+			{
+				const __m256 normalX = _mm256_set1_ps(planeSet.normals.x[plane]);
+				const __m256 normalY = _mm256_set1_ps(planeSet.normals.y[plane]);
+				const __m256 normalZ = _mm256_set1_ps(planeSet.normals.z[plane]);
+
+				const __m256 toPlaneX = _mm256_sub_ps(_mm256_set1_ps(planeSet.origins.x[plane]), originX);
+				const __m256 toPlaneY = _mm256_sub_ps(_mm256_set1_ps(planeSet.origins.y[plane]), originY);
+				const __m256 toPlaneZ = _mm256_sub_ps(_mm256_set1_ps(planeSet.origins.z[plane]), originZ);
+				const __m256 numerator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toPlaneX, normalX), _mm256_mul_ps(toPlaneY, normalY)), _mm256_mul_ps(toPlaneZ, normalZ));
+				const __m256 denominator = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, normalX), _mm256_mul_ps(directionY, normalY)), _mm256_mul_ps(directionZ, normalZ));
+				const __m256 t = _mm256_div_ps(numerator, denominator);
+
+				const __m256 hit = _mm256_and_ps(_mm256_cmp_ps(denominator, _mm256_setzero_ps(), _CMP_NEQ_OQ),
+					_mm256_and_ps(_mm256_cmp_ps(t, rayMin, _CMP_GE_OQ), _mm256_cmp_ps(t, rayMax, _CMP_LE_OQ)));
+				planeHits |= static_cast<uint32_t>(_mm256_movemask_ps(hit));
+			}
+
+			return hits | (planeHits & mask);
+#else
+			return hits | TestLanes(mask, [&](uint32_t lane) { return HitTest_PlaneSet(planeSet, pRays[lane]); });
+#endif
+		}
+
+		inline uint32_t HitTest_SphereSetPacket(const SphereSet& sphereSet, const RayPacket& packet, const Ray* pRays, uint32_t activeMask)
+		{
+			if (sphereSet.bvh.nodes.empty() || !activeMask) {
+				return 0;
+			}
+
+			uint32_t remaining{ activeMask };
+			Traverse_PacketBVH(sphereSet.bvh, packet, remaining, [&](uint32_t first, uint32_t count, uint32_t leafMask) {
+				return TestLanes(leafMask, [&](uint32_t lane) {
+					float tClosest{ FLT_MAX };
+					return HitTest_SphereBatch(sphereSet, first, count, pRays[lane], tClosest) >= 0;
+					});
+				});
+
+			return activeMask & ~remaining;
+		}
+
+		inline uint32_t HitTest_QuadSetPacket(const QuadSet& quadSet, const RayPacket& packet, const Ray* pRays, uint32_t activeMask)
+		{
+			if (quadSet.bvh.nodes.empty() || !activeMask) {
+				return 0;
+			}
+
+			uint32_t remaining{ activeMask };
+			Traverse_PacketBVH(quadSet.bvh, packet, remaining, [&](uint32_t first, uint32_t count, uint32_t leafMask) {
+				return TestLanes(leafMask, [&](uint32_t lane) {
+					for (uint32_t i{ first }; i < first + count; ++i) {
+						float tClosest{ FLT_MAX }, u{}, v{};
+						if (HitTest_Quad(quadSet.quads[i], pRays[lane], tClosest, u, v))
+							return true;
+					}
+					return false;
+					});
+				});
+
+			return activeMask & ~remaining;
+		}
 #pragma endregion
 	}
 
@@ -327,12 +1272,102 @@ namespace dae
 			return Vector3(origin,light.origin);
 		}
 
-		inline ColorRGB GetRadiance(const Light& light, const Vector3& target, const Vector3& surfaceNormal)
+		//Cosine of the half angle of the cone of directions from target that hit a sphere light, -1 from inside of it
+		inline float GetSphereConeCos(const Light& light, const Vector3& target)
+		{
+			const float sinSq = Square(light.radius) / (light.origin - target).SqrMagnitude();
+			return sinSq < 1.f ? sqrtf(1.f - sinSq) : -1.f;
+		}
+
+		//Radiance arriving at target from lightPoint, a point on the light (its origin for point lights)
+		//For area lights this is the share of one uniformly picked point, averaging it over the points gives the light as a whole
+		inline ColorRGB GetRadiance(const Light& light, const Vector3& target, const Vector3& lightPoint)
+		{
+
+			Vector3 direction = lightPoint - target;
+			const float distanceSq = direction.SqrMagnitude();
+
+			switch (light.type)
+			{
+			case LightType::Rectangle:
+				//Lambertian emitter, the intensity is the one along its normal
+				return light.color * (light.intensity * std::max(-Vector3::Dot(light.direction, direction), 0.f) / (distanceSq * sqrtf(distanceSq)));
+			case LightType::Sphere:
+				//Lambertian emitter with the intensity of a point light in every direction, the points are picked uniformly over the
+				//cone of directions the sphere covers, so every point carries the same radiance divided by the pdf of the cone
+				return light.color * (2.f * light.intensity * (1.f - GetSphereConeCos(light, target)) / Square(light.radius));
+			default:
+				return light.color * (light.intensity/distanceSq);
+			}
+		}
+
+		//Point on an area light for the uniform random numbers u1 and u2, spheres are sampled over the cone they cover seen from target
+		inline Vector3 GetSamplePoint(const Light& light, const Vector3& target, float u1, float u2)
+		{
+			switch (light.type)
+			{
+			case LightType::Rectangle:
+				return light.origin + light.edge1 * (u1 - 0.5f) + light.edge2 * (u2 - 0.5f);
+			case LightType::Sphere:
+			{
+				const Vector3 toLight = light.origin - target;
+				const float distance = toLight.Magnitude();
+				const Vector3 w = toLight / distance;
+				Vector3 t{}, b{};
+				BRDF::GetTangentFrame(w, t, b);
+
+				const float cosTheta = 1.f - u1 * (1.f - GetSphereConeCos(light, target));
+				const float sinTheta = sqrtf(std::max(1.f - cosTheta * cosTheta, 0.f));
+				const float phi = PI_2 * u2;
+				const Vector3 direction = t * (sinTheta * cosf(phi)) + b * (sinTheta * sinf(phi)) + w * cosTheta;
+
+				//Closest intersection of the direction with the sphere, the far one from inside of it
+				const float halfChord = sqrtf(std::max(Square(light.radius) - Square(distance * sinTheta), 0.f));
+				const float t0 = distance * cosTheta - halfChord;
+				return target + direction * (t0 > 0.f ? t0 : distance * cosTheta + halfChord);
+			}
+			default:
+				return light.origin;
+			}
+		}
+
+		inline bool IsAreaLight(const Light& light)
 		{
+			return light.type == LightType::Rectangle || light.type == LightType::Sphere;
+		}
+
+		//Radius around origin that holds the whole light
+		inline float GetExtent(const Light& light)
+		{
+			switch (light.type)
+			{
+			case LightType::Rectangle:
+				return (light.edge1.Magnitude() + light.edge2.Magnitude()) * 0.5f;
+			case LightType::Sphere:
+				return light.radius;
+			default:
+				return 0.f;
+			}
+		}
+
+		inline AABB GetBounds(const Light& light)
+		{
+			const float extent = GetExtent(light);
+			return { light.origin - Vector3{ extent, extent, extent }, light.origin + Vector3{ extent, extent, extent } };
+		}
+
+		//Distance from origin beyond which the radiance of a light stays below cutoff, directional lights reach everything
+		inline float GetInfluenceRadius(const Light& light, float cutoff)
+		{
+			if (light.type == LightType::Directional)
+				return FLT_MAX;
 
-			Vector3 direction = light.origin - target;
+			const float brightest = std::max(light.color.r, std::max(light.color.g, light.color.b));
+			if (!IsAreaLight(light))
+				return sqrtf(light.intensity * brightest / cutoff);
 
-			return light.color * (light.intensity/(direction.SqrMagnitude()));
+			//Seen from outside of it, a sphere light shades at most like a point light on its surface
+			return sqrtf(light.intensity * brightest / cutoff) + GetExtent(light);
 		}
 
 	}
@@ -342,12 +1377,35 @@ namespace dae
 		//Just parses vertices and indices
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		//texCoords is left empty unless every vertex of the faces has texture coordinates
+		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<Vector3>& vertexNormals,
+			std::vector<TexCoord>& texCoords, std::vector<int>& indices)
 		{
 			std::ifstream file(filename);
 			if (!file)
 				return false;
 
+			std::vector<Vector3> filePositions{};
+			std::vector<Vector3> fileNormals{};
+			std::vector<TexCoord> fileTexCoords{};
+
+			//A vertex is a unique position/texture coordinate/normal triple, positions used with different ones get duplicated
+			struct VertexKey
+			{
+				int position, texCoord, normal;
+				bool operator==(const VertexKey&) const = default;
+			};
+			struct VertexKeyHash
+			{
+				size_t operator()(const VertexKey& key) const
+				{
+					return std::hash<uint64_t>{}((uint64_t(uint32_t(key.position)) << 32) ^ (uint64_t(uint32_t(key.texCoord)) << 16) ^ uint32_t(key.normal));
+				}
+			};
+			std::unordered_map<VertexKey, int, VertexKeyHash> vertexLookup{};
+			bool hasAllNormals = true;
+			bool hasAllTexCoords = true;
+
 			std::string sCommand;
 			// start a while iteration ending when the end of file is reached (ios::eof)
 			while (!file.eof())
@@ -364,16 +1422,60 @@ namespace dae
 					//Vertex
 					float x, y, z;
 					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
+					filePositions.push_back({ x, y, z });
+				}
+				else if (sCommand == "vn")
+				{
+					//Vertex Normal
+					float x, y, z;
+					file >> x >> y >> z;
+					fileNormals.push_back(Vector3{ x, y, z }.Normalized());
+				}
+				else if (sCommand == "vt")
+				{
+					//Texture Coordinate, OBJ puts v = 0 at the bottom of the image
+					float u, v;
+					file >> u >> v;
+					fileTexCoords.push_back({ u, 1.f - v });
 				}
 				else if (sCommand == "f")
 				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
-
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
+					//Faces are "v", "v/vt", "v//vn" or "v/vt/vn"
+					for (int i{ 0 }; i < 3; ++i)
+					{
+						std::string sVertex;
+						file >> sVertex;
+
+						const int positionIndex = std::stoi(sVertex) - 1;
+						int texCoordIndex = -1;
+						int normalIndex = -1;
+
+						const size_t firstSlash = sVertex.find('/');
+						const size_t secondSlash = firstSlash != std::string::npos ? sVertex.find('/', firstSlash + 1) : std::string::npos;
+						if (firstSlash != std::string::npos && firstSlash + 1 < sVertex.size() && sVertex[firstSlash + 1] != '/')
+							texCoordIndex = std::stoi(sVertex.substr(firstSlash + 1)) - 1;
+						if (secondSlash != std::string::npos && secondSlash + 1 < sVertex.size())
+							normalIndex = std::stoi(sVertex.substr(secondSlash + 1)) - 1;
+
+						hasAllNormals &= normalIndex >= 0;
+						hasAllTexCoords &= texCoordIndex >= 0;
+
+						const VertexKey key{ positionIndex, texCoordIndex, normalIndex };
+						const auto it = vertexLookup.find(key);
+						if (it != vertexLookup.end())
+						{
+							indices.push_back(it->second);
+							continue;
+						}
+
+						const int vertexIndex = static_cast<int>(positions.size());
+						positions.push_back(filePositions[positionIndex]);
+						vertexNormals.push_back(normalIndex >= 0 ? fileNormals[normalIndex] : Vector3::Zero);
+						texCoords.push_back(texCoordIndex >= 0 ? fileTexCoords[texCoordIndex] : TexCoord{});
+
+						vertexLookup[key] = vertexIndex;
+						indices.push_back(vertexIndex);
+					}
 				}
 				//read till end of line and ignore all remaining chars
 				file.ignore(1000, '\n');
@@ -382,6 +1484,12 @@ namespace dae
 					break;
 			}
 
+			//Without normals for every vertex the mesh computes its own (TriangleMesh::CalculateVertexNormals)
+			if (!hasAllNormals)
+				vertexNormals.clear();
+			if (!hasAllTexCoords)
+				texCoords.clear();
+
 			//Precompute normals
 			for (uint64_t index = 0; index < indices.size(); index += 3)
 			{
@@ -393,22 +1501,25 @@ namespace dae
 				Vector3 edgeV0V2 = positions[i2] - positions[i0];
 				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
 
-				if (isnan(normal.x))
-				{
-					int k = 0;
-				}
-
 				normal.Normalize();
-				if (isnan(normal.x))
-				{
-					int k = 0;
-				}
 
 				normals.push_back(normal);
 			}
 
 			return true;
 		}
+
+		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<Vector3>& vertexNormals, std::vector<int>& indices)
+		{
+			std::vector<TexCoord> texCoords{};
+			return ParseOBJ(filename, positions, normals, vertexNormals, texCoords, indices);
+		}
+
+		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		{
+			std::vector<Vector3> vertexNormals{};
+			return ParseOBJ(filename, positions, normals, vertexNormals, indices);
+		}
 #pragma warning(pop)
 	}
 }
\ No newline at end of file
@@ -155,6 +155,16 @@ namespace dae {
 		return *this;
 	}
 
+	bool Vector3::operator==(const Vector3& v) const
+	{
+		return x == v.x && y == v.y && z == v.z;
+	}
+
+	bool Vector3::operator!=(const Vector3& v) const
+	{
+		return !(*this == v);
+	}
+
 	float& Vector3::operator[](int index)
 	{
 		assert(index <= 2 && index >= 0);
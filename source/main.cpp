@@ -6,14 +6,295 @@
 
 //Standard includes
 #include <iostream>
+#include <fstream>
+#include <future>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "Material.h"
 
 using namespace dae;
 
+//Renders full frames of the bunny scene with every pixel order and saves the average frame time of each
+//#define BENCHMARK_PIXEL_ORDER
+
+void BenchmarkPixelOrders(Renderer* pRenderer, Scene* pScene, int numFrames = 20)
+{
+	const float secondsPerCount = 1.0f / static_cast<float>(SDL_GetPerformanceFrequency());
+	std::ofstream fileStream("benchmark_pixelorder.txt");
+
+	std::cout << "**PIXEL ORDER BENCHMARK STARTED**\n";
+	for (int order{}; order < 2; ++order)
+	{
+		//Warm up caches and the thread pool
+		pRenderer->ForceFullRedraw();
+		pRenderer->Render(pScene);
+
+		const uint64_t startTime = SDL_GetPerformanceCounter();
+		for (int frame{}; frame < numFrames; ++frame)
+		{
+			pRenderer->ForceFullRedraw();
+			pRenderer->Render(pScene);
+		}
+		const float avgMs = (SDL_GetPerformanceCounter() - startTime) * secondsPerCount * 1000.f / numFrames;
+
+		std::cout << ">> " << pRenderer->GetPixelOrderName() << " = " << avgMs << " ms" << std::endl;
+		fileStream << pRenderer->GetPixelOrderName() << " = " << avgMs << " ms" << std::endl;
+
+		pRenderer->CyclePixelOrder();
+	}
+	std::cout << "**PIXEL ORDER BENCHMARK FINISHED**\n";
+}
+
+//Rebuilds the mesh BVHs of the bunny scene with every build mode and saves the build time next to the average frame time
+//#define BENCHMARK_BVH
+
+void BenchmarkBVHs(Renderer* pRenderer, Scene* pScene, int numFrames = 20)
+{
+	const float secondsPerCount = 1.0f / static_cast<float>(SDL_GetPerformanceFrequency());
+	std::ofstream fileStream("benchmark_bvh.txt");
+
+	const struct
+	{
+		const char* name;
+		BVHBuildSettings settings;
+	} configurations[]
+	{
+		{ "Binned SAH", { BVHBuildMode::BinnedSAH } },
+		{ "SBVH (budget 10%)", { BVHBuildMode::SpatialSplits, 0.1f } },
+		{ "SBVH (budget 30%)", { BVHBuildMode::SpatialSplits, 0.3f } },
+		{ "SBVH (budget 100%)", { BVHBuildMode::SpatialSplits, 1.f } },
+		{ "LBVH (30 bit)", { BVHBuildMode::Linear } },
+		{ "LBVH (63 bit)", { BVHBuildMode::Linear, 0.f, 4, true } },
+		{ "LBVH (30 bit, treelets)", { BVHBuildMode::Linear, 0.f, 4, false, true } },
+		{ "Binned SAH (quantized)", { BVHBuildMode::BinnedSAH, 0.f, 4, false, false, true } },
+		{ "SBVH (budget 30%, quantized)", { BVHBuildMode::SpatialSplits, 0.3f, 4, false, false, true } },
+		{ "LBVH (30 bit, quantized)", { BVHBuildMode::Linear, 0.f, 4, false, false, true } }
+	};
+
+	std::cout << "**BVH BENCHMARK STARTED**\n";
+	for (const auto& configuration : configurations)
+	{
+		const Scene::BVHStats stats = pScene->RebuildBVHs(configuration.settings);
+
+		//Warm up caches and the thread pool
+		pRenderer->ForceFullRedraw();
+		pRenderer->Render(pScene);
+
+		const uint64_t startTime = SDL_GetPerformanceCounter();
+		for (int frame{}; frame < numFrames; ++frame)
+		{
+			pRenderer->ForceFullRedraw();
+			pRenderer->Render(pScene);
+		}
+		const float avgMs = (SDL_GetPerformanceCounter() - startTime) * secondsPerCount * 1000.f / numFrames;
+
+		for (std::ostream* pStream : { static_cast<std::ostream*>(&std::cout), static_cast<std::ostream*>(&fileStream) })
+		{
+			*pStream << ">> " << configuration.name << ": build = " << stats.buildTimeMs << " ms, trace = " << avgMs << " ms, "
+				<< stats.referenceCount << " references for " << stats.triangleCount << " triangles, " << stats.nodeCount << " nodes, "
+				<< stats.memoryBytes / 1024.f << " KiB" << std::endl;
+		}
+	}
+	std::cout << "**BVH BENCHMARK FINISHED**\n";
+}
+
+//Evaluates the Cook-Torrance BRDF for random light and view directions with the reference functions, the precomputed material
+//and the GGX table, and saves the time per evaluation next to the error against the reference
+//#define BENCHMARK_BRDF
+
+void BenchmarkBRDFs(uint32_t numSamples = 1 << 20)
+{
+	const float secondsPerCount = 1.0f / static_cast<float>(SDL_GetPerformanceFrequency());
+	std::ofstream fileStream("benchmark_brdf.txt");
+
+	//Directions are generated up front so only the BRDFs are timed
+	const Vector3 n{ 0.f, 1.f, 0.f };
+	std::vector<Vector3> lightDirections(numSamples), viewDirections(numSamples);
+	for (uint32_t i{ 0 }; i < numSamples; ++i)
+	{
+		lightDirections[i] = BRDF::SampleCosineHemisphere(n, ToUnitFloat(PcgHash(4 * i)), ToUnitFloat(PcgHash(4 * i + 1)));
+		viewDirections[i] = BRDF::SampleCosineHemisphere(n, ToUnitFloat(PcgHash(4 * i + 2)), ToUnitFloat(PcgHash(4 * i + 3)));
+	}
+
+	const auto measure = [&](auto&& function)
+		{
+			float sink{};
+			const uint64_t startTime = SDL_GetPerformanceCounter();
+			for (uint32_t i{ 0 }; i < numSamples; ++i)
+				sink += function(i);
+			const float ns = (SDL_GetPerformanceCounter() - startTime) * secondsPerCount * 1e9f / numSamples;
+			return std::make_pair(ns, sink);
+		};
+
+	//Relative error of the sum of the channels, tiny reference values are compared absolutely
+	const auto relativeError = [](float value, float reference)
+		{
+			return std::abs(value - reference) / std::max(std::abs(reference), 1e-3f);
+		};
+
+	const struct
+	{
+		const char* name;
+		ColorRGB albedo;
+		float metalness;
+	} materials[]
+	{
+		{ "Plastic", { .75f, .75f, .75f }, 0.f },
+		{ "Copper", { .955f, .637f, .538f }, 1.f }
+	};
+
+	std::cout << "**BRDF BENCHMARK STARTED**\n";
+	for (const auto& material : materials)
+	{
+		for (const float roughness : { .1f, .3f, .6f, 1.f })
+		{
+			Material_CookTorrence cookTorrance{ material.albedo, material.metalness, roughness };
+			HitRecord hitRecord{};
+			hitRecord.normal = n;
+
+			std::vector<float> reference(numSamples), referenceD(numSamples);
+			const auto [referenceNs, referenceSink] = measure([&](uint32_t i)
+				{
+					const ColorRGB color = BRDF::CookTorrance(n, lightDirections[i], viewDirections[i], material.albedo, material.metalness, roughness);
+					return reference[i] = color.r + color.g + color.b;
+				});
+			const auto [materialNs, materialSink] = measure([&](uint32_t i)
+				{
+					const ColorRGB color = cookTorrance.Shade(hitRecord, lightDirections[i], viewDirections[i]);
+					return color.r + color.g + color.b;
+				});
+			const auto [referenceDNs, referenceDSink] = measure([&](uint32_t i)
+				{
+					const Vector3 h = (lightDirections[i] + viewDirections[i]).Normalized();
+					return referenceD[i] = BRDF::NormalDistribution_GGX(n, h, roughness);
+				});
+			const auto [tableDNs, tableDSink] = measure([&](uint32_t i)
+				{
+					const Vector3 h = (lightDirections[i] + viewDirections[i]).Normalized();
+					return BRDF::NormalDistribution_GGXTable(Vector3::Dot(n, h), roughness);
+				});
+
+			//Errors are measured apart from the timing so they do not slow the timed loops down
+			float materialMax{}, materialMean{}, tableMax{}, tableMean{};
+			for (uint32_t i{ 0 }; i < numSamples; ++i)
+			{
+				const ColorRGB color = cookTorrance.Shade(hitRecord, lightDirections[i], viewDirections[i]);
+				const float materialError = relativeError(color.r + color.g + color.b, reference[i]);
+				materialMax = std::max(materialMax, materialError);
+				materialMean += materialError / numSamples;
+
+				const Vector3 h = (lightDirections[i] + viewDirections[i]).Normalized();
+				const float tableError = relativeError(BRDF::NormalDistribution_GGXTable(Vector3::Dot(n, h), roughness), referenceD[i]);
+				tableMax = std::max(tableMax, tableError);
+				tableMean += tableError / numSamples;
+			}
+
+			for (std::ostream* pStream : { static_cast<std::ostream*>(&std::cout), static_cast<std::ostream*>(&fileStream) })
+			{
+				*pStream << ">> " << material.name << ", roughness " << roughness << ": reference = " << referenceNs << " ns, precomputed = "
+					<< materialNs << " ns (max error " << materialMax << ", mean " << materialMean << "), GGX D = " << referenceDNs
+					<< " ns, GGX table = " << tableDNs << " ns (max error " << tableMax << ", mean " << tableMean << ")"
+					<< " [" << referenceSink + materialSink + referenceDSink + tableDSink << "]" << std::endl;
+			}
+		}
+	}
+	std::cout << "**BRDF BENCHMARK FINISHED**\n";
+}
+
+//Renders full frames of the many lights scene without light culling, once shading the lights one at a time and once 8 at a time,
+//and saves the average frame time of both
+//#define BENCHMARK_LIGHT_BATCHES
+
+void BenchmarkLightBatches(Renderer* pRenderer, Scene* pScene, int numFrames = 10)
+{
+	const float secondsPerCount = 1.0f / static_cast<float>(SDL_GetPerformanceFrequency());
+	std::ofstream fileStream("benchmark_lightbatches.txt");
+
+	//Every light is shaded for every hit
+	pRenderer->ToggleLightCulling();
+
+	std::cout << "**LIGHT BATCH BENCHMARK STARTED**\n";
+	for (const char* name : { "Batches of 8", "One at a time" })
+	{
+		//Warm up caches and the thread pool
+		pRenderer->ForceFullRedraw();
+		pRenderer->Render(pScene);
+
+		const uint64_t startTime = SDL_GetPerformanceCounter();
+		for (int frame{}; frame < numFrames; ++frame)
+		{
+			pRenderer->ForceFullRedraw();
+			pRenderer->Render(pScene);
+		}
+		const float avgMs = (SDL_GetPerformanceCounter() - startTime) * secondsPerCount * 1000.f / numFrames;
+
+		std::cout << ">> " << name << " = " << avgMs << " ms" << std::endl;
+		fileStream << name << " = " << avgMs << " ms" << std::endl;
+
+		pRenderer->ToggleLightBatches();
+	}
+	pRenderer->ToggleLightCulling();
+	std::cout << "**LIGHT BATCH BENCHMARK FINISHED**\n";
+}
+
+//Renders full frames of the mesh level of detail scene once for every level of detail mode
+//and saves the average frame time of each
+//#define BENCHMARK_MESH_LOD
+
+void BenchmarkMeshLODs(Renderer* pRenderer, Scene* pScene, int numFrames = 10)
+{
+	const float secondsPerCount = 1.0f / static_cast<float>(SDL_GetPerformanceFrequency());
+	std::ofstream fileStream("benchmark_meshlod.txt");
+
+	std::cout << "**MESH LOD BENCHMARK STARTED**\n";
+	for (int mode{}; mode < 3; ++mode)
+	{
+		//The selected levels only become visible in CommitFrame
+		pScene->CommitFrame();
+		const char* name{ pScene->GetMeshLODModeName() };
+
+		//Warm up caches and the thread pool
+		pRenderer->ForceFullRedraw();
+		pRenderer->Render(pScene);
+
+		const uint64_t startTime = SDL_GetPerformanceCounter();
+		for (int frame{}; frame < numFrames; ++frame)
+		{
+			pRenderer->ForceFullRedraw();
+			pRenderer->Render(pScene);
+		}
+		const float avgMs = (SDL_GetPerformanceCounter() - startTime) * secondsPerCount * 1000.f / numFrames;
+
+		std::cout << ">> " << name << " = " << avgMs << " ms" << std::endl;
+		fileStream << name << " = " << avgMs << " ms" << std::endl;
+
+		pScene->CycleMeshLODMode();
+	}
+	std::cout << "**MESH LOD BENCHMARK FINISHED**\n";
+}
+
+//Traces a million spheres through a SphereSet instead of the default scene
+//#define SPHERE_CLOUD
+
+//Shades 400 point lights through the light BVH instead of the default scene
+//#define MANY_LIGHTS
+
+//Metal and glass spheres instead of the default scene, press F8 to trace reflections and refractions
+//#define GLASS
+
+//Rectangle and sphere area lights instead of the default scene, press F2 for their soft shadows and F9 to compare with every sample traced
+//#define AREA_LIGHTS
+
+//Floor and wall with large tiled textures read through the texture cache instead of the default scene
+//#define TEXTURES
+
+//Rows of detailed rocks traced through their levels of detail instead of the default scene, press F11 to cycle the level of detail mode
+//(off by default) and F12 to let rays after a bounce trace coarser levels by their footprint
+//#define MESH_LOD
+
 void ShutDown(SDL_Window* pWindow)
 {
 	SDL_DestroyWindow(pWindow);
@@ -45,16 +326,64 @@ int main(int argc, char* args[])
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
 
+#if defined(BENCHMARK_PIXEL_ORDER)
+	const auto pScene = new Scene_W4_BunnyScene();
+	pScene->Initialize();
+	pScene->CommitFrame();
+	BenchmarkPixelOrders(pRenderer, pScene);
+#elif defined(BENCHMARK_BVH)
+	const auto pScene = new Scene_W4_BunnyScene();
+	pScene->Initialize();
+	pScene->CommitFrame();
+	BenchmarkBVHs(pRenderer, pScene);
+#elif defined(BENCHMARK_LIGHT_BATCHES)
+	const auto pScene = new Scene_ManyLights();
+	pScene->Initialize();
+	pScene->CommitFrame();
+	BenchmarkLightBatches(pRenderer, pScene);
+#elif defined(BENCHMARK_MESH_LOD)
+	const auto pScene = new Scene_MeshLOD();
+	pScene->Initialize();
+	BenchmarkMeshLODs(pRenderer, pScene);
+#elif defined(BENCHMARK_BRDF)
+	BenchmarkBRDFs();
+	const auto pScene = new Scene_W4();
+	pScene->Initialize();
+#elif defined(MANY_LIGHTS)
+	const auto pScene = new Scene_ManyLights();
+	pScene->Initialize();
+#elif defined(SPHERE_CLOUD)
+	const auto pScene = new Scene_SphereCloud();
+	pScene->Initialize();
+#elif defined(GLASS)
+	const auto pScene = new Scene_Glass();
+	pScene->Initialize();
+#elif defined(AREA_LIGHTS)
+	const auto pScene = new Scene_AreaLights();
+	pScene->Initialize();
+#elif defined(TEXTURES)
+	const auto pScene = new Scene_Textures();
+	pScene->Initialize();
+#elif defined(MESH_LOD)
+	const auto pScene = new Scene_MeshLOD();
+	pScene->Initialize();
+#else
 	const auto pScene = new Scene_W4();
 	pScene->Initialize();
+#endif
 
 	//Start loop
 	pTimer->Start();
 
+	//Prepare the first frame, after this every update overlaps with tracing the previous frame
+	pScene->Update(pTimer);
+	pScene->CommitFrame();
+
 	// Start Benchmark
 	// pTimer->StartBenchmark();
 
 	float printTimer = 0.f;
+	Renderer::FrameStats sampleStats{};
 	bool isLooping = true;
 	bool takeScreenshot = false;
 	while (isLooping)
@@ -75,11 +404,32 @@ int main(int argc, char* args[])
 			}
 		}
 
+		//--------- Render ---------
+		//Renderer settings only change between frames
+		pRenderer->Update();
+		if (takeScreenshot)
+		{
+			pRenderer->RequestScreenshot();
+			takeScreenshot = false;
+		}
+
+		auto renderJob = pRenderer->RenderAsync(pScene);
+
+		//Shows the previous frame while this one is traced, its surface is only packed over once this returned
+		pRenderer->Present();
+
 		//--------- Update ---------
+		//Prepares the next frame while this one is traced, the scene only makes it visible in CommitFrame
 		pScene->Update(pTimer);
-		pRenderer->Update();
-		//--------- Render ---------
-		pRenderer->Render(pScene);
+		pScene->UpdateBVHs();
+
+		renderJob.get();
+		pScene->CommitFrame();
+
+		const Renderer::FrameStats& frameStats = pRenderer->GetFrameStats();
+		sampleStats.sampleCount += frameStats.sampleCount;
+		sampleStats.traceSeconds += frameStats.traceSeconds;
+		sampleStats.busySeconds += frameStats.busySeconds;
 
 		//--------- Timer ---------
 		pTimer->Update();
@@ -88,16 +438,14 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
-		}
 
-		//Save screenshot after full render
-		if (takeScreenshot)
-		{
-			if (!pRenderer->SaveBufferToImage())
-				std::cout << "Screenshot saved!" << std::endl;
-			else
-				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
-			takeScreenshot = false;
+			//Samples per second of one thread stay the same as long as tracing scales linearly with the cores
+			if (sampleStats.sampleCount > 0)
+			{
+				std::cout << "Samples/s: " << sampleStats.sampleCount / sampleStats.traceSeconds
+					<< " (" << sampleStats.sampleCount / sampleStats.busySeconds << " per thread)" << std::endl;
+			}
+			sampleStats = {};
 		}
 	}
 	pTimer->Stop();